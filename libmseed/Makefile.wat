@@ -35,7 +35,8 @@ OBJS=	fileutils.obj	&
 	unpack.obj	&
 	unpackdata.obj  &
 	selection.obj	&
-	logging.obj
+	logging.obj	&
+	convertdata.obj
 
 all: lib
 
@@ -53,13 +54,14 @@ lmplatform.obj:	lmplatform.c libmseed.h
 lookup.obj:	lookup.c libmseed.h
 msrutils.obj:	msrutils.c libmseed.h
 pack.obj:	pack.c libmseed.h packdata.h
-packdata.obj:	packdata.c libmseed.h packdata.h
-traceutils.obj:	traceutils.c libmseed.h
-tracelist.obj:	tracelist.c libmseed.h
+packdata.obj:	packdata.c libmseed.h convertdata.h packdata.h
+traceutils.obj:	traceutils.c libmseed.h convertdata.h
+tracelist.obj:	tracelist.c libmseed.h convertdata.h
 parseutils.obj:	parseutils.c libmseed.h
 unpack.obj:	unpack.c libmseed.h unpackdata.h
-unpackdata.obj:	unpackdata.c libmseed.h unpackdata.h
+unpackdata.obj:	unpackdata.c libmseed.h convertdata.h unpackdata.h
 logging.obj:	logging.c libmseed.h
+convertdata.obj:	convertdata.c libmseed.h convertdata.h
 
 # How to compile sources:
 .c.obj:
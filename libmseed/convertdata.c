@@ -0,0 +1,380 @@
+/***************************************************************************
+ * convertdata.c:
+ *
+ * Routines for byte swapping arrays of samples and converting between
+ * sample types, used by the fixed-width encoders and decoders and the
+ * sample type conversion routines.
+ *
+ * Each routine processes a block of samples with SSE2, part of the
+ * x86-64 baseline, when available and the remainder with a scalar
+ * loop.  Swapping and non-swapping variants are separate loops so the
+ * swap flag is not tested per sample.
+ *
+ * Input and output may be the same buffer (in-place) for routines
+ * where the output quantity is not larger than the input quantity,
+ * otherwise they must not overlap.
+ *
+ * modified: 2026.289
+ ***************************************************************************/
+
+#include <memory.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libmseed.h"
+#include "convertdata.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+/* Swap bytes of each 16-bit, 32-bit and 64-bit quantity in a vector */
+#define SWAP16X8(V) _mm_or_si128 (_mm_slli_epi16 (V, 8), _mm_srli_epi16 (V, 8))
+#define SWAP32X4(V) SWAP16X8 (_mm_shufflehi_epi16 (_mm_shufflelo_epi16 (V, 0xB1), 0xB1))
+#define SWAP64X2(V) SWAP16X8 (_mm_shufflehi_epi16 (_mm_shufflelo_epi16 (V, 0x1B), 0x1B))
+#endif
+
+/************************************************************************
+ * ms_gswap2n:
+ *
+ * Copy count 16-bit quantities from input to output swapping the byte
+ * order of each, the quantities do not need to be memory aligned.
+ ************************************************************************/
+void
+ms_gswap2n (void *output, const void *input, int count)
+{
+  const uint8_t *in = (const uint8_t *)input;
+  uint8_t *out      = (uint8_t *)output;
+  uint16_t value;
+  int idx = 0;
+
+#if defined(__SSE2__)
+  __m128i vector;
+
+  for (; idx + 8 <= count; idx += 8)
+  {
+    vector = _mm_loadu_si128 ((const __m128i *)(in + 2 * idx));
+    _mm_storeu_si128 ((__m128i *)(out + 2 * idx), SWAP16X8 (vector));
+  }
+#endif
+
+  for (; idx < count; idx++)
+  {
+    memcpy (&value, in + 2 * idx, 2);
+    ms_gswap2a (&value);
+    memcpy (out + 2 * idx, &value, 2);
+  }
+} /* End of ms_gswap2n() */
+
+/************************************************************************
+ * ms_gswap4n:
+ *
+ * Copy count 32-bit quantities from input to output swapping the byte
+ * order of each, the quantities do not need to be memory aligned.
+ ************************************************************************/
+void
+ms_gswap4n (void *output, const void *input, int count)
+{
+  const uint8_t *in = (const uint8_t *)input;
+  uint8_t *out      = (uint8_t *)output;
+  uint32_t value;
+  int idx = 0;
+
+#if defined(__SSE2__)
+  __m128i vector;
+
+  for (; idx + 4 <= count; idx += 4)
+  {
+    vector = _mm_loadu_si128 ((const __m128i *)(in + 4 * idx));
+    _mm_storeu_si128 ((__m128i *)(out + 4 * idx), SWAP32X4 (vector));
+  }
+#endif
+
+  for (; idx < count; idx++)
+  {
+    memcpy (&value, in + 4 * idx, 4);
+    ms_gswap4a (&value);
+    memcpy (out + 4 * idx, &value, 4);
+  }
+} /* End of ms_gswap4n() */
+
+/************************************************************************
+ * ms_gswap8n:
+ *
+ * Copy count 64-bit quantities from input to output swapping the byte
+ * order of each, the quantities do not need to be memory aligned.
+ ************************************************************************/
+void
+ms_gswap8n (void *output, const void *input, int count)
+{
+  const uint8_t *in = (const uint8_t *)input;
+  uint8_t *out      = (uint8_t *)output;
+  uint32_t value[2];
+  int idx = 0;
+
+#if defined(__SSE2__)
+  __m128i vector;
+
+  for (; idx + 2 <= count; idx += 2)
+  {
+    vector = _mm_loadu_si128 ((const __m128i *)(in + 8 * idx));
+    _mm_storeu_si128 ((__m128i *)(out + 8 * idx), SWAP64X2 (vector));
+  }
+#endif
+
+  for (; idx < count; idx++)
+  {
+    memcpy (value, in + 8 * idx, 8);
+    ms_gswap8a (value);
+    memcpy (out + 8 * idx, value, 8);
+  }
+} /* End of ms_gswap8n() */
+
+/************************************************************************
+ * ms_convert_int16_int32:
+ *
+ * Convert count 16-bit integers to 32-bit integers, swapping the byte
+ * order of the input if swapflag is true.
+ ************************************************************************/
+void
+ms_convert_int16_int32 (const int16_t *input, int32_t *output,
+                        int count, int swapflag)
+{
+  int16_t sample;
+  int idx = 0;
+
+#if defined(__SSE2__)
+  __m128i vector;
+
+  /* Sign extend by placing each value in the top of a 32-bit lane */
+  if (swapflag)
+  {
+    for (; idx + 8 <= count; idx += 8)
+    {
+      vector = _mm_loadu_si128 ((const __m128i *)(input + idx));
+      vector = SWAP16X8 (vector);
+      _mm_storeu_si128 ((__m128i *)(output + idx), _mm_srai_epi32 (_mm_unpacklo_epi16 (vector, vector), 16));
+      _mm_storeu_si128 ((__m128i *)(output + idx + 4), _mm_srai_epi32 (_mm_unpackhi_epi16 (vector, vector), 16));
+    }
+  }
+  else
+  {
+    for (; idx + 8 <= count; idx += 8)
+    {
+      vector = _mm_loadu_si128 ((const __m128i *)(input + idx));
+      _mm_storeu_si128 ((__m128i *)(output + idx), _mm_srai_epi32 (_mm_unpacklo_epi16 (vector, vector), 16));
+      _mm_storeu_si128 ((__m128i *)(output + idx + 4), _mm_srai_epi32 (_mm_unpackhi_epi16 (vector, vector), 16));
+    }
+  }
+#endif
+
+  for (; idx < count; idx++)
+  {
+    sample = input[idx];
+
+    if (swapflag)
+      ms_gswap2a (&sample);
+
+    output[idx] = (int32_t)sample;
+  }
+} /* End of ms_convert_int16_int32() */
+
+/************************************************************************
+ * ms_convert_int32_int16:
+ *
+ * Convert count 32-bit integers to 16-bit integers by truncation,
+ * swapping the byte order of the output if swapflag is true.
+ ************************************************************************/
+void
+ms_convert_int32_int16 (const int32_t *input, int16_t *output,
+                        int count, int swapflag)
+{
+  int idx = 0;
+
+#if defined(__SSE2__)
+  __m128i lo, hi, vector;
+
+  /* Truncate by sign extending the low 16 bits so the saturating pack is exact */
+  if (swapflag)
+  {
+    for (; idx + 8 <= count; idx += 8)
+    {
+      lo     = _mm_loadu_si128 ((const __m128i *)(input + idx));
+      hi     = _mm_loadu_si128 ((const __m128i *)(input + idx + 4));
+      vector = _mm_packs_epi32 (_mm_srai_epi32 (_mm_slli_epi32 (lo, 16), 16),
+                                _mm_srai_epi32 (_mm_slli_epi32 (hi, 16), 16));
+      _mm_storeu_si128 ((__m128i *)(output + idx), SWAP16X8 (vector));
+    }
+  }
+  else
+  {
+    for (; idx + 8 <= count; idx += 8)
+    {
+      lo     = _mm_loadu_si128 ((const __m128i *)(input + idx));
+      hi     = _mm_loadu_si128 ((const __m128i *)(input + idx + 4));
+      vector = _mm_packs_epi32 (_mm_srai_epi32 (_mm_slli_epi32 (lo, 16), 16),
+                                _mm_srai_epi32 (_mm_slli_epi32 (hi, 16), 16));
+      _mm_storeu_si128 ((__m128i *)(output + idx), vector);
+    }
+  }
+#endif
+
+  for (; idx < count; idx++)
+  {
+    output[idx] = (int16_t)input[idx];
+
+    if (swapflag)
+      ms_gswap2a (&output[idx]);
+  }
+} /* End of ms_convert_int32_int16() */
+
+/************************************************************************
+ * ms_convert_int32_float:
+ *
+ * Convert count 32-bit integers to 32-bit floats.
+ ************************************************************************/
+void
+ms_convert_int32_float (const int32_t *input, float *output, int64_t count)
+{
+  int64_t idx = 0;
+
+#if defined(__SSE2__)
+  for (; idx + 4 <= count; idx += 4)
+    _mm_storeu_ps (output + idx, _mm_cvtepi32_ps (_mm_loadu_si128 ((const __m128i *)(input + idx))));
+#endif
+
+  for (; idx < count; idx++)
+    output[idx] = (float)input[idx];
+} /* End of ms_convert_int32_float() */
+
+/************************************************************************
+ * ms_convert_int32_double:
+ *
+ * Convert count 32-bit integers to 64-bit doubles.
+ ************************************************************************/
+void
+ms_convert_int32_double (const int32_t *input, double *output, int64_t count)
+{
+  int64_t idx = 0;
+
+#if defined(__SSE2__)
+  __m128i vector;
+
+  for (; idx + 4 <= count; idx += 4)
+  {
+    vector = _mm_loadu_si128 ((const __m128i *)(input + idx));
+    _mm_storeu_pd (output + idx, _mm_cvtepi32_pd (vector));
+    _mm_storeu_pd (output + idx + 2, _mm_cvtepi32_pd (_mm_unpackhi_epi64 (vector, vector)));
+  }
+#endif
+
+  for (; idx < count; idx++)
+    output[idx] = (double)input[idx];
+} /* End of ms_convert_int32_double() */
+
+/************************************************************************
+ * ms_convert_float_double:
+ *
+ * Convert count 32-bit floats to 64-bit doubles.
+ ************************************************************************/
+void
+ms_convert_float_double (const float *input, double *output, int64_t count)
+{
+  int64_t idx = 0;
+
+#if defined(__SSE2__)
+  __m128 vector;
+
+  for (; idx + 4 <= count; idx += 4)
+  {
+    vector = _mm_loadu_ps (input + idx);
+    _mm_storeu_pd (output + idx, _mm_cvtps_pd (vector));
+    _mm_storeu_pd (output + idx + 2, _mm_cvtps_pd (_mm_movehl_ps (vector, vector)));
+  }
+#endif
+
+  for (; idx < count; idx++)
+    output[idx] = (double)input[idx];
+} /* End of ms_convert_float_double() */
+
+/************************************************************************
+ * ms_convert_double_float:
+ *
+ * Convert count 64-bit doubles to 32-bit floats.
+ ************************************************************************/
+void
+ms_convert_double_float (const double *input, float *output, int64_t count)
+{
+  int64_t idx = 0;
+
+#if defined(__SSE2__)
+  __m128 lo, hi;
+
+  for (; idx + 4 <= count; idx += 4)
+  {
+    lo = _mm_cvtpd_ps (_mm_loadu_pd (input + idx));
+    hi = _mm_cvtpd_ps (_mm_loadu_pd (input + idx + 2));
+    _mm_storeu_ps (output + idx, _mm_movelh_ps (lo, hi));
+  }
+#endif
+
+  for (; idx < count; idx++)
+    output[idx] = (float)input[idx];
+} /* End of ms_convert_double_float() */
+
+/************************************************************************
+ * ms_convert_float_int32:
+ *
+ * Convert count 32-bit floats to 32-bit integers with simple
+ * rounding, adding 0.5 to the sample value before converting
+ * (truncating) to integer.
+ ************************************************************************/
+void
+ms_convert_float_int32 (const float *input, int32_t *output, int64_t count)
+{
+  int64_t idx = 0;
+
+#if defined(__SSE2__)
+  const __m128d half = _mm_set1_pd (0.5);
+  __m128 vector;
+  __m128i lo, hi;
+
+  for (; idx + 4 <= count; idx += 4)
+  {
+    vector = _mm_loadu_ps (input + idx);
+    lo     = _mm_cvttpd_epi32 (_mm_add_pd (_mm_cvtps_pd (vector), half));
+    hi     = _mm_cvttpd_epi32 (_mm_add_pd (_mm_cvtps_pd (_mm_movehl_ps (vector, vector)), half));
+    _mm_storeu_si128 ((__m128i *)(output + idx), _mm_unpacklo_epi64 (lo, hi));
+  }
+#endif
+
+  for (; idx < count; idx++)
+    output[idx] = (int32_t) (input[idx] + 0.5);
+} /* End of ms_convert_float_int32() */
+
+/************************************************************************
+ * ms_convert_double_int32:
+ *
+ * Convert count 64-bit doubles to 32-bit integers with simple
+ * rounding, adding 0.5 to the sample value before converting
+ * (truncating) to integer.
+ ************************************************************************/
+void
+ms_convert_double_int32 (const double *input, int32_t *output, int64_t count)
+{
+  int64_t idx = 0;
+
+#if defined(__SSE2__)
+  const __m128d half = _mm_set1_pd (0.5);
+  __m128i lo, hi;
+
+  for (; idx + 4 <= count; idx += 4)
+  {
+    lo = _mm_cvttpd_epi32 (_mm_add_pd (_mm_loadu_pd (input + idx), half));
+    hi = _mm_cvttpd_epi32 (_mm_add_pd (_mm_loadu_pd (input + idx + 2), half));
+    _mm_storeu_si128 ((__m128i *)(output + idx), _mm_unpacklo_epi64 (lo, hi));
+  }
+#endif
+
+  for (; idx < count; idx++)
+    output[idx] = (int32_t) (input[idx] + 0.5);
+} /* End of ms_convert_double_int32() */
@@ -0,0 +1,35 @@
+/***************************************************************************
+ * convertdata.h:
+ *
+ * Interface declarations for the sample byte swapping and conversion
+ * routines in convertdata.c
+ *
+ * modified: 2026.289
+ ***************************************************************************/
+
+#ifndef CONVERTDATA_H
+#define CONVERTDATA_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void ms_gswap2n (void *output, const void *input, int count);
+extern void ms_gswap4n (void *output, const void *input, int count);
+extern void ms_gswap8n (void *output, const void *input, int count);
+extern void ms_convert_int16_int32 (const int16_t *input, int32_t *output,
+                                    int count, int swapflag);
+extern void ms_convert_int32_int16 (const int32_t *input, int16_t *output,
+                                    int count, int swapflag);
+extern void ms_convert_int32_float (const int32_t *input, float *output, int64_t count);
+extern void ms_convert_int32_double (const int32_t *input, double *output, int64_t count);
+extern void ms_convert_float_double (const float *input, double *output, int64_t count);
+extern void ms_convert_double_float (const double *input, float *output, int64_t count);
+extern void ms_convert_float_int32 (const float *input, int32_t *output, int64_t count);
+extern void ms_convert_double_int32 (const double *input, int32_t *output, int64_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -84,7 +84,7 @@ int8_t packtypes[9][3] = {
  *********************************************************************/
 
 /* Initialize the global file reading parameters */
-MSFileParam gMSFileParam = {NULL, "", NULL, 0, 0, 0, 0, 0, 0, 0};
+MSFileParam gMSFileParam = {NULL, "", NULL, 0, 0, 0, 0, 0, 0, 0, NULL, NULL, NULL, NULL};
 
 /**********************************************************************
  * ms_readmsr:
@@ -169,6 +169,83 @@ ms_shift_msfp (MSFileParam *msfp, int shift)
 /* Macro to return current reading position */
 #define MSFPREADPTR(MSFP) (MSFP->rawrec + MSFP->readoffset)
 
+/**********************************************************************
+ * ms_init_msfp:
+ *
+ * Allocate and initialize file reading parameters.
+ *
+ * Returns a pointer to a MSFileParam struct on success or NULL on
+ * error.
+ *********************************************************************/
+static MSFileParam *
+ms_init_msfp (void)
+{
+  MSFileParam *msfp;
+
+  if (!(msfp = (MSFileParam *)malloc (sizeof (MSFileParam))))
+    return NULL;
+
+  msfp->fp            = NULL;
+  msfp->filename[0]   = '\0';
+  msfp->rawrec        = NULL;
+  msfp->readlen       = 0;
+  msfp->readoffset    = 0;
+  msfp->packtype      = 0;
+  msfp->packhdroffset = 0;
+  msfp->filepos       = 0;
+  msfp->filesize      = 0;
+  msfp->recordcount   = 0;
+  msfp->map           = NULL;
+  msfp->packctx       = NULL;
+  msfp->recordfilter  = NULL;
+  msfp->filterdata    = NULL;
+
+  return msfp;
+} /* End of ms_init_msfp() */
+
+/**********************************************************************
+ * ms_readmsr_setfilter:
+ *
+ * Set a filter for records read with ms_readmsr_main() and
+ * ms_readmsr_mmap() using the file reading parameters at *ppmsfp,
+ * allocating the parameters if needed.  The filter is removed when
+ * the reading parameters are reset by calling the reader with msfile
+ * set to NULL.
+ *
+ * The recordfilter() function is called with each raw record detected
+ * in the file before it is unpacked, the record length, the file
+ * position of the record and the filterdata pointer.  If it returns 0
+ * the record is skipped without unpacking, otherwise the record is
+ * unpacked and returned.  ms_recheaderinfo() may be used to test the
+ * record.  The filter is only used when the record length is known
+ * before unpacking, i.e. the record contains a Blockette 1000 or the
+ * record length was specified.
+ *
+ * Returns 0 on success and -1 on error.
+ *********************************************************************/
+int
+ms_readmsr_setfilter (MSFileParam **ppmsfp,
+                      int (*recordfilter) (char *, int, off_t, void *),
+                      void *filterdata)
+{
+  if (!ppmsfp)
+    return -1;
+
+  if (!*ppmsfp)
+  {
+    if (!(*ppmsfp = ms_init_msfp ()))
+    {
+      ms_log (2, "ms_readmsr_setfilter(): Cannot allocate memory for MSFP\n");
+      return -1;
+    }
+  }
+
+  (*ppmsfp)->recordfilter = recordfilter;
+  (*ppmsfp)->filterdata   = filterdata;
+
+  return 0;
+} /* End of ms_readmsr_setfilter() */
+
 /**********************************************************************
  * ms_readmsr_main:
  *
@@ -202,6 +279,11 @@ ms_shift_msfp (MSFileParam *msfp, int shift)
  *
  * dataflag will be passed directly to msr_unpack().
  *
+ * The record header buffers of the MSRecord, including blockettes,
+ * are retained in MSFileParam->packctx and reused for the following
+ * records, the allocations made for them are counted in
+ * MSFileParam->packctx->allocations until cleanup.
+ *
  * If a Selections list is supplied it will be used to determine when
  * a section of data in a packed file may be skipped, packed files are
  * internal to the IRIS DMC.
@@ -239,9 +321,7 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
   /* Initialize the file read parameters if needed */
   if (!msfp)
   {
-    msfp = (MSFileParam *)malloc (sizeof (MSFileParam));
-
-    if (msfp == NULL)
+    if (!(msfp = ms_init_msfp ()))
     {
       ms_log (2, "ms_readmsr_main(): Cannot allocate memory for MSFP\n");
       return MS_GENERROR;
@@ -249,17 +329,6 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
 
     /* Redirect the supplied pointer to the allocated params */
     *ppmsfp = msfp;
-
-    msfp->fp            = NULL;
-    msfp->filename[0]   = '\0';
-    msfp->rawrec        = NULL;
-    msfp->readlen       = 0;
-    msfp->readoffset    = 0;
-    msfp->packtype      = 0;
-    msfp->packhdroffset = 0;
-    msfp->filepos       = 0;
-    msfp->filesize      = 0;
-    msfp->recordcount   = 0;
   }
 
   /* When cleanup is requested */
@@ -273,6 +342,11 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
     if (msfp->rawrec != NULL)
       free (msfp->rawrec);
 
+    if (msfp->map != NULL)
+      lmp_unmapfile (msfp->map, msfp->filesize);
+
+    ms_freepackcontext (&msfp->packctx);
+
     /* If the file parameters are the global parameters reset them */
     if (*ppmsfp == &gMSFileParam)
     {
@@ -286,6 +360,10 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
       gMSFileParam.filepos       = 0;
       gMSFileParam.filesize      = 0;
       gMSFileParam.recordcount   = 0;
+      gMSFileParam.map           = NULL;
+      gMSFileParam.packctx       = NULL;
+      gMSFileParam.recordfilter  = NULL;
+      gMSFileParam.filterdata    = NULL;
     }
     /* Otherwise free the MSFileParam */
     else
@@ -307,6 +385,13 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
     }
   }
 
+  /* Allocate context for reusing record header buffers */
+  if (msfp->packctx == NULL)
+  {
+    if (!(msfp->packctx = ms_initpackcontext ()))
+      return MS_GENERROR;
+  }
+
   /* Sanity check: track if we are reading the same file */
   if (msfp->fp && strncmp (msfile, msfp->filename, sizeof (msfp->filename)))
   {
@@ -546,7 +631,25 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
       if (msfp->packhdroffset && msfp->packhdroffset < (msfp->filepos + MSFPBUFLEN (msfp)))
         parselen = msfp->packhdroffset - msfp->filepos;
 
-      parseval = msr_parse (MSFPREADPTR (msfp), parselen, ppmsr, reclen, dataflag, verbose);
+      /* Skip records rejected by the record filter without unpacking */
+      if (msfp->recordfilter)
+      {
+        int filterlen = (reclen > 0) ? reclen : ms_detect (MSFPREADPTR (msfp), parselen);
+
+        if (filterlen >= MINRECLEN && filterlen <= parselen &&
+            !msfp->recordfilter (MSFPREADPTR (msfp), filterlen, msfp->filepos, msfp->filterdata))
+        {
+          /* Update reading offset, file position and record count */
+          msfp->readoffset += filterlen;
+          msfp->filepos += filterlen;
+          msfp->recordcount++;
+
+          parseval = 0;
+          continue;
+        }
+      }
+
+      parseval = msr_parse_r (msfp->packctx, MSFPREADPTR (msfp), parselen, ppmsr, reclen, dataflag, verbose);
 
       /* Record detected and parsed */
       if (parseval == 0)
@@ -707,6 +810,280 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
   return retcode;
 } /* End of ms_readmsr_main() */
 
+/**********************************************************************
+ * ms_readmsr_mmap:
+ *
+ * This routine is an alternative to ms_readmsr_main() that maps the
+ * entire input file into memory and parses records directly from the
+ * mapping, avoiding the copying of file contents into a read buffer.
+ * The arguments, the handling of *fpos (including negative values as
+ * a starting offset), *last, skipnotdata and return values are the
+ * same as for ms_readmsr_main().
+ *
+ * The record buffer of each returned MSRecord (MSRecord.record)
+ * points directly into the read-only mapping and is valid until the
+ * file is closed.  The file must not be truncated while mapped.
+ *
+ * Standard input, packed files and files that cannot be mapped
+ * (e.g. empty files or platforms without mmap support) are
+ * transparently read using ms_readmsr_main().
+ *
+ * After reading all the records in a file the controlling program
+ * should call it one last time with msfile set to NULL.  This will
+ * release the mapping and free allocated memory.
+ *
+ * Returns MS_NOERROR and populates an MSRecord struct at *ppmsr on
+ * successful read, returns MS_ENDOFFILE on EOF, otherwise returns a
+ * libmseed error code (listed in libmseed.h) and *ppmsr is set to
+ * NULL.
+ *********************************************************************/
+int
+ms_readmsr_mmap (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
+                 int reclen, off_t *fpos, int *last, flag skipnotdata,
+                 flag dataflag, Selections *selections, flag verbose)
+{
+  MSFileParam *msfp;
+  off_t remaining;
+  int parselen;
+  int parseval = 0;
+  int retcode  = MS_NOERROR;
+
+  if (!ppmsr)
+    return MS_GENERROR;
+
+  if (!ppmsfp)
+    return MS_GENERROR;
+
+  msfp = *ppmsfp;
+
+  /* Cleanup and all reading not done from a mapping is handled by ms_readmsr_main() */
+  if (msfile == NULL || (msfp && msfp->fp) || strcmp (msfile, "-") == 0)
+    return ms_readmsr_main (ppmsfp, ppmsr, msfile, reclen, fpos, last,
+                            skipnotdata, dataflag, selections, verbose);
+
+  /* Initialize the file read parameters if needed */
+  if (!msfp)
+  {
+    if (!(msfp = ms_init_msfp ()))
+    {
+      ms_log (2, "ms_readmsr_mmap(): Cannot allocate memory for MSFP\n");
+      return MS_GENERROR;
+    }
+
+    /* Redirect the supplied pointer to the allocated params */
+    *ppmsfp = msfp;
+  }
+
+  /* Allocate context for reusing record header buffers */
+  if (msfp->packctx == NULL)
+  {
+    if (!(msfp->packctx = ms_initpackcontext ()))
+      return MS_GENERROR;
+  }
+
+  /* Sanity check: track if we are reading the same file */
+  if (msfp->map && strncmp (msfile, msfp->filename, sizeof (msfp->filename)))
+  {
+    ms_log (2, "ms_readmsr_mmap() called with a different file name without being reset\n");
+
+    /* Release previous mapping and reset needed variables */
+    lmp_unmapfile (msfp->map, msfp->filesize);
+
+    msfp->map         = NULL;
+    msfp->filepos     = 0;
+    msfp->filesize    = 0;
+    msfp->recordcount = 0;
+  }
+
+  /* Map the file if needed */
+  if (msfp->map == NULL)
+  {
+    /* Store the filename for tracking */
+    strncpy (msfp->filename, msfile, sizeof (msfp->filename) - 1);
+    msfp->filename[sizeof (msfp->filename) - 1] = '\0';
+
+    msfp->map = lmp_mapfile (msfile, &msfp->filesize);
+
+    /* Packed files are not supported from a mapping, test for signatures */
+    if (msfp->map && msfp->filesize >= 48 && *(msfp->map) == 'P' &&
+        (!memcmp ("PED", msfp->map, 3) || !memcmp ("PSD", msfp->map, 3) ||
+         !memcmp ("PLC", msfp->map, 3) || !memcmp ("PQI", msfp->map, 3) ||
+         !memcmp ("PLS", msfp->map, 3)))
+    {
+      lmp_unmapfile (msfp->map, msfp->filesize);
+      msfp->map = NULL;
+    }
+
+    /* Otherwise read the file using the standard reader */
+    if (msfp->map == NULL)
+    {
+      msfp->filesize = 0;
+
+      if (verbose > 1)
+        ms_log (1, "%s: Not reading from memory map\n", msfile);
+
+      return ms_readmsr_main (ppmsfp, ppmsr, msfile, reclen, fpos, last,
+                              skipnotdata, dataflag, selections, verbose);
+    }
+
+    msfp->filepos     = 0;
+    msfp->recordcount = 0;
+  }
+
+  /* Set starting offset if requested */
+  if (fpos != NULL && *fpos < 0)
+  {
+    msfp->filepos = *fpos * -1;
+  }
+
+  /* Zero the last record indicator */
+  if (last)
+    *last = 0;
+
+  /* Search for records */
+  for (;;)
+  {
+    remaining = msfp->filesize - msfp->filepos;
+
+    /* Finished when within MINRECLEN from EOF */
+    if (remaining < MINRECLEN)
+    {
+      if (msfp->recordcount == 0)
+      {
+        if (verbose > 0)
+          ms_log (2, "%s: No data records read, not SEED?\n", msfile);
+        retcode = MS_NOTSEED;
+      }
+      else
+      {
+        retcode = MS_ENDOFFILE;
+      }
+
+      break;
+    }
+
+    /* Limit the parse length to the largest record length supported */
+    parselen = (remaining > MAXRECLEN) ? MAXRECLEN : (int)remaining;
+
+    /* Skip records rejected by the record filter without unpacking */
+    if (msfp->recordfilter)
+    {
+      int filterlen = (reclen > 0) ? reclen : ms_detect (msfp->map + msfp->filepos, parselen);
+
+      if (filterlen >= MINRECLEN && filterlen <= parselen &&
+          !msfp->recordfilter (msfp->map + msfp->filepos, filterlen, msfp->filepos, msfp->filterdata))
+      {
+        /* Update file position and record count */
+        msfp->filepos += filterlen;
+        msfp->recordcount++;
+        continue;
+      }
+    }
+
+    parseval = msr_parse_r (msfp->packctx, msfp->map + msfp->filepos, parselen, ppmsr, reclen, dataflag, verbose);
+
+    /* Record detected and parsed */
+    if (parseval == 0)
+    {
+      if (verbose > 1)
+        ms_log (1, "Read record length of %d bytes\n", (*ppmsr)->reclen);
+
+      /* Test if this is the last record */
+      if (last)
+        if ((msfp->filesize - (msfp->filepos + (*ppmsr)->reclen)) < MINRECLEN)
+          *last = 1;
+
+      /* Return file position for this record */
+      if (fpos)
+        *fpos = msfp->filepos;
+
+      /* Update file position and record count */
+      msfp->filepos += (*ppmsr)->reclen;
+      msfp->recordcount++;
+
+      retcode = MS_NOERROR;
+      break;
+    }
+    else if (parseval < 0)
+    {
+      /* Skip non-data if requested */
+      if (skipnotdata)
+      {
+        if (verbose > 1)
+        {
+          if (MS_ISVALIDBLANK ((char *)(msfp->map + msfp->filepos)))
+            ms_log (1, "Skipped %d bytes of blank/noise record at byte offset %" PRId64 "\n",
+                    MINRECLEN, msfp->filepos);
+          else
+            ms_log (1, "Skipped %d bytes of non-data record at byte offset %" PRId64 "\n",
+                    MINRECLEN, msfp->filepos);
+        }
+
+        /* Skip MINRECLEN bytes and update file position */
+        msfp->filepos += MINRECLEN;
+      }
+      /* Parsing errors */
+      else
+      {
+        ms_log (2, "Cannot detect record at byte offset %" PRId64 ": %s\n",
+                msfp->filepos, msfile);
+
+        /* Print common errors and raw details if verbose */
+        ms_parse_raw (msfp->map + msfp->filepos, parselen, verbose, -1);
+
+        retcode = parseval;
+        break;
+      }
+    }
+    else /* parseval > 0 (found record but need more data) */
+    {
+      /* Check for parse hints that are larger than MAXRECLEN */
+      if ((parselen + parseval) > MAXRECLEN)
+      {
+        if (skipnotdata)
+        {
+          /* Skip MINRECLEN bytes and update file position */
+          msfp->filepos += MINRECLEN;
+        }
+        else
+        {
+          retcode = MS_OUTOFRANGE;
+          break;
+        }
+      }
+
+      /* End of file, determine implied record length if needed.
+       * Check that record length is within range and a power of 2.
+       * Power of two if (X & (X - 1)) == 0 */
+      else if (reclen <= 0 && remaining >= MINRECLEN && remaining <= MAXRECLEN &&
+               (remaining & (remaining - 1)) == 0)
+      {
+        /* Set the record length implied by the end of the file */
+        reclen = (int)remaining;
+      }
+
+      /* Otherwise a truncated record */
+      else
+      {
+        if (verbose)
+          ms_log (1, "Truncated record at byte offset %" PRId64 ", filesize %" PRId64 ": %s\n",
+                  msfp->filepos, msfp->filesize, msfile);
+
+        retcode = MS_ENDOFFILE;
+        break;
+      }
+    }
+  } /* End of record detection and parsing loop */
+
+  /* Cleanup target MSRecord if returning an error */
+  if (retcode != MS_NOERROR)
+  {
+    msr_free (ppmsr);
+  }
+
+  return retcode;
+} /* End of ms_readmsr_mmap() */
+
 /*********************************************************************
  * ms_readtraces:
  *
@@ -749,6 +1126,8 @@ ms_readtraces_timewin (MSTraceGroup **ppmstg, const char *msfile, int reclen,
   selection.srcname[1]  = '\0';
   selection.timewindows = &selecttime;
   selection.next        = NULL;
+  selection.windowarray = NULL;
+  selection.windowcount = 0;
 
   selecttime.starttime = starttime;
   selecttime.endtime   = endtime;
@@ -872,6 +1251,8 @@ ms_readtracelist_timewin (MSTraceList **ppmstl, const char *msfile,
   selection.srcname[1]  = '\0';
   selection.timewindows = &selecttime;
   selection.next        = NULL;
+  selection.windowarray = NULL;
+  selection.windowcount = 0;
 
   selecttime.starttime = starttime;
   selecttime.endtime   = endtime;
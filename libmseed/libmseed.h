@@ -497,9 +497,23 @@ typedef struct MSRecord_s {
 
   /* Stream oriented state information */
   StreamState    *ststate;           /* Stream processing state information */
+
+  flag            blktsdeferred;     /* Flag: blockettes not yet unpacked, see msr_unpack_blockettes() */
 }
 MSRecord;
 
+/* Reusable buffers for packing and unpacking records, the record is
+ * owned by the context and its buffers must not be replaced */
+typedef struct MSPackContext_s {
+  char           *rawrec;            /* Record buffer used by msr_pack_r() */
+  int32_t         rawreclen;         /* Allocated length of record buffer */
+  MSRecord       *msr;               /* Record returned by msr_unpack_r() */
+  size_t          datasize;          /* Allocated size of msr->datasamples */
+  BlktLink       *freeblkts;         /* Blockette links retained for reuse */
+  uint64_t        allocations;       /* Count of memory allocations for context buffers */
+}
+MSPackContext;
+
 /* Container for a continuous trace, linkable */
 typedef struct MSTrace_s {
   char            network[11];       /* Network designation, NULL terminated */
@@ -582,8 +596,13 @@ typedef struct Selections_s {
   char srcname[100];     /* Matching (globbing) source name: Net_Sta_Loc_Chan_Qual */
   struct SelectTime_s *timewindows;
   struct Selections_s *next;
+  struct SelectTime_s **windowarray; /* Sorted time windows, built by ms_sortselecttimes() */
+  int windowcount;       /* Number of entries in windowarray */
 } Selections;
 
+/* Data selection index for fast source name matching, opaque */
+typedef struct SelectIndex_s SelectIndex;
+
 
 /* Global variables (defined in pack.c) and macros to set/force
  * pack byte orders */
@@ -606,10 +625,18 @@ extern int unpackencodingfallback;
 #define MS_UNPACKENCODINGFORMAT(X) (unpackencodingformat = X);
 #define MS_UNPACKENCODINGFALLBACK(X) (unpackencodingfallback = X);
 
+/* Global variable (defined in unpack.c) and macro to set lazy
+ * unpacking of blockettes */
+extern flag unpacklazyblockettes;
+#define MS_UNPACKLAZYBLOCKETTES(X) (unpacklazyblockettes = X);
+
 /* Mini-SEED record related functions */
 extern int           msr_parse (char *record, int recbuflen, MSRecord **ppmsr, int reclen,
 				flag dataflag, flag verbose);
 
+extern int           msr_parse_r (MSPackContext *ctx, char *record, int recbuflen,
+				  MSRecord **ppmsr, int reclen, flag dataflag, flag verbose);
+
 extern int           msr_parse_selection ( char *recbuf, int recbuflen, int64_t *offset,
 					   MSRecord **ppmsr, int reclen,
 					   Selections *selections, flag dataflag, flag verbose );
@@ -624,11 +651,29 @@ extern int           msr_pack_header (MSRecord *msr, flag normalize, flag verbos
 
 extern int           msr_unpack_data (MSRecord *msr, int swapflag, flag verbose);
 
+extern int           msr_unpack_blockettes (MSRecord *msr, flag verbose);
+
+extern int           msr_unpack_r (MSPackContext *ctx, char *record, int reclen,
+				   MSRecord **ppmsr, flag dataflag, flag verbose);
+
+extern int           msr_unpack_recycle (MSPackContext *ctx, char *record, int reclen,
+					 MSRecord **ppmsr, flag dataflag, flag verbose);
+
+extern int           msr_pack_r (MSPackContext *ctx, MSRecord *msr,
+				 void (*record_handler) (char *, int, void *),
+				 void *handlerdata, int64_t *packedsamples, flag flush, flag verbose);
+
 extern MSRecord*     msr_init (MSRecord *msr);
 extern void          msr_free (MSRecord **ppmsr);
 extern void          msr_free_blktchain (MSRecord *msr);
 extern BlktLink*     msr_addblockette (MSRecord *msr, char *blktdata, int length,
 				       int blkttype, int chainpos);
+extern BlktLink*     msr_addblockette_r (MSPackContext *ctx, MSRecord *msr, char *blktdata,
+					 int length, int blkttype, int chainpos);
+extern void          msr_recycle_blktchain (MSPackContext *ctx, MSRecord *msr);
+extern MSPackContext* ms_initpackcontext (void);
+extern void          ms_freepackcontext (MSPackContext **ppctx);
+extern char*         ms_packcontextbuffer (MSPackContext *ctx, int reclen);
 extern int           msr_normalize_header (MSRecord *msr, flag verbose);
 extern MSRecord*     msr_duplicate (MSRecord *msr, flag datadup);
 extern double        msr_samprate (MSRecord *msr);
@@ -705,6 +750,10 @@ typedef struct MSFileParam_s
   off_t filepos;
   off_t filesize;
   int   recordcount;
+  char *map;            /* Memory mapped file contents, used by ms_readmsr_mmap() */
+  MSPackContext *packctx; /* Retained record header buffers */
+  int (*recordfilter) (char *, int, off_t, void *); /* Raw record filter, see ms_readmsr_setfilter() */
+  void *filterdata;     /* Data passed to recordfilter() */
 } MSFileParam;
 
 extern int      ms_readmsr (MSRecord **ppmsr, const char *msfile, int reclen, off_t *fpos, int *last,
@@ -713,6 +762,10 @@ extern int      ms_readmsr_r (MSFileParam **ppmsfp, MSRecord **ppmsr, const char
 			      off_t *fpos, int *last, flag skipnotdata, flag dataflag, flag verbose);
 extern int      ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile, int reclen,
 				 off_t *fpos, int *last, flag skipnotdata, flag dataflag, Selections *selections, flag verbose);
+extern int      ms_readmsr_setfilter (MSFileParam **ppmsfp, int (*recordfilter) (char *, int, off_t, void *),
+				      void *filterdata);
+extern int      ms_readmsr_mmap (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile, int reclen,
+				 off_t *fpos, int *last, flag skipnotdata, flag dataflag, Selections *selections, flag verbose);
 extern int      ms_readtraces (MSTraceGroup **ppmstg, const char *msfile, int reclen, double timetol, double sampratetol,
 			       flag dataquality, flag skipnotdata, flag dataflag, flag verbose);
 extern int      ms_readtraces_timewin (MSTraceGroup **ppmstg, const char *msfile, int reclen, double timetol, double sampratetol,
@@ -735,6 +788,8 @@ extern int      mst_writemseedgroup ( MSTraceGroup *mstg, const char *msfile, fl
 
 /* General use functions */
 extern char*    ms_recsrcname (char *record, char *srcname, flag quality);
+extern int      ms_recheaderinfo (char *record, int reclen, char *srcname, hptime_t *starttime,
+				  hptime_t *endtime, int64_t *samplecnt);
 extern int      ms_splitsrcname (char *srcname, char *net, char *sta, char *loc, char *chan, char *qual);
 extern int      ms_strncpclean (char *dest, const char *source, int length);
 extern int      ms_strncpcleantail (char *dest, const char *source, int length);
@@ -792,6 +847,12 @@ extern MSLogParam *ms_loginit_l (MSLogParam *logp,
 extern Selections *ms_matchselect (Selections *selections, char *srcname,
 				   hptime_t starttime, hptime_t endtime, SelectTime **ppselecttime);
 extern Selections *msr_matchselect (Selections *selections, MSRecord *msr, SelectTime **ppselecttime);
+extern SelectTime *ms_matchselecttime (Selections *selection, hptime_t starttime, hptime_t endtime);
+extern int      ms_sortselecttimes (Selections *selections);
+extern SelectIndex *ms_initselectindex (Selections *selections);
+extern int      ms_matchselectindex (SelectIndex *index, char *srcname,
+				     Selections ***ppmatches, int *matchesmax);
+extern void     ms_freeselectindex (SelectIndex *index);
 extern int      ms_addselect (Selections **ppselections, char *srcname,
 			      hptime_t starttime, hptime_t endtime);
 extern int      ms_addselect_comp (Selections **ppselections, char *net, char* sta, char *loc,
@@ -832,6 +893,8 @@ extern void     ms_gswap8a ( void *data8 );
 /* Platform portable functions */
 extern off_t lmp_ftello (FILE *stream);
 extern int lmp_fseeko (FILE *stream, off_t offset, int whence);
+extern char *lmp_mapfile (const char *filename, off_t *length);
+extern int lmp_unmapfile (char *map, off_t length);
 
 #ifdef __cplusplus
 }
@@ -11,6 +11,13 @@
 
 #include "libmseed.h"
 
+#if !defined(LMP_WIN)
+  #include <fcntl.h>
+  #include <stdint.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+
 /* Size of off_t data type as determined at build time */
 int LM_SIZEOF_OFF_T = sizeof(off_t);
 
@@ -49,3 +56,84 @@ lmp_fseeko (FILE *stream, off_t offset, int whence)
 
 #endif
 } /* End of lmp_fseeko() */
+
+/***************************************************************************
+ * lmp_mapfile:
+ *
+ * Map the entire contents of the specified file read-only into memory
+ * and set *length to the size of the mapping.  The access pattern is
+ * advised to be sequential when supported.
+ *
+ * Returns a pointer to the mapped file contents on success and NULL
+ * on error or when memory mapping is not supported on the platform,
+ * an empty file cannot be mapped and also results in NULL.
+ ***************************************************************************/
+char *
+lmp_mapfile (const char *filename, off_t *length)
+{
+#if defined(LMP_WIN)
+  if (length)
+    *length = 0;
+
+  return NULL;
+
+#else
+  struct stat sbuf;
+  void *map;
+  int fd;
+
+  if (!filename || !length)
+    return NULL;
+
+  *length = 0;
+
+  if ((fd = open (filename, O_RDONLY)) < 0)
+    return NULL;
+
+  if (fstat (fd, &sbuf) || !S_ISREG (sbuf.st_mode) || sbuf.st_size <= 0 ||
+      (uint64_t)sbuf.st_size > (uint64_t)SIZE_MAX)
+  {
+    close (fd);
+    return NULL;
+  }
+
+  map = mmap (NULL, (size_t)sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  /* The mapping remains valid after the descriptor is closed */
+  close (fd);
+
+  if (map == MAP_FAILED)
+    return NULL;
+
+#if defined(MADV_SEQUENTIAL)
+  madvise (map, (size_t)sbuf.st_size, MADV_SEQUENTIAL);
+#endif
+
+  *length = sbuf.st_size;
+
+  return (char *)map;
+
+#endif
+} /* End of lmp_mapfile() */
+
+/***************************************************************************
+ * lmp_unmapfile:
+ *
+ * Release a file mapping created with lmp_mapfile().
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+lmp_unmapfile (char *map, off_t length)
+{
+#if defined(LMP_WIN)
+  return -1;
+
+#else
+  if (!map || length <= 0)
+    return -1;
+
+  return munmap (map, (size_t)length);
+
+#endif
+} /* End of lmp_unmapfile() */
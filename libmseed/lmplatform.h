@@ -107,6 +107,8 @@ extern "C" {
 
 extern off_t lmp_ftello (FILE *stream);
 extern int lmp_fseeko (FILE *stream, off_t offset, int whence);
+extern char *lmp_mapfile (const char *filename, off_t *length);
+extern int lmp_unmapfile (char *map, off_t length);
 
 #ifdef __cplusplus
 }
@@ -138,6 +138,43 @@ msr_free_blktchain (MSRecord *msr)
   }
 } /* End of msr_free_blktchain() */
 
+/***************************************************************************
+ * msr_recycle_blktchain:
+ *
+ * Move the blockette chain of a MSRecord struct to the retained
+ * blockette links of a pack context for reuse by msr_addblockette_r()
+ * and set MSRecord->blkts to NULL.  Also reset the shortcut blockette
+ * pointers.  Without a context the chain is freed.
+ ***************************************************************************/
+void
+msr_recycle_blktchain (MSPackContext *ctx, MSRecord *msr)
+{
+  BlktLink *last;
+
+  if (!ctx)
+  {
+    msr_free_blktchain (msr);
+    return;
+  }
+
+  if (msr)
+  {
+    if (msr->blkts)
+    {
+      for (last = msr->blkts; last->next; last = last->next)
+        ;
+
+      last->next     = ctx->freeblkts;
+      ctx->freeblkts = msr->blkts;
+      msr->blkts     = 0;
+    }
+
+    msr->Blkt100  = 0;
+    msr->Blkt1000 = 0;
+    msr->Blkt1001 = 0;
+  }
+} /* End of msr_recycle_blktchain() */
+
 /***************************************************************************
  * msr_addblockette:
  *
@@ -155,69 +192,108 @@ msr_free_blktchain (MSRecord *msr)
 BlktLink *
 msr_addblockette (MSRecord *msr, char *blktdata, int length, int blkttype,
                   int chainpos)
+{
+  return msr_addblockette_r (NULL, msr, blktdata, length, blkttype, chainpos);
+} /* End of msr_addblockette() */
+
+/***************************************************************************
+ * msr_addblockette_r:
+ *
+ * Add a blockette to the blockette chain of an MSRecord as
+ * msr_addblockette(), reusing a blockette link retained in the pack
+ * context if available.  A retained link with the same data length
+ * is preferred, so records with the same blockettes do not allocate
+ * memory once links have been retained.  If ctx is NULL memory is
+ * always allocated.
+ *
+ * Returns a pointer to the BlktLink added to the chain on success and
+ * NULL on error.
+ ***************************************************************************/
+BlktLink *
+msr_addblockette_r (MSPackContext *ctx, MSRecord *msr, char *blktdata,
+                    int length, int blkttype, int chainpos)
 {
   BlktLink *blkt;
+  BlktLink *prev = NULL;
+  BlktLink *last;
+  char *data;
 
   if (!msr)
     return NULL;
 
-  blkt = msr->blkts;
-
-  if (blkt)
+  if (ctx && ctx->freeblkts)
   {
-    if (chainpos != 0)
-    {
-      blkt = (BlktLink *)malloc (sizeof (BlktLink));
+    /* Find a retained link with the same data length, otherwise use the first */
+    for (blkt = ctx->freeblkts; blkt; prev = blkt, blkt = blkt->next)
+      if (blkt->blktdatalen == length)
+        break;
 
-      blkt->next = msr->blkts;
-      msr->blkts = blkt;
+    if (!blkt)
+    {
+      blkt = ctx->freeblkts;
+      prev = NULL;
     }
-    else
+
+    if (blkt->blktdatalen != length)
     {
-      /* Find the last blockette */
-      while (blkt && blkt->next)
+      if (!(data = (char *)realloc (blkt->blktdata, length)))
       {
-        blkt = blkt->next;
+        ms_log (2, "msr_addblockette(): Cannot allocate memory\n");
+        return NULL;
       }
 
-      blkt->next = (BlktLink *)malloc (sizeof (BlktLink));
-
-      blkt       = blkt->next;
-      blkt->next = 0;
+      blkt->blktdata    = data;
+      blkt->blktdatalen = length;
+      ctx->allocations++;
     }
 
+    if (prev)
+      prev->next = blkt->next;
+    else
+      ctx->freeblkts = blkt->next;
+  }
+  else
+  {
+    blkt = (BlktLink *)malloc (sizeof (BlktLink));
+
     if (blkt == NULL)
     {
       ms_log (2, "msr_addblockette(): Cannot allocate memory\n");
       return NULL;
     }
-  }
-  else
-  {
-    msr->blkts = (BlktLink *)malloc (sizeof (BlktLink));
 
-    if (msr->blkts == NULL)
+    blkt->blktdata = (char *)malloc (length);
+
+    if (blkt->blktdata == NULL)
     {
       ms_log (2, "msr_addblockette(): Cannot allocate memory\n");
+      free (blkt);
       return NULL;
     }
 
-    blkt       = msr->blkts;
+    if (ctx)
+      ctx->allocations += 2;
+  }
+
+  if (msr->blkts && chainpos == 0)
+  {
+    /* Find the last blockette */
+    for (last = msr->blkts; last->next; last = last->next)
+      ;
+
+    last->next = blkt;
     blkt->next = 0;
   }
+  else
+  {
+    blkt->next = msr->blkts;
+    msr->blkts = blkt;
+  }
 
   blkt->blktoffset = 0;
   blkt->blkt_type  = blkttype;
   blkt->next_blkt  = 0;
 
-  blkt->blktdata = (char *)malloc (length);
-
-  if (blkt->blktdata == NULL)
-  {
-    ms_log (2, "msr_addblockette(): Cannot allocate memory\n");
-    return NULL;
-  }
-
   memcpy (blkt->blktdata, blktdata, length);
   blkt->blktdatalen = length;
 
@@ -236,7 +312,98 @@ msr_addblockette (MSRecord *msr, char *blktdata, int length, int blkttype,
   }
 
   return blkt;
-} /* End of msr_addblockette() */
+} /* End of msr_addblockette_r() */
+
+/***************************************************************************
+ * ms_initpackcontext:
+ *
+ * Allocate and initialize a pack context holding buffers that are
+ * reused by msr_unpack_r(), msr_unpack_recycle() and msr_pack_r().
+ * A context may only be used by one thread at a time.  The number of
+ * allocations made for context buffers is counted in
+ * MSPackContext->allocations.
+ *
+ * Returns a pointer to a MSPackContext struct on success or NULL on error.
+ ***************************************************************************/
+MSPackContext *
+ms_initpackcontext (void)
+{
+  MSPackContext *ctx;
+
+  if (!(ctx = (MSPackContext *)calloc (1, sizeof (MSPackContext))))
+  {
+    ms_log (2, "ms_initpackcontext(): Cannot allocate memory\n");
+    return NULL;
+  }
+
+  return ctx;
+} /* End of ms_initpackcontext() */
+
+/***************************************************************************
+ * ms_freepackcontext:
+ *
+ * Free all memory associated with a pack context, including the
+ * record returned by msr_unpack_r().
+ ***************************************************************************/
+void
+ms_freepackcontext (MSPackContext **ppctx)
+{
+  BlktLink *blkt;
+
+  if (ppctx != NULL && *ppctx != 0)
+  {
+    if ((*ppctx)->rawrec)
+      free ((*ppctx)->rawrec);
+
+    msr_free (&(*ppctx)->msr);
+
+    while ((blkt = (*ppctx)->freeblkts))
+    {
+      (*ppctx)->freeblkts = blkt->next;
+
+      if (blkt->blktdata)
+        free (blkt->blktdata);
+
+      free (blkt);
+    }
+
+    free (*ppctx);
+
+    *ppctx = NULL;
+  }
+} /* End of ms_freepackcontext() */
+
+/***************************************************************************
+ * ms_packcontextbuffer:
+ *
+ * Return the record buffer of a pack context, grown to at least
+ * reclen bytes.  The buffer is also used by msr_pack_r().
+ *
+ * Returns a pointer to the buffer on success or NULL on error.
+ ***************************************************************************/
+char *
+ms_packcontextbuffer (MSPackContext *ctx, int reclen)
+{
+  char *rawrec;
+
+  if (!ctx || reclen <= 0)
+    return NULL;
+
+  if (ctx->rawreclen < reclen)
+  {
+    if (!(rawrec = (char *)realloc (ctx->rawrec, reclen)))
+    {
+      ms_log (2, "ms_packcontextbuffer(): Cannot allocate memory\n");
+      return NULL;
+    }
+
+    ctx->rawrec    = rawrec;
+    ctx->rawreclen = reclen;
+    ctx->allocations++;
+  }
+
+  return ctx->rawrec;
+} /* End of ms_packcontextbuffer() */
 
 /***************************************************************************
  * msr_normalize_header:
@@ -263,6 +430,10 @@ msr_normalize_header (MSRecord *msr, flag verbose)
   if (!msr)
     return -1;
 
+  /* Unpack deferred blockettes before normalizing the chain */
+  if (msr->blktsdeferred && msr_unpack_blockettes (msr, verbose) != MS_NOERROR)
+    return -1;
+
   /* Get start time rounded to tenths of milliseconds and microsecond offset */
   ms_hptime2tomsusecoffset (msr->starttime, &hptimems, &usecoffset);
 
@@ -381,6 +552,10 @@ msr_duplicate (MSRecord *msr, flag datadup)
   if (!msr)
     return NULL;
 
+  /* Unpack deferred blockettes so the full chain is copied */
+  if (msr->blktsdeferred && msr_unpack_blockettes (msr, 0) != MS_NOERROR)
+    return NULL;
+
   /* Allocate target MSRecord structure */
   if ((dupmsr = msr_init (NULL)) == NULL)
     return NULL;
@@ -698,6 +873,10 @@ msr_print (MSRecord *msr, flag details)
   if (!msr)
     return;
 
+  /* Unpack deferred blockettes for printing details */
+  if (details > 0 && msr->blktsdeferred)
+    msr_unpack_blockettes (msr, 0);
+
   /* Generate a source name string */
   srcname[0] = '\0';
   msr_srcname (msr, srcname, 0);
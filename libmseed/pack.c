@@ -70,6 +70,25 @@ flag packdatabyteorder   = -2;
 int
 msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
           void *handlerdata, int64_t *packedsamples, flag flush, flag verbose)
+{
+  return msr_pack_r (NULL, msr, record_handler, handlerdata, packedsamples,
+                     flush, verbose);
+} /* End of msr_pack() */
+
+/***************************************************************************
+ * msr_pack_r:
+ *
+ * Pack data into SEED data records as msr_pack(), using the record
+ * buffer and retained blockette links of a pack context, see
+ * ms_initpackcontext(), instead of allocating memory for each call.
+ * If ctx is NULL memory is allocated as needed.
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+int
+msr_pack_r (MSPackContext *ctx, MSRecord *msr,
+            void (*record_handler) (char *, int, void *),
+            void *handlerdata, int64_t *packedsamples, flag flush, flag verbose)
 {
   uint16_t *HPnumsamples;
   uint16_t *HPdataoffset;
@@ -95,6 +114,10 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   if (!msr)
     return -1;
 
+  /* Unpack deferred blockettes, all are included in packed records */
+  if (msr->blktsdeferred && msr_unpack_blockettes (msr, verbose) != MS_NOERROR)
+    return -1;
+
   if (!record_handler)
   {
     ms_log (2, "msr_pack(): record_handler() function pointer not set!\n");
@@ -111,6 +134,9 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
       return -1;
     }
     memset (msr->ststate, 0, sizeof (StreamState));
+
+    if (ctx)
+      ctx->allocations++;
   }
 
   /* Generate source name for MSRecord */
@@ -224,8 +250,11 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     return -1;
   }
 
-  /* Allocate space for data record */
-  rawrec = (char *)malloc (msr->reclen);
+  /* Allocate space for data record, or use the context buffer */
+  if (ctx)
+    rawrec = ms_packcontextbuffer (ctx, msr->reclen);
+  else
+    rawrec = (char *)malloc (msr->reclen);
 
   if (rawrec == NULL)
   {
@@ -274,10 +303,11 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     if (verbose > 2)
       ms_log (1, "%s: Adding 1000 Blockette\n", srcname);
 
-    if (!msr_addblockette (msr, (char *)&blkt1000, sizeof (struct blkt_1000_s), 1000, 0))
+    if (!msr_addblockette_r (ctx, msr, (char *)&blkt1000, sizeof (struct blkt_1000_s), 1000, 0))
     {
       ms_log (2, "msr_pack(%s): Error adding 1000 Blockette\n", srcname);
-      free (rawrec);
+      if (!ctx)
+        free (rawrec);
       return -1;
     }
   }
@@ -288,7 +318,8 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   if (headerlen == -1)
   {
     ms_log (2, "msr_pack(%s): Error packing header\n", srcname);
-    free (rawrec);
+    if (!ctx)
+      free (rawrec);
     return -1;
   }
 
@@ -346,7 +377,8 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     if (packsamples < 0)
     {
       ms_log (2, "msr_pack(%s): Error packing data samples\n", srcname);
-      free (rawrec);
+      if (!ctx)
+        free (rawrec);
       return -1;
     }
 
@@ -389,10 +421,11 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   if (verbose > 2)
     ms_log (1, "%s: Packed %d total samples\n", srcname, totalpackedsamples);
 
-  free (rawrec);
+  if (!ctx)
+    free (rawrec);
 
   return recordcnt;
-} /* End of msr_pack() */
+} /* End of msr_pack_r() */
 
 /***************************************************************************
  * msr_pack_header:
@@ -417,6 +450,10 @@ msr_pack_header (MSRecord *msr, flag normalize, flag verbose)
   if (!msr)
     return -1;
 
+  /* Unpack deferred blockettes, all are included in the packed header */
+  if (msr->blktsdeferred && msr_unpack_blockettes (msr, verbose) != MS_NOERROR)
+    return -1;
+
   /* Generate source name for MSRecord */
   if (msr_srcname (msr, srcname, 1) == NULL)
   {
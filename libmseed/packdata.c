@@ -10,8 +10,14 @@
 #include <stdlib.h>
 
 #include "libmseed.h"
+#include "convertdata.h"
 #include "packdata.h"
 
+/* SSE2 is part of the x86-64 baseline, used to classify Steim differences */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* Control for printing debugging information */
 int encodedebug = 0;
 
@@ -61,7 +67,7 @@ int
 msr_encode_int16 (int32_t *input, int samplecount, int16_t *output,
                   int outputlength, int swapflag)
 {
-  int idx;
+  int count;
 
   if (samplecount <= 0)
     return 0;
@@ -69,20 +75,18 @@ msr_encode_int16 (int32_t *input, int samplecount, int16_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int16_t); idx++)
-  {
-    output[idx] = (int16_t)input[idx];
+  count = outputlength / (int)sizeof (int16_t);
+  if (count > samplecount)
+    count = samplecount;
 
-    if (swapflag)
-      ms_gswap2a (&output[idx]);
+  ms_convert_int32_int16 (input, output, count, swapflag);
 
-    outputlength -= sizeof (int16_t);
-  }
+  outputlength -= count * (int)sizeof (int16_t);
 
   if (outputlength)
-    memset (&output[idx], 0, outputlength);
+    memset (&output[count], 0, outputlength);
 
-  return idx;
+  return count;
 } /* End of msr_encode_int16() */
 
 /************************************************************************
@@ -98,7 +102,7 @@ int
 msr_encode_int32 (int32_t *input, int samplecount, int32_t *output,
                   int outputlength, int swapflag)
 {
-  int idx;
+  int count;
 
   if (samplecount <= 0)
     return 0;
@@ -106,20 +110,21 @@ msr_encode_int32 (int32_t *input, int samplecount, int32_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
-  {
-    output[idx] = input[idx];
+  count = outputlength / (int)sizeof (int32_t);
+  if (count > samplecount)
+    count = samplecount;
 
-    if (swapflag)
-      ms_gswap4a (&output[idx]);
+  if (swapflag)
+    ms_gswap4n (output, input, count);
+  else
+    memcpy (output, input, count * sizeof (int32_t));
 
-    outputlength -= sizeof (int32_t);
-  }
+  outputlength -= count * (int)sizeof (int32_t);
 
   if (outputlength)
-    memset (&output[idx], 0, outputlength);
+    memset (&output[count], 0, outputlength);
 
-  return idx;
+  return count;
 } /* End of msr_encode_int32() */
 
 /************************************************************************
@@ -135,7 +140,7 @@ int
 msr_encode_float32 (float *input, int samplecount, float *output,
                     int outputlength, int swapflag)
 {
-  int idx;
+  int count;
 
   if (samplecount <= 0)
     return 0;
@@ -143,20 +148,21 @@ msr_encode_float32 (float *input, int samplecount, float *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (float); idx++)
-  {
-    output[idx] = input[idx];
+  count = outputlength / (int)sizeof (float);
+  if (count > samplecount)
+    count = samplecount;
 
-    if (swapflag)
-      ms_gswap4a (&output[idx]);
+  if (swapflag)
+    ms_gswap4n (output, input, count);
+  else
+    memcpy (output, input, count * sizeof (float));
 
-    outputlength -= sizeof (float);
-  }
+  outputlength -= count * (int)sizeof (float);
 
   if (outputlength)
-    memset (&output[idx], 0, outputlength);
+    memset (&output[count], 0, outputlength);
 
-  return idx;
+  return count;
 } /* End of msr_encode_float32() */
 
 /************************************************************************
@@ -172,7 +178,7 @@ int
 msr_encode_float64 (double *input, int samplecount, double *output,
                     int outputlength, int swapflag)
 {
-  int idx;
+  int count;
 
   if (samplecount <= 0)
     return 0;
@@ -180,43 +186,199 @@ msr_encode_float64 (double *input, int samplecount, double *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (double); idx++)
-  {
-    output[idx] = input[idx];
+  count = outputlength / (int)sizeof (double);
+  if (count > samplecount)
+    count = samplecount;
 
-    if (swapflag)
-      ms_gswap8a (&output[idx]);
+  if (swapflag)
+    ms_gswap8n (output, input, count);
+  else
+    memcpy (output, input, count * sizeof (double));
 
-    outputlength -= sizeof (double);
-  }
+  outputlength -= count * (int)sizeof (double);
 
   if (outputlength)
-    memset (&output[idx], 0, outputlength);
+    memset (&output[count], 0, outputlength);
 
-  return idx;
+  return count;
 } /* End of msr_encode_float64() */
 
-/* Macro to determine number of bits needed to represent VALUE in
- * the following bit widths: 4,5,6,8,10,15,16,30,32 and set RESULT. */
-#define BITWIDTH(VALUE, RESULT)                       \
-  if (VALUE >= -8 && VALUE <= 7)                      \
-    RESULT = 4;                                       \
-  else if (VALUE >= -16 && VALUE <= 15)               \
-    RESULT = 5;                                       \
-  else if (VALUE >= -32 && VALUE <= 31)               \
-    RESULT = 6;                                       \
-  else if (VALUE >= -128 && VALUE <= 127)             \
-    RESULT = 8;                                       \
-  else if (VALUE >= -512 && VALUE <= 511)             \
-    RESULT = 10;                                      \
-  else if (VALUE >= -16384 && VALUE <= 16383)         \
-    RESULT = 15;                                      \
-  else if (VALUE >= -32768 && VALUE <= 32767)         \
-    RESULT = 16;                                      \
-  else if (VALUE >= -536870912 && VALUE <= 536870911) \
-    RESULT = 30;                                      \
-  else                                                \
-    RESULT = 32;
+/* Test if VALUE can be represented as a signed integer of WIDTH bits,
+ * MAGNITUDE is VALUE ^ (VALUE >> 31): VALUE for positive values and
+ * -VALUE - 1 for negative values. */
+#define FITSBITS(MAGNITUDE, WIDTH) ((MAGNITUDE) < (1 << ((WIDTH)-1)))
+
+/* Packing capacity of a difference: the largest number of differences
+ * per word of a layout that can represent it.  Steim1 layouts are
+ * 1 x 32-bit, 2 x 16-bit and 4 x 8-bit.  Steim2 layouts are 1 x 30,
+ * 2 x 15, 3 x 10, 4 x 8, 5 x 6, 6 x 5 and 7 x 4-bit, a capacity of 0
+ * means the difference cannot be represented. */
+#define STEIM1CAPACITY(MAGNITUDE) \
+  (1 + FITSBITS (MAGNITUDE, 16) + 2 * FITSBITS (MAGNITUDE, 8))
+#define STEIM2CAPACITY(MAGNITUDE)                                                   \
+  (FITSBITS (MAGNITUDE, 30) + FITSBITS (MAGNITUDE, 15) + FITSBITS (MAGNITUDE, 10) + \
+   FITSBITS (MAGNITUDE, 8) + FITSBITS (MAGNITUDE, 6) + FITSBITS (MAGNITUDE, 5) +    \
+   FITSBITS (MAGNITUDE, 4))
+
+/* Number of differences calculated at a time by the Steim encoders and
+ * buffer sizes including the differences of a partial word and room
+ * for 16-byte vector reads past the end */
+#define STEIM_DIFFCHUNK 256
+#define STEIM_DIFFBUFFER (STEIM_DIFFCHUNK + 8)
+#define STEIM_CAPBUFFER (STEIM_DIFFCHUNK + 48)
+
+/* Steim1 layout used for a number of differences that fit in a word */
+static const int steim1packing[5] = {0, 1, 2, 2, 4};
+
+/************************************************************************
+ * steim_capacity:
+ *
+ * Return the packing capacity of a difference for the Steim version.
+ ************************************************************************/
+static uint8_t
+steim_capacity (int version, int32_t diff)
+{
+  int32_t magnitude = diff ^ (diff >> 31);
+
+  if (version == 1)
+    return STEIM1CAPACITY (magnitude);
+
+  return STEIM2CAPACITY (magnitude);
+} /* End of steim_capacity() */
+
+/************************************************************************
+ * steim_loaddiffs:
+ *
+ * Move the differences not yet packed, from diffidx to diffcount, to
+ * the start of the buffers and add up to STEIM_DIFFCHUNK differences
+ * from input, starting at *inputidx.  For each difference the number
+ * of differences that can be packed in a word starting with it is
+ * stored in packcount: the largest count, up to 4 for Steim1 and 7
+ * for Steim2, for which every one of the differences has at least
+ * that capacity, or 0 if it cannot be represented.
+ *
+ * Differences, capacities and counts are calculated for whole buffers
+ * with SSE2 when available.  Capacities past the end of the buffer are
+ * set to zero, limiting the counts to the differences available.
+ *
+ * Return number of differences in the buffers.
+ ************************************************************************/
+static int
+steim_loaddiffs (int version, int32_t *input, int samplecount, int *inputidx,
+                 int32_t *diffs, uint8_t *capacity, uint8_t *packcount,
+                 int diffidx, int diffcount)
+{
+  int32_t *sample = input + *inputidx;
+  int32_t *diff;
+  uint8_t *cap;
+  uint8_t limit;
+  int maxcount = (version == 1) ? 4 : 7;
+  int count;
+  int lag;
+  int idx;
+#if defined(__SSE2__)
+  __m128i value[4];
+  __m128i magnitude;
+  __m128i counts;
+  int vidx;
+#endif
+
+  diffcount -= diffidx;
+  memmove (diffs, diffs + diffidx, diffcount * sizeof (int32_t));
+  memmove (capacity, capacity + diffidx, diffcount);
+
+  count = samplecount - 1 - *inputidx;
+  if (count > STEIM_DIFFCHUNK)
+    count = STEIM_DIFFCHUNK;
+
+  diff = diffs + diffcount;
+  cap  = capacity + diffcount;
+  idx  = 0;
+
+#if defined(__SSE2__)
+  /* Differences and capacities, 16 at a time */
+  for (; idx + 16 <= count; idx += 16)
+  {
+    for (vidx = 0; vidx < 4; vidx++)
+    {
+      magnitude = _mm_sub_epi32 (_mm_loadu_si128 ((const __m128i *)(sample + idx + 4 * vidx + 1)),
+                                 _mm_loadu_si128 ((const __m128i *)(sample + idx + 4 * vidx)));
+      _mm_storeu_si128 ((__m128i *)(diff + idx + 4 * vidx), magnitude);
+
+      magnitude = _mm_xor_si128 (magnitude, _mm_srai_epi32 (magnitude, 31));
+
+      /* Comparisons are -1 when true, subtracting adds 1 */
+      if (version == 1)
+      {
+        counts = _mm_sub_epi32 (_mm_set1_epi32 (1), _mm_cmplt_epi32 (magnitude, _mm_set1_epi32 (1 << 15)));
+        counts = _mm_sub_epi32 (counts, _mm_add_epi32 (_mm_cmplt_epi32 (magnitude, _mm_set1_epi32 (1 << 7)),
+                                                       _mm_cmplt_epi32 (magnitude, _mm_set1_epi32 (1 << 7))));
+      }
+      else
+      {
+        counts = _mm_cmplt_epi32 (magnitude, _mm_set1_epi32 (1 << 29));
+        counts = _mm_add_epi32 (counts, _mm_cmplt_epi32 (magnitude, _mm_set1_epi32 (1 << 14)));
+        counts = _mm_add_epi32 (counts, _mm_cmplt_epi32 (magnitude, _mm_set1_epi32 (1 << 9)));
+        counts = _mm_add_epi32 (counts, _mm_cmplt_epi32 (magnitude, _mm_set1_epi32 (1 << 7)));
+        counts = _mm_add_epi32 (counts, _mm_cmplt_epi32 (magnitude, _mm_set1_epi32 (1 << 5)));
+        counts = _mm_add_epi32 (counts, _mm_cmplt_epi32 (magnitude, _mm_set1_epi32 (1 << 4)));
+        counts = _mm_add_epi32 (counts, _mm_cmplt_epi32 (magnitude, _mm_set1_epi32 (1 << 3)));
+        counts = _mm_sub_epi32 (_mm_setzero_si128 (), counts);
+      }
+
+      value[vidx] = counts;
+    }
+
+    _mm_storeu_si128 ((__m128i *)(cap + idx),
+                      _mm_packus_epi16 (_mm_packs_epi32 (value[0], value[1]),
+                                        _mm_packs_epi32 (value[2], value[3])));
+  }
+#endif
+
+  for (; idx < count; idx++)
+  {
+    diff[idx] = (int32_t) ((uint32_t)sample[idx + 1] - (uint32_t)sample[idx]);
+    cap[idx]  = steim_capacity (version, diff[idx]);
+  }
+
+  *inputidx += count;
+  diffcount += count;
+
+  memset (capacity + diffcount, 0, STEIM_CAPBUFFER - diffcount);
+
+  /* A difference lag positions into a word limits the count to its
+   * capacity or to the lag differences before it, whichever is larger */
+  idx = 0;
+
+#if defined(__SSE2__)
+  for (; idx < diffcount; idx += 16)
+  {
+    counts = _mm_min_epu8 (_mm_loadu_si128 ((const __m128i *)(capacity + idx)),
+                           _mm_set1_epi8 (maxcount));
+
+    for (lag = 1; lag < maxcount; lag++)
+      counts = _mm_min_epu8 (counts, _mm_max_epu8 (_mm_loadu_si128 ((const __m128i *)(capacity + idx + lag)),
+                                                   _mm_set1_epi8 (lag)));
+
+    _mm_storeu_si128 ((__m128i *)(packcount + idx), counts);
+  }
+#endif
+
+  for (; idx < diffcount; idx++)
+  {
+    packcount[idx] = (capacity[idx] < maxcount) ? capacity[idx] : maxcount;
+
+    for (lag = 1; lag < maxcount; lag++)
+    {
+      limit = (capacity[idx + lag] > lag) ? capacity[idx + lag] : lag;
+
+      if (limit < packcount[idx])
+        packcount[idx] = limit;
+    }
+  }
+
+  return diffcount;
+} /* End of steim_loaddiffs() */
 
 /************************************************************************
  * msr_encode_steim1:
@@ -237,9 +399,12 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
 {
   int32_t *frameptr;   /* Frame pointer in output */
   int32_t *Xnp = NULL; /* Reverse integration constant, aka last sample */
-  int32_t diffs[4];
-  int32_t bitwidth[4];
+  int32_t diffs[STEIM_DIFFBUFFER];
+  uint8_t capacity[STEIM_CAPBUFFER];
+  uint8_t packcount[STEIM_CAPBUFFER];
+  int32_t *diff;
   int diffcount     = 0;
+  int diffidx       = 0;
   int inputidx      = 0;
   int outputsamples = 0;
   int maxframes     = outputlength / 64;
@@ -247,7 +412,6 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
   int frameidx;
   int startnibble;
   int widx;
-  int idx;
 
   union dword {
     int8_t d8[4];
@@ -266,9 +430,10 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
             samplecount, maxframes, swapflag);
 
   /* Add first difference to buffers */
-  diffs[0] = diff0;
-  BITWIDTH (diffs[0], bitwidth[0]);
-  diffcount = 1;
+  diffs[0]    = diff0;
+  capacity[0] = steim_capacity (1, diff0);
+  diffcount   = steim_loaddiffs (1, input, samplecount, &inputidx,
+                                 diffs, capacity, packcount, 0, 1);
 
   for (frameidx = 0; frameidx < maxframes && outputsamples < samplecount; frameidx++)
   {
@@ -303,60 +468,43 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
 
     for (widx = startnibble; widx < 16 && outputsamples < samplecount; widx++)
     {
-      if (diffcount < 4)
+      /* Add new diffs and capacities when fewer than a full word remain */
+      if (diffcount - diffidx < 4 && inputidx < (samplecount - 1))
       {
-        /* Shift diffs and related bit widths to beginning of buffers */
-        for (idx = 0; idx < diffcount; idx++)
-        {
-          diffs[idx]    = diffs[packedsamples + idx];
-          bitwidth[idx] = bitwidth[packedsamples + idx];
-        }
-
-        /* Add new diffs and determine bit width needed to represent */
-        for (idx = diffcount; idx < 4 && inputidx < (samplecount - 1); idx++, inputidx++)
-        {
-          diffs[idx] = *(input + inputidx + 1) - *(input + inputidx);
-          BITWIDTH (diffs[idx], bitwidth[idx]);
-          diffcount++;
-        }
+        diffcount = steim_loaddiffs (1, input, samplecount, &inputidx,
+                                     diffs, capacity, packcount, diffidx, diffcount);
+        diffidx   = 0;
       }
 
-      /* Determine optimal packing by checking, in-order:
-       * 4 x 8-bit differences
-       * 2 x 16-bit differences
-       * 1 x 32-bit difference */
+      /* Determine optimal packing, in-order: 4 x 8-bit, 2 x 16-bit, 1 x 32-bit */
+      packedsamples = steim1packing[packcount[diffidx]];
 
-      word          = (union dword *)&frameptr[widx];
-      packedsamples = 0;
+      diff = diffs + diffidx;
+      word = (union dword *)&frameptr[widx];
 
       /* 4 x 8-bit differences */
-      if (diffcount == 4 &&
-          bitwidth[0] <= 8 && bitwidth[1] <= 8 &&
-          bitwidth[2] <= 8 && bitwidth[3] <= 8)
+      if (packedsamples == 4)
       {
         if (encodedebug)
           ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
-                  widx, diffs[0], diffs[1], diffs[2], diffs[3]);
+                  widx, diff[0], diff[1], diff[2], diff[3]);
 
-        word->d8[0] = diffs[0];
-        word->d8[1] = diffs[1];
-        word->d8[2] = diffs[2];
-        word->d8[3] = diffs[3];
+        word->d8[0] = diff[0];
+        word->d8[1] = diff[1];
+        word->d8[2] = diff[2];
+        word->d8[3] = diff[3];
 
         /* 2-bit nibble is 0b01 (0x1) */
         frameptr[0] |= 0x1ul << (30 - 2 * widx);
-
-        packedsamples = 4;
       }
       /* 2 x 16-bit differences */
-      else if (diffcount >= 2 &&
-               bitwidth[0] <= 16 && bitwidth[1] <= 16)
+      else if (packedsamples == 2)
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 2=2x16b  %d  %d\n", widx, diffs[0], diffs[1]);
+          ms_log (1, "  W%02d: 2=2x16b  %d  %d\n", widx, diff[0], diff[1]);
 
-        word->d16[0] = diffs[0];
-        word->d16[1] = diffs[1];
+        word->d16[0] = diff[0];
+        word->d16[1] = diff[1];
 
         if (swapflag)
         {
@@ -366,27 +514,23 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
 
         /* 2-bit nibble is 0b10 (0x2) */
         frameptr[0] |= 0x2ul << (30 - 2 * widx);
-
-        packedsamples = 2;
       }
       /* 1 x 32-bit difference */
       else
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 3=1x32b  %d\n", widx, diffs[0]);
+          ms_log (1, "  W%02d: 3=1x32b  %d\n", widx, diff[0]);
 
-        frameptr[widx] = diffs[0];
+        frameptr[widx] = diff[0];
 
         if (swapflag)
           ms_gswap4a (&frameptr[widx]);
 
         /* 2-bit nibble is 0b11 (0x3) */
         frameptr[0] |= 0x3ul << (30 - 2 * widx);
-
-        packedsamples = 1;
       }
 
-      diffcount -= packedsamples;
+      diffidx += packedsamples;
       outputsamples += packedsamples;
     } /* Done with words in frame */
 
@@ -428,9 +572,12 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
 {
   uint32_t *frameptr;  /* Frame pointer in output */
   int32_t *Xnp = NULL; /* Reverse integration constant, aka last sample */
-  int32_t diffs[7];
-  int32_t bitwidth[7];
+  int32_t diffs[STEIM_DIFFBUFFER];
+  uint8_t capacity[STEIM_CAPBUFFER];
+  uint8_t packcount[STEIM_CAPBUFFER];
+  int32_t *diff;
   int diffcount     = 0;
+  int diffidx       = 0;
   int inputidx      = 0;
   int outputsamples = 0;
   int maxframes     = outputlength / 64;
@@ -438,7 +585,6 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
   int frameidx;
   int startnibble;
   int widx;
-  int idx;
 
   union dword {
     int8_t d8[4];
@@ -457,9 +603,10 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
             samplecount, maxframes, swapflag);
 
   /* Add first difference to buffers */
-  diffs[0] = diff0;
-  BITWIDTH (diffs[0], bitwidth[0]);
-  diffcount = 1;
+  diffs[0]    = diff0;
+  capacity[0] = steim_capacity (2, diff0);
+  diffcount   = steim_loaddiffs (2, input, samplecount, &inputidx,
+                                 diffs, capacity, packcount, 0, 1);
 
   for (frameidx = 0; frameidx < maxframes && outputsamples < samplecount; frameidx++)
   {
@@ -494,202 +641,158 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
 
     for (widx = startnibble; widx < 16 && outputsamples < samplecount; widx++)
     {
-      if (diffcount < 7)
+      /* Add new diffs and capacities when fewer than a full word remain */
+      if (diffcount - diffidx < 7 && inputidx < (samplecount - 1))
       {
-        /* Shift diffs and related bit widths to beginning of buffers */
-        for (idx = 0; idx < diffcount; idx++)
-        {
-          diffs[idx]    = diffs[packedsamples + idx];
-          bitwidth[idx] = bitwidth[packedsamples + idx];
-        }
+        diffcount = steim_loaddiffs (2, input, samplecount, &inputidx,
+                                     diffs, capacity, packcount, diffidx, diffcount);
+        diffidx   = 0;
+      }
 
-        /* Add new diffs and determine bit width needed to represent */
-        for (idx = diffcount; idx < 7 && inputidx < (samplecount - 1); idx++, inputidx++)
-        {
-          diffs[idx] = *(input + inputidx + 1) - *(input + inputidx);
-          BITWIDTH (diffs[idx], bitwidth[idx]);
-          diffcount++;
-        }
+      /* Determine optimal packing, in-order: 7 x 4-bit, 6 x 5-bit, 5 x 6-bit,
+       * 4 x 8-bit, 3 x 10-bit, 2 x 15-bit, 1 x 30-bit */
+      packedsamples = packcount[diffidx];
+
+      if (packedsamples == 0)
+      {
+        ms_log (2, "msr_encode_steim2(%s): Unable to represent difference in <= 30 bits\n",
+                srcname);
+        return -1;
       }
 
-      /* Determine optimal packing by checking, in-order:
-       * 7 x 4-bit differences
-       * 6 x 5-bit differences
-       * 5 x 6-bit differences
-       * 4 x 8-bit differences
-       * 3 x 10-bit differences
-       * 2 x 15-bit differences
-       * 1 x 30-bit difference */
-
-      packedsamples = 0;
-
-      /* 7 x 4-bit differences */
-      if (diffcount == 7 && bitwidth[0] <= 4 &&
-          bitwidth[1] <= 4 && bitwidth[2] <= 4 && bitwidth[3] <= 4 &&
-          bitwidth[4] <= 4 && bitwidth[5] <= 4 && bitwidth[6] <= 4)
+      diff = diffs + diffidx;
+
+      switch (packedsamples)
       {
+      case 7: /* 7 x 4-bit differences */
         if (encodedebug)
           ms_log (1, "  W%02d: 11,10=7x4b  %d  %d  %d  %d  %d  %d  %d\n",
-                  widx, diffs[0], diffs[1], diffs[2], diffs[3], diffs[4], diffs[5], diffs[6]);
+                  widx, diff[0], diff[1], diff[2], diff[3], diff[4], diff[5], diff[6]);
 
         /* Mask the values, shift to proper location and set in word */
-        frameptr[widx] = ((uint32_t)diffs[6] & 0xFul);
-        frameptr[widx] |= ((uint32_t)diffs[5] & 0xFul) << 4;
-        frameptr[widx] |= ((uint32_t)diffs[4] & 0xFul) << 8;
-        frameptr[widx] |= ((uint32_t)diffs[3] & 0xFul) << 12;
-        frameptr[widx] |= ((uint32_t)diffs[2] & 0xFul) << 16;
-        frameptr[widx] |= ((uint32_t)diffs[1] & 0xFul) << 20;
-        frameptr[widx] |= ((uint32_t)diffs[0] & 0xFul) << 24;
+        frameptr[widx] = ((uint32_t)diff[6] & 0xFul);
+        frameptr[widx] |= ((uint32_t)diff[5] & 0xFul) << 4;
+        frameptr[widx] |= ((uint32_t)diff[4] & 0xFul) << 8;
+        frameptr[widx] |= ((uint32_t)diff[3] & 0xFul) << 12;
+        frameptr[widx] |= ((uint32_t)diff[2] & 0xFul) << 16;
+        frameptr[widx] |= ((uint32_t)diff[1] & 0xFul) << 20;
+        frameptr[widx] |= ((uint32_t)diff[0] & 0xFul) << 24;
 
         /* 2-bit decode nibble is 0b10 (0x2) */
         frameptr[widx] |= 0x2ul << 30;
 
         /* 2-bit nibble is 0b11 (0x3) */
         frameptr[0] |= 0x3ul << (30 - 2 * widx);
+        break;
 
-        packedsamples = 7;
-      }
-      /* 6 x 5-bit differences */
-      else if (diffcount >= 6 &&
-               bitwidth[0] <= 5 && bitwidth[1] <= 5 && bitwidth[2] <= 5 &&
-               bitwidth[3] <= 5 && bitwidth[4] <= 5 && bitwidth[5] <= 5)
-      {
+      case 6: /* 6 x 5-bit differences */
         if (encodedebug)
           ms_log (1, "  W%02d: 11,01=6x5b  %d  %d  %d  %d  %d  %d\n",
-                  widx, diffs[0], diffs[1], diffs[2], diffs[3], diffs[4], diffs[5]);
+                  widx, diff[0], diff[1], diff[2], diff[3], diff[4], diff[5]);
 
         /* Mask the values, shift to proper location and set in word */
-        frameptr[widx] = ((uint32_t)diffs[5] & 0x1Ful);
-        frameptr[widx] |= ((uint32_t)diffs[4] & 0x1Ful) << 5;
-        frameptr[widx] |= ((uint32_t)diffs[3] & 0x1Ful) << 10;
-        frameptr[widx] |= ((uint32_t)diffs[2] & 0x1Ful) << 15;
-        frameptr[widx] |= ((uint32_t)diffs[1] & 0x1Ful) << 20;
-        frameptr[widx] |= ((uint32_t)diffs[0] & 0x1Ful) << 25;
+        frameptr[widx] = ((uint32_t)diff[5] & 0x1Ful);
+        frameptr[widx] |= ((uint32_t)diff[4] & 0x1Ful) << 5;
+        frameptr[widx] |= ((uint32_t)diff[3] & 0x1Ful) << 10;
+        frameptr[widx] |= ((uint32_t)diff[2] & 0x1Ful) << 15;
+        frameptr[widx] |= ((uint32_t)diff[1] & 0x1Ful) << 20;
+        frameptr[widx] |= ((uint32_t)diff[0] & 0x1Ful) << 25;
 
         /* 2-bit decode nibble is 0b01 (0x1) */
         frameptr[widx] |= 0x1ul << 30;
 
         /* 2-bit nibble is 0b11 (0x3) */
         frameptr[0] |= 0x3ul << (30 - 2 * widx);
+        break;
 
-        packedsamples = 6;
-      }
-      /* 5 x 6-bit differences */
-      else if (diffcount >= 5 &&
-               bitwidth[0] <= 6 && bitwidth[1] <= 6 && bitwidth[2] <= 6 &&
-               bitwidth[3] <= 6 && bitwidth[4] <= 6)
-      {
+      case 5: /* 5 x 6-bit differences */
         if (encodedebug)
           ms_log (1, "  W%02d: 11,00=5x6b  %d  %d  %d  %d  %d\n",
-                  widx, diffs[0], diffs[1], diffs[2], diffs[3], diffs[4]);
+                  widx, diff[0], diff[1], diff[2], diff[3], diff[4]);
 
         /* Mask the values, shift to proper location and set in word */
-        frameptr[widx] = ((uint32_t)diffs[4] & 0x3Ful);
-        frameptr[widx] |= ((uint32_t)diffs[3] & 0x3Ful) << 6;
-        frameptr[widx] |= ((uint32_t)diffs[2] & 0x3Ful) << 12;
-        frameptr[widx] |= ((uint32_t)diffs[1] & 0x3Ful) << 18;
-        frameptr[widx] |= ((uint32_t)diffs[0] & 0x3Ful) << 24;
+        frameptr[widx] = ((uint32_t)diff[4] & 0x3Ful);
+        frameptr[widx] |= ((uint32_t)diff[3] & 0x3Ful) << 6;
+        frameptr[widx] |= ((uint32_t)diff[2] & 0x3Ful) << 12;
+        frameptr[widx] |= ((uint32_t)diff[1] & 0x3Ful) << 18;
+        frameptr[widx] |= ((uint32_t)diff[0] & 0x3Ful) << 24;
 
         /* 2-bit decode nibble is 0b00, nothing to set */
 
         /* 2-bit nibble is 0b11 (0x3) */
         frameptr[0] |= 0x3ul << (30 - 2 * widx);
+        break;
 
-        packedsamples = 5;
-      }
-      /* 4 x 8-bit differences */
-      else if (diffcount >= 4 &&
-               bitwidth[0] <= 8 && bitwidth[1] <= 8 &&
-               bitwidth[2] <= 8 && bitwidth[3] <= 8)
-      {
+      case 4: /* 4 x 8-bit differences */
         if (encodedebug)
           ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
-                  widx, diffs[0], diffs[1], diffs[2], diffs[3]);
+                  widx, diff[0], diff[1], diff[2], diff[3]);
 
         word = (union dword *)&frameptr[widx];
 
-        word->d8[0] = diffs[0];
-        word->d8[1] = diffs[1];
-        word->d8[2] = diffs[2];
-        word->d8[3] = diffs[3];
+        word->d8[0] = diff[0];
+        word->d8[1] = diff[1];
+        word->d8[2] = diff[2];
+        word->d8[3] = diff[3];
 
         /* 2-bit nibble is 0b01, only need to set 2nd bit */
         frameptr[0] |= 0x1ul << (30 - 2 * widx);
+        break;
 
-        packedsamples = 4;
-      }
-      /* 3 x 10-bit differences */
-      else if (diffcount >= 3 &&
-               bitwidth[0] <= 10 && bitwidth[1] <= 10 && bitwidth[2] <= 10)
-      {
+      case 3: /* 3 x 10-bit differences */
         if (encodedebug)
           ms_log (1, "  W%02d: 10,11=3x10b  %d  %d  %d\n",
-                  widx, diffs[0], diffs[1], diffs[2]);
+                  widx, diff[0], diff[1], diff[2]);
 
         /* Mask the values, shift to proper location and set in word */
-        frameptr[widx] = ((uint32_t)diffs[2] & 0x3FFul);
-        frameptr[widx] |= ((uint32_t)diffs[1] & 0x3FFul) << 10;
-        frameptr[widx] |= ((uint32_t)diffs[0] & 0x3FFul) << 20;
+        frameptr[widx] = ((uint32_t)diff[2] & 0x3FFul);
+        frameptr[widx] |= ((uint32_t)diff[1] & 0x3FFul) << 10;
+        frameptr[widx] |= ((uint32_t)diff[0] & 0x3FFul) << 20;
 
         /* 2-bit decode nibble is 0b11 (0x3) */
         frameptr[widx] |= 0x3ul << 30;
 
         /* 2-bit nibble is 0b10 (0x2) */
         frameptr[0] |= 0x2ul << (30 - 2 * widx);
+        break;
 
-        packedsamples = 3;
-      }
-      /* 2 x 15-bit differences */
-      else if (diffcount >= 2 &&
-               bitwidth[0] <= 15 && bitwidth[1] <= 15)
-      {
+      case 2: /* 2 x 15-bit differences */
         if (encodedebug)
           ms_log (1, "  W%02d: 10,10=2x15b  %d  %d\n",
-                  widx, diffs[0], diffs[1]);
+                  widx, diff[0], diff[1]);
 
         /* Mask the values, shift to proper location and set in word */
-        frameptr[widx] = ((uint32_t)diffs[1] & 0x7FFFul);
-        frameptr[widx] |= ((uint32_t)diffs[0] & 0x7FFFul) << 15;
+        frameptr[widx] = ((uint32_t)diff[1] & 0x7FFFul);
+        frameptr[widx] |= ((uint32_t)diff[0] & 0x7FFFul) << 15;
 
         /* 2-bit decode nibble is 0b10 (0x2) */
         frameptr[widx] |= 0x2ul << 30;
 
         /* 2-bit nibble is 0b10 (0x2) */
         frameptr[0] |= 0x2ul << (30 - 2 * widx);
+        break;
 
-        packedsamples = 2;
-      }
-      /* 1 x 30-bit difference */
-      else if (diffcount >= 1 &&
-               bitwidth[0] <= 30)
-      {
+      default: /* 1 x 30-bit difference */
         if (encodedebug)
           ms_log (1, "  W%02d: 10,01=1x30b  %d\n",
-                  widx, diffs[0]);
+                  widx, diff[0]);
 
         /* Mask the value and set in word */
-        frameptr[widx] = ((uint32_t)diffs[0] & 0x3FFFFFFFul);
+        frameptr[widx] = ((uint32_t)diff[0] & 0x3FFFFFFFul);
 
         /* 2-bit decode nibble is 0b01 (0x1) */
         frameptr[widx] |= 0x1ul << 30;
 
         /* 2-bit nibble is 0b10 (0x2) */
         frameptr[0] |= 0x2ul << (30 - 2 * widx);
-
-        packedsamples = 1;
-      }
-      else
-      {
-        ms_log (2, "msr_encode_steim2(%s): Unable to represent difference in <= 30 bits\n",
-                srcname);
-        return -1;
+        break;
       }
 
       /* Swap encoded word except for 4x8-bit samples */
       if (swapflag && packedsamples != 4)
         ms_gswap4a (&frameptr[widx]);
 
-      diffcount -= packedsamples;
+      diffidx += packedsamples;
       outputsamples += packedsamples;
     } /* Done with words in frame */
 
@@ -42,6 +42,23 @@
 int
 msr_parse (char *record, int recbuflen, MSRecord **ppmsr, int reclen,
            flag dataflag, flag verbose)
+{
+  return msr_parse_r (NULL, record, recbuflen, ppmsr, reclen, dataflag, verbose);
+} /* End of msr_parse() */
+
+/**********************************************************************
+ * msr_parse_r:
+ *
+ * Parse a Mini-SEED record as msr_parse(), unpacking with
+ * msr_unpack_recycle() so that the blockette links of the supplied
+ * MSRecord are retained in the pack context and reused.  If ctx is
+ * NULL this is identical to msr_parse().
+ *
+ * Return values are the same as msr_parse().
+ *********************************************************************/
+int
+msr_parse_r (MSPackContext *ctx, char *record, int recbuflen,
+             MSRecord **ppmsr, int reclen, flag dataflag, flag verbose)
 {
   int detlen  = 0;
   int retcode = 0;
@@ -105,7 +122,7 @@ msr_parse (char *record, int recbuflen, MSRecord **ppmsr, int reclen,
   }
 
   /* Unpack record */
-  if ((retcode = msr_unpack (record, reclen, ppmsr, dataflag, verbose)) != MS_NOERROR)
+  if ((retcode = msr_unpack_recycle (ctx, record, reclen, ppmsr, dataflag, verbose)) != MS_NOERROR)
   {
     msr_free (ppmsr);
 
@@ -113,7 +130,7 @@ msr_parse (char *record, int recbuflen, MSRecord **ppmsr, int reclen,
   }
 
   return MS_NOERROR;
-} /* End of msr_parse() */
+} /* End of msr_parse_r() */
 
 /**********************************************************************
  * msr_parse_selection:
@@ -17,91 +17,1208 @@
 
 #include "libmseed.h"
 
+/* Number of fields in a source name: Net_Sta_Loc_Chan_Qual */
+#define SELECTINDEX_FIELDS 5
+
+/* Selection index trie node, one level per source name field */
+typedef struct SelectIndexNode_s {
+  char *field;                       /* Field value or globbing pattern */
+  struct SelectIndexNode_s **exact;  /* Children with literal fields, sorted */
+  int exactcount;
+  int exactmax;
+  struct SelectIndexNode_s **glob;   /* Children with globbing fields */
+  int globcount;
+  int globmax;
+  int *ordinals;                     /* Selection ordinals, leaf nodes only */
+  int ordinalcount;
+  int ordinalmax;
+} SelectIndexNode;
+
+/* Selection index hash table entry for literal source names */
+typedef struct SelectIndexEntry_s {
+  char *srcname;                     /* Source name, NULL for empty slot */
+  int *ordinals;                     /* Selection ordinals */
+  int ordinalcount;
+  int ordinalmax;
+} SelectIndexEntry;
+
+/* Selection index, opaque type declared in libmseed.h */
+struct SelectIndex_s {
+  Selections **list;                 /* Selections in list order, by ordinal */
+  int listcount;
+  SelectIndexEntry *table;           /* Hash table of literal source names */
+  unsigned int tablesize;
+  SelectIndexNode *root;             /* Field trie of globbing source names */
+  char **patterns;                   /* Field storage, split pattern copies */
+  int patterncount;
+  int *generic;                      /* Ordinals of patterns tested in full */
+  int genericcount;
+  int genericmax;
+};
+
+/* Hash table of selection entries by source name, used when loading */
+typedef struct SelectHash_s {
+  Selections **slots;                /* Table of entries, NULL for empty slot */
+  unsigned int size;                 /* Number of slots, a power of 2 */
+  unsigned int count;                /* Number of used slots */
+} SelectHash;
+
+/* Field pattern and ordinal used to build the trie */
+typedef struct SelectIndexKey_s {
+  char *fields[SELECTINDEX_FIELDS];
+  int ordinal;
+} SelectIndexKey;
+
+/* Match result ordinals, buffer avoids allocation for few matches */
+typedef struct SelectIndexResult_s {
+  int *ordinals;
+  int count;
+  int max;
+  int buffer[32];
+} SelectIndexResult;
+
 static int ms_globmatch (char *string, char *pattern);
+static void selection_compname (char *srcname, size_t srcnamesize, char *net, char *sta,
+                                char *loc, char *chan, char *qual);
+static unsigned int selection_hash (char *string);
+static int selecthash_add (SelectHash *hash, Selections **ppselections, char *srcname,
+                           hptime_t starttime, hptime_t endtime);
+static Selections **selecthash_find (SelectHash *hash, char *srcname);
+static int selecttime_cmp (const void *a, const void *b);
+static int selectindex_classify (char *pattern);
+static int selectindex_search (SelectIndexNode *node, char **fields, int level,
+                               SelectIndexResult *result);
+static SelectIndexNode *selectindex_addchild (SelectIndexNode *node, char *field);
+static void selectindex_freenode (SelectIndexNode *node);
+static SelectIndexEntry *selectindex_findentry (SelectIndex *index, char *srcname);
+static int selectindex_addentry (SelectIndex *index, char *srcname, int ordinal);
+static int selectindex_addordinal (int **ordinals, int *count, int *max, int ordinal);
+static int selectindex_addresult (SelectIndexResult *result, int ordinal);
+static int selectindex_keycmp (const void *a, const void *b);
+static int selectindex_intcmp (const void *a, const void *b);
+
+/***************************************************************************
+ * ms_matchselect:
+ *
+ * Test the specified parameters for a matching selection entry.  The
+ * srcname parameter may contain globbing characters.  The NULL value
+ * (matching any times) for the start and end times is HPTERROR.
+ *
+ * Return Selections pointer to matching entry on successful match and
+ * NULL for no match or error.
+ ***************************************************************************/
+Selections *
+ms_matchselect (Selections *selections, char *srcname, hptime_t starttime,
+                hptime_t endtime, SelectTime **ppselecttime)
+{
+  Selections *findsl  = NULL;
+  SelectTime *matchst = NULL;
+
+  if (selections)
+  {
+    findsl = selections;
+    while (findsl)
+    {
+      if (ms_globmatch (srcname, findsl->srcname))
+        matchst = ms_matchselecttime (findsl, starttime, endtime);
+
+      if (matchst)
+        break;
+      else
+        findsl = findsl->next;
+    }
+  }
+
+  if (ppselecttime)
+    *ppselecttime = matchst;
+
+  return (matchst) ? findsl : NULL;
+} /* End of ms_matchselect() */
+
+/***************************************************************************
+ * ms_matchselecttime:
+ *
+ * Test the specified time range against the time windows of a single
+ * selection entry, the source name is not tested.  The NULL value
+ * (matching any times) for the start and end times is HPTERROR.
+ *
+ * If the time windows have been sorted with ms_sortselecttimes() a
+ * binary search is used to find the matching window.
+ *
+ * Return SelectTime pointer to the first matching time window and
+ * NULL for no match or error.
+ ***************************************************************************/
+SelectTime *
+ms_matchselecttime (Selections *selection, hptime_t starttime, hptime_t endtime)
+{
+  SelectTime *findst = NULL;
+  int lower;
+  int upper;
+  int mid;
+
+  if (!selection)
+    return NULL;
+
+  /* Search sorted, disjoint windows for the first window ending at or
+   * after the start time, the only window that may match */
+  if (selection->windowarray && starttime != HPTERROR && endtime != HPTERROR &&
+      starttime <= endtime)
+  {
+    lower = 0;
+    upper = selection->windowcount;
+    while (lower < upper)
+    {
+      mid = (lower + upper) / 2;
+      findst = selection->windowarray[mid];
+
+      if (findst->endtime == HPTERROR || findst->endtime >= starttime)
+        upper = mid;
+      else
+        lower = mid + 1;
+    }
+
+    if (lower >= selection->windowcount)
+      return NULL;
+
+    findst = selection->windowarray[lower];
+
+    if (findst->starttime != HPTERROR && findst->starttime > endtime)
+      return NULL;
+
+    return findst;
+  }
+
+  findst = selection->timewindows;
+  while (findst)
+  {
+    if (starttime != HPTERROR && findst->starttime != HPTERROR &&
+        (starttime < findst->starttime && !(starttime <= findst->starttime && endtime >= findst->starttime)))
+    {
+      findst = findst->next;
+      continue;
+    }
+    else if (endtime != HPTERROR && findst->endtime != HPTERROR &&
+             (endtime > findst->endtime && !(starttime <= findst->endtime && endtime >= findst->endtime)))
+    {
+      findst = findst->next;
+      continue;
+    }
+
+    break;
+  }
+
+  return findst;
+} /* End of ms_matchselecttime() */
+
+/***************************************************************************
+ * ms_sortselecttimes:
+ *
+ * Sort the time windows of each selection entry by start time and
+ * merge windows that overlap, the merged window covers the union of
+ * the originals.  An array of the windows is built for searching with
+ * ms_matchselecttime().  Windows added later with ms_addselect()
+ * discard the array for that entry until this routine is called again.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+int
+ms_sortselecttimes (Selections *selections)
+{
+  Selections *select;
+  SelectTime **windows;
+  SelectTime *selecttime;
+  SelectTime *merged;
+  int count;
+  int idx;
+
+  for (select = selections; select; select = select->next)
+  {
+    count = 0;
+    for (selecttime = select->timewindows; selecttime; selecttime = selecttime->next)
+      count++;
+
+    if (select->windowarray)
+      free (select->windowarray);
+
+    select->windowcount = 0;
+
+    if (!(select->windowarray = (SelectTime **)malloc (((count) ? count : 1) * sizeof (SelectTime *))))
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return -1;
+    }
+
+    windows = select->windowarray;
+
+    count = 0;
+    for (selecttime = select->timewindows; selecttime; selecttime = selecttime->next)
+      windows[count++] = selecttime;
+
+    if (count > 1)
+      qsort (windows, count, sizeof (SelectTime *), selecttime_cmp);
+
+    /* Merge overlapping windows, HPTERROR is an open start or end */
+    merged = NULL;
+    for (idx = 0; idx < count; idx++)
+    {
+      selecttime = windows[idx];
+
+      if (merged && (merged->endtime == HPTERROR || selecttime->starttime == HPTERROR ||
+                     selecttime->starttime <= merged->endtime))
+      {
+        if (merged->endtime != HPTERROR &&
+            (selecttime->endtime == HPTERROR || selecttime->endtime > merged->endtime))
+          merged->endtime = selecttime->endtime;
+
+        free (selecttime);
+        continue;
+      }
+
+      merged = selecttime;
+      windows[select->windowcount++] = merged;
+    }
+
+    /* Re-link list in sorted order */
+    select->timewindows = NULL;
+    for (idx = select->windowcount - 1; idx >= 0; idx--)
+    {
+      windows[idx]->next  = select->timewindows;
+      select->timewindows = windows[idx];
+    }
+  }
+
+  return 0;
+} /* End of ms_sortselecttimes() */
+
+/***************************************************************************
+ * msr_matchselect:
+ *
+ * A simple wrapper for calling ms_matchselect() using details from a
+ * MSRecord struct.
+ *
+ * Return Selections pointer to matching entry on successful match and
+ * NULL for no match or error.
+ ***************************************************************************/
+Selections *
+msr_matchselect (Selections *selections, MSRecord *msr, SelectTime **ppselecttime)
+{
+  char srcname[50];
+  hptime_t endtime;
+
+  if (!selections || !msr)
+    return NULL;
+
+  msr_srcname (msr, srcname, 1);
+  endtime = msr_endtime (msr);
+
+  return ms_matchselect (selections, srcname, msr->starttime, endtime,
+                         ppselecttime);
+} /* End of msr_matchselect() */
+
+/***************************************************************************
+ * ms_initselectindex:
+ *
+ * Build an index of a selection list for fast source name matching
+ * with ms_matchselectindex().  Source names without globbing
+ * characters are stored in a hash table, patterns that can be split
+ * into Net_Sta_Loc_Chan_Qual fields are stored in a trie with one
+ * level per field and all other patterns are tested individually.
+ *
+ * The index references the Selections entries, the list must not be
+ * modified or freed while the index is in use.  Once built the index
+ * is not modified by matching and may be shared between threads.
+ *
+ * Return pointer to new SelectIndex on success and NULL on error.
+ ***************************************************************************/
+SelectIndex *
+ms_initselectindex (Selections *selections)
+{
+  SelectIndex *index = NULL;
+  SelectIndexKey *keys = NULL;
+  SelectIndexNode *node;
+  Selections *select;
+  char *field;
+  int keycount = 0;
+  int ordinal;
+  int level;
+  int idx;
+
+  if (!(index = (SelectIndex *)calloc (1, sizeof (SelectIndex))))
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return NULL;
+  }
+
+  for (select = selections; select; select = select->next)
+    index->listcount++;
+
+  for (index->tablesize = 16; index->tablesize < (unsigned int)index->listcount * 2;)
+    index->tablesize *= 2;
+
+  if (!(index->root = (SelectIndexNode *)calloc (1, sizeof (SelectIndexNode))) ||
+      !(index->table = (SelectIndexEntry *)calloc (index->tablesize, sizeof (SelectIndexEntry))) ||
+      (index->listcount &&
+       (!(index->list = (Selections **)malloc (index->listcount * sizeof (Selections *))) ||
+        !(index->patterns = (char **)calloc (index->listcount, sizeof (char *))) ||
+        !(keys = (SelectIndexKey *)malloc (index->listcount * sizeof (SelectIndexKey))))))
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    ms_freeselectindex (index);
+    return NULL;
+  }
+
+  /* Classify each entry and add to the hash table, trie keys or generic list */
+  for (select = selections, ordinal = 0; select; select = select->next, ordinal++)
+  {
+    index->list[ordinal] = select;
+
+    switch (selectindex_classify (select->srcname))
+    {
+    case 0:
+      if (selectindex_addentry (index, select->srcname, ordinal))
+      {
+        ms_freeselectindex (index);
+        free (keys);
+        return NULL;
+      }
+      break;
+
+    case 1:
+      if (!(field = strdup (select->srcname)))
+      {
+        ms_log (2, "Cannot allocate memory\n");
+        ms_freeselectindex (index);
+        free (keys);
+        return NULL;
+      }
+
+      index->patterns[index->patterncount++] = field;
+
+      for (level = 0; level < SELECTINDEX_FIELDS; level++)
+      {
+        keys[keycount].fields[level] = field;
+
+        if (level < SELECTINDEX_FIELDS - 1)
+        {
+          field    = strchr (field, '_');
+          *field++ = '\0';
+        }
+      }
+
+      keys[keycount++].ordinal = ordinal;
+      break;
+
+    default:
+      if (selectindex_addordinal (&index->generic, &index->genericcount,
+                                  &index->genericmax, ordinal))
+      {
+        ms_freeselectindex (index);
+        free (keys);
+        return NULL;
+      }
+      break;
+    }
+  }
+
+  /* Sort keys so that entries sharing leading fields are adjacent and
+   * literal fields are added to each node in sorted order */
+  if (keycount > 1)
+    qsort (keys, keycount, sizeof (SelectIndexKey), selectindex_keycmp);
+
+  /* Build the field trie */
+  for (idx = 0; idx < keycount; idx++)
+  {
+    node = index->root;
+
+    for (level = 0; level < SELECTINDEX_FIELDS; level++)
+    {
+      if (!(node = selectindex_addchild (node, keys[idx].fields[level])))
+      {
+        ms_freeselectindex (index);
+        free (keys);
+        return NULL;
+      }
+    }
+
+    if (selectindex_addordinal (&node->ordinals, &node->ordinalcount,
+                                &node->ordinalmax, keys[idx].ordinal))
+    {
+      ms_freeselectindex (index);
+      free (keys);
+      return NULL;
+    }
+  }
+
+  free (keys);
+
+  return index;
+} /* End of ms_initselectindex() */
+
+/***************************************************************************
+ * ms_matchselectindex:
+ *
+ * Find all selection entries with source name patterns that match
+ * the specified srcname.  The matches are returned in selection list
+ * order, i.e. the same order they would be found by ms_matchselect(),
+ * in the array at *ppmatches.
+ *
+ * The *ppmatches array is (re)allocated as needed and *matchesmax is
+ * updated to the allocated length, allowing the array to be re-used
+ * for multiple calls.  The caller is responsible for freeing the
+ * array.  Time windows are not tested, use ms_matchselecttime() to
+ * test individual matches.
+ *
+ * Return count of matching selections on success and -1 on error.
+ ***************************************************************************/
+int
+ms_matchselectindex (SelectIndex *index, char *srcname,
+                     Selections ***ppmatches, int *matchesmax)
+{
+  SelectIndexEntry *entry;
+  SelectIndexResult result;
+  Selections **matches;
+  char name[100];
+  char *fields[SELECTINDEX_FIELDS];
+  char *cp;
+  int ordinal;
+  int count;
+  int idx;
+
+  if (!index || !srcname || !ppmatches || !matchesmax)
+    return -1;
+
+  result.ordinals = result.buffer;
+  result.count    = 0;
+  result.max      = sizeof (result.buffer) / sizeof (result.buffer[0]);
+
+  /* Split source name into fields */
+  count = 0;
+  if (strlen (srcname) < sizeof (name))
+  {
+    strcpy (name, srcname);
+
+    fields[count++] = name;
+    for (cp = name; *cp; cp++)
+    {
+      if (*cp == '_')
+      {
+        if (count >= SELECTINDEX_FIELDS)
+        {
+          count++;
+          break;
+        }
+
+        *cp             = '\0';
+        fields[count++] = cp + 1;
+      }
+    }
+  }
+
+  if (count == SELECTINDEX_FIELDS)
+  {
+    /* Literal source names */
+    if ((entry = selectindex_findentry (index, srcname)) && entry->srcname)
+    {
+      for (idx = 0; idx < entry->ordinalcount; idx++)
+        if (selectindex_addresult (&result, entry->ordinals[idx]))
+          return -1;
+    }
+
+    /* Field patterns */
+    if (selectindex_search (index->root, fields, 0, &result))
+      return -1;
+
+    /* Generic patterns */
+    for (idx = 0; idx < index->genericcount; idx++)
+    {
+      ordinal = index->generic[idx];
+
+      if (ms_globmatch (srcname, index->list[ordinal]->srcname))
+        if (selectindex_addresult (&result, ordinal))
+          return -1;
+    }
+
+    if (result.count > 1)
+      qsort (result.ordinals, result.count, sizeof (int), selectindex_intcmp);
+  }
+  /* Patterns with wildcards may match underscores in names that do
+   * not have exactly five fields, test all entries in list order */
+  else
+  {
+    for (ordinal = 0; ordinal < index->listcount; ordinal++)
+    {
+      if (ms_globmatch (srcname, index->list[ordinal]->srcname))
+        if (selectindex_addresult (&result, ordinal))
+          return -1;
+    }
+  }
+
+  /* Populate matches in list order */
+  if (result.count > *matchesmax)
+  {
+    if (!(matches = (Selections **)realloc (*ppmatches, result.count * sizeof (Selections *))))
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      if (result.ordinals != result.buffer)
+        free (result.ordinals);
+      return -1;
+    }
+
+    *ppmatches  = matches;
+    *matchesmax = result.count;
+  }
+
+  for (idx = 0; idx < result.count; idx++)
+    (*ppmatches)[idx] = index->list[result.ordinals[idx]];
+
+  count = result.count;
+
+  if (result.ordinals != result.buffer)
+    free (result.ordinals);
+
+  return count;
+} /* End of ms_matchselectindex() */
+
+/***************************************************************************
+ * ms_freeselectindex:
+ *
+ * Free all memory associated with a SelectIndex, the Selections list
+ * the index was built from is not modified.
+ ***************************************************************************/
+void
+ms_freeselectindex (SelectIndex *index)
+{
+  unsigned int idx;
+
+  if (!index)
+    return;
+
+  selectindex_freenode (index->root);
+
+  if (index->table)
+  {
+    for (idx = 0; idx < index->tablesize; idx++)
+      if (index->table[idx].ordinals)
+        free (index->table[idx].ordinals);
+
+    free (index->table);
+  }
+
+  if (index->patterns)
+  {
+    for (idx = 0; idx < (unsigned int)index->patterncount; idx++)
+      free (index->patterns[idx]);
+
+    free (index->patterns);
+  }
+
+  if (index->generic)
+    free (index->generic);
+
+  if (index->list)
+    free (index->list);
+
+  free (index);
+} /* End of ms_freeselectindex() */
+
+/***************************************************************************
+ * selection_compname:
+ *
+ * Create a source name globbing match from separate name components,
+ * see ms_addselect_comp() for the handling of missing components and
+ * the special case blank location ID.
+ ***************************************************************************/
+static void
+selection_compname (char *srcname, size_t srcnamesize, char *net, char *sta,
+                    char *loc, char *chan, char *qual)
+{
+  char selnet[20];
+  char selsta[20];
+  char selloc[20];
+  char selchan[20];
+  char selqual[20];
+
+  if (net)
+  {
+    strncpy (selnet, net, sizeof (selnet));
+    selnet[sizeof (selnet) - 1] = '\0';
+  }
+  else
+    strcpy (selnet, "*");
+
+  if (sta)
+  {
+    strncpy (selsta, sta, sizeof (selsta));
+    selsta[sizeof (selsta) - 1] = '\0';
+  }
+  else
+    strcpy (selsta, "*");
+
+  if (loc)
+  {
+    /* Test for special case blank location ID */
+    if (!strcmp (loc, "--"))
+      selloc[0] = '\0';
+    else
+    {
+      strncpy (selloc, loc, sizeof (selloc));
+      selloc[sizeof (selloc) - 1] = '\0';
+    }
+  }
+  else
+    strcpy (selloc, "*");
+
+  if (chan)
+  {
+    strncpy (selchan, chan, sizeof (selchan));
+    selchan[sizeof (selchan) - 1] = '\0';
+  }
+  else
+    strcpy (selchan, "*");
+
+  if (qual)
+  {
+    strncpy (selqual, qual, sizeof (selqual));
+    selqual[sizeof (selqual) - 1] = '\0';
+  }
+  else
+    strcpy (selqual, "?");
+
+  snprintf (srcname, srcnamesize, "%s_%s_%s_%s_%s",
+            selnet, selsta, selloc, selchan, selqual);
+} /* End of selection_compname() */
+
+/***************************************************************************
+ * selection_hash:
+ *
+ * Calculate the FNV-1a hash of a string.
+ ***************************************************************************/
+static unsigned int
+selection_hash (char *string)
+{
+  unsigned int hash = 2166136261u;
+  unsigned char *cp;
+
+  for (cp = (unsigned char *)string; *cp; cp++)
+  {
+    hash ^= *cp;
+    hash *= 16777619u;
+  }
+
+  return hash;
+} /* End of selection_hash() */
+
+/***************************************************************************
+ * selecthash_add:
+ *
+ * Add select parameters to a selection list using a hash table of the
+ * entries in the list to find an existing entry for the srcname.  The
+ * list is modified in the same way as ms_addselect(): new entries are
+ * added to the beginning of the list and new time windows are added
+ * to the beginning of an entry's window list.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+selecthash_add (SelectHash *hash, Selections **ppselections, char *srcname,
+                hptime_t starttime, hptime_t endtime)
+{
+  Selections **slot;
+  Selections *newsl;
+  SelectTime *newst;
+
+  if (!(slot = selecthash_find (hash, srcname)))
+    return -1;
+
+  if (!(newst = (SelectTime *)calloc (1, sizeof (SelectTime))))
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    return -1;
+  }
+
+  newst->starttime = starttime;
+  newst->endtime   = endtime;
+
+  if (*slot)
+  {
+    /* Add time window selection to beginning of window list */
+    newst->next          = (*slot)->timewindows;
+    (*slot)->timewindows = newst;
+
+    /* Discard sorted window array, the list is no longer sorted */
+    if ((*slot)->windowarray)
+    {
+      free ((*slot)->windowarray);
+      (*slot)->windowarray = NULL;
+      (*slot)->windowcount = 0;
+    }
+
+    return 0;
+  }
+
+  if (!(newsl = (Selections *)calloc (1, sizeof (Selections))))
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    free (newst);
+    return -1;
+  }
+
+  strncpy (newsl->srcname, srcname, sizeof (newsl->srcname));
+  newsl->srcname[sizeof (newsl->srcname) - 1] = '\0';
+
+  /* Add new Selections to beginning of list */
+  newsl->timewindows = newst;
+  newsl->next        = *ppselections;
+  *ppselections      = newsl;
+
+  *slot = newsl;
+  hash->count++;
+
+  return 0;
+} /* End of selecthash_add() */
+
+/***************************************************************************
+ * selecthash_find:
+ *
+ * Find the hash table slot for a source name using linear probing,
+ * growing the table to keep it at least half empty.
+ *
+ * Return pointer to the slot for the source name, containing the
+ * matching entry or NULL if not present, and NULL on error.
+ ***************************************************************************/
+static Selections **
+selecthash_find (SelectHash *hash, char *srcname)
+{
+  Selections **slots;
+  unsigned int newsize;
+  unsigned int idx;
+  unsigned int pos;
+
+  if ((hash->count + 1) * 2 > hash->size)
+  {
+    newsize = (hash->size) ? hash->size * 2 : 1024;
+
+    if (!(slots = (Selections **)calloc (newsize, sizeof (Selections *))))
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return NULL;
+    }
+
+    for (idx = 0; idx < hash->size; idx++)
+    {
+      if (!hash->slots[idx])
+        continue;
+
+      pos = selection_hash (hash->slots[idx]->srcname) & (newsize - 1);
+      while (slots[pos])
+        pos = (pos + 1) & (newsize - 1);
+
+      slots[pos] = hash->slots[idx];
+    }
+
+    if (hash->slots)
+      free (hash->slots);
+
+    hash->slots = slots;
+    hash->size  = newsize;
+  }
+
+  pos = selection_hash (srcname) & (hash->size - 1);
+  while (hash->slots[pos] && strcmp (hash->slots[pos]->srcname, srcname))
+    pos = (pos + 1) & (hash->size - 1);
+
+  return &hash->slots[pos];
+} /* End of selecthash_find() */
+
+/***************************************************************************
+ * selecttime_cmp:
+ *
+ * qsort() comparison of SelectTime pointers by start time then end
+ * time, an open start time (HPTERROR) sorts first and an open end
+ * time sorts last.
+ ***************************************************************************/
+static int
+selecttime_cmp (const void *a, const void *b)
+{
+  const SelectTime *sta = *(SelectTime *const *)a;
+  const SelectTime *stb = *(SelectTime *const *)b;
+
+  if (sta->starttime != stb->starttime)
+  {
+    if (sta->starttime == HPTERROR)
+      return -1;
+    if (stb->starttime == HPTERROR)
+      return 1;
+    return (sta->starttime < stb->starttime) ? -1 : 1;
+  }
+
+  if (sta->endtime != stb->endtime)
+  {
+    if (sta->endtime == HPTERROR)
+      return 1;
+    if (stb->endtime == HPTERROR)
+      return -1;
+    return (sta->endtime < stb->endtime) ? -1 : 1;
+  }
+
+  return 0;
+} /* End of selecttime_cmp() */
+
+/***************************************************************************
+ * selectindex_classify:
+ *
+ * Determine how a source name pattern is stored in a SelectIndex.
+ *
+ * A pattern can be split into fields when it contains exactly four
+ * underscores, none of them inside character sets, and no escapes.
+ * Each literal underscore must then match one of the four
+ * underscores in a five field source name, so no wildcard can match
+ * an underscore and the pattern matches if and only if each field
+ * matches.
+ *
+ * Return 0 for literal names, 1 for field patterns and 2 for patterns
+ * that must be tested against the complete source name.
+ ***************************************************************************/
+static int
+selectindex_classify (char *pattern)
+{
+  char *cp;
+  int underscores = 0;
+  int literal     = 1;
+
+  for (cp = pattern; *cp; cp++)
+  {
+    switch (*cp)
+    {
+    case '\\':
+      return 2;
+
+    case '_':
+      underscores++;
+      break;
+
+    case '*':
+    case '?':
+      literal = 0;
+      break;
+
+    case '[':
+      literal = 0;
+
+      /* Character set spans at least one character up to closing bracket */
+      if (*++cp == '^')
+        cp++;
+      if (!*cp || *cp == '_')
+        return 2;
+      for (cp++; *cp && *cp != ']'; cp++)
+        if (*cp == '_')
+          return 2;
+      if (!*cp)
+        return 2;
+      break;
+    }
+  }
+
+  if (literal)
+    return 0;
+
+  return (underscores == SELECTINDEX_FIELDS - 1) ? 1 : 2;
+} /* End of selectindex_classify() */
 
 /***************************************************************************
- * ms_matchselect:
+ * selectindex_search:
  *
- * Test the specified parameters for a matching selection entry.  The
- * srcname parameter may contain globbing characters.  The NULL value
- * (matching any times) for the start and end times is HPTERROR.
+ * Recursively search the field trie for patterns matching the source
+ * name fields, adding the ordinals of matching entries to result.
  *
- * Return Selections pointer to matching entry on successful match and
- * NULL for no match or error.
+ * Return 0 on success and -1 on error.
  ***************************************************************************/
-Selections *
-ms_matchselect (Selections *selections, char *srcname, hptime_t starttime,
-                hptime_t endtime, SelectTime **ppselecttime)
+static int
+selectindex_search (SelectIndexNode *node, char **fields, int level,
+                    SelectIndexResult *result)
 {
-  Selections *findsl  = NULL;
-  SelectTime *findst  = NULL;
-  SelectTime *matchst = NULL;
+  int lower;
+  int upper;
+  int mid;
+  int cmp;
+  int idx;
 
-  if (selections)
+  if (level == SELECTINDEX_FIELDS)
   {
-    findsl = selections;
-    while (findsl)
-    {
-      if (ms_globmatch (srcname, findsl->srcname))
-      {
-        findst = findsl->timewindows;
-        while (findst)
-        {
-          if (starttime != HPTERROR && findst->starttime != HPTERROR &&
-              (starttime < findst->starttime && !(starttime <= findst->starttime && endtime >= findst->starttime)))
-          {
-            findst = findst->next;
-            continue;
-          }
-          else if (endtime != HPTERROR && findst->endtime != HPTERROR &&
-                   (endtime > findst->endtime && !(starttime <= findst->endtime && endtime >= findst->endtime)))
-          {
-            findst = findst->next;
-            continue;
-          }
+    for (idx = 0; idx < node->ordinalcount; idx++)
+      if (selectindex_addresult (result, node->ordinals[idx]))
+        return -1;
 
-          matchst = findst;
-          break;
-        }
-      }
+    return 0;
+  }
 
-      if (matchst)
-        break;
-      else
-        findsl = findsl->next;
+  /* Binary search of sorted literal fields */
+  lower = 0;
+  upper = node->exactcount - 1;
+  while (lower <= upper)
+  {
+    mid = (lower + upper) / 2;
+    cmp = strcmp (fields[level], node->exact[mid]->field);
+
+    if (cmp == 0)
+    {
+      if (selectindex_search (node->exact[mid], fields, level + 1, result))
+        return -1;
+      break;
     }
+    else if (cmp < 0)
+      upper = mid - 1;
+    else
+      lower = mid + 1;
   }
 
-  if (ppselecttime)
-    *ppselecttime = matchst;
+  /* Test each globbing field */
+  for (idx = 0; idx < node->globcount; idx++)
+  {
+    if (ms_globmatch (fields[level], node->glob[idx]->field))
+      if (selectindex_search (node->glob[idx], fields, level + 1, result))
+        return -1;
+  }
 
-  return (matchst) ? findsl : NULL;
-} /* End of ms_matchselect() */
+  return 0;
+} /* End of selectindex_search() */
 
 /***************************************************************************
- * msr_matchselect:
+ * selectindex_addchild:
  *
- * A simple wrapper for calling ms_matchselect() using details from a
- * MSRecord struct.
+ * Find or add the child node for the specified field.  Fields must
+ * be added in sorted order, an existing child can only be the last
+ * one added.
  *
- * Return Selections pointer to matching entry on successful match and
- * NULL for no match or error.
+ * Return pointer to child node on success and NULL on error.
  ***************************************************************************/
-Selections *
-msr_matchselect (Selections *selections, MSRecord *msr, SelectTime **ppselecttime)
+static SelectIndexNode *
+selectindex_addchild (SelectIndexNode *node, char *field)
 {
-  char srcname[50];
-  hptime_t endtime;
+  SelectIndexNode ***pchildren;
+  SelectIndexNode **children;
+  SelectIndexNode *child;
+  int *count;
+  int *max;
 
-  if (!selections || !msr)
+  if (strpbrk (field, "*?["))
+  {
+    pchildren = &node->glob;
+    count     = &node->globcount;
+    max       = &node->globmax;
+  }
+  else
+  {
+    pchildren = &node->exact;
+    count     = &node->exactcount;
+    max       = &node->exactmax;
+  }
+
+  if (*count > 0 && !strcmp ((*pchildren)[*count - 1]->field, field))
+    return (*pchildren)[*count - 1];
+
+  if (*count >= *max)
+  {
+    if (!(children = (SelectIndexNode **)realloc (*pchildren, ((*max) ? *max * 2 : 4) * sizeof (SelectIndexNode *))))
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return NULL;
+    }
+
+    *pchildren = children;
+    *max       = (*max) ? *max * 2 : 4;
+  }
+
+  if (!(child = (SelectIndexNode *)calloc (1, sizeof (SelectIndexNode))))
+  {
+    ms_log (2, "Cannot allocate memory\n");
     return NULL;
+  }
 
-  msr_srcname (msr, srcname, 1);
-  endtime = msr_endtime (msr);
+  child->field         = field;
+  (*pchildren)[*count] = child;
+  (*count)++;
 
-  return ms_matchselect (selections, srcname, msr->starttime, endtime,
-                         ppselecttime);
-} /* End of msr_matchselect() */
+  return child;
+} /* End of selectindex_addchild() */
+
+/***************************************************************************
+ * selectindex_freenode:
+ *
+ * Free a trie node and all of its children.
+ ***************************************************************************/
+static void
+selectindex_freenode (SelectIndexNode *node)
+{
+  int idx;
+
+  if (!node)
+    return;
+
+  for (idx = 0; idx < node->exactcount; idx++)
+    selectindex_freenode (node->exact[idx]);
+
+  for (idx = 0; idx < node->globcount; idx++)
+    selectindex_freenode (node->glob[idx]);
+
+  if (node->exact)
+    free (node->exact);
+  if (node->glob)
+    free (node->glob);
+  if (node->ordinals)
+    free (node->ordinals);
+
+  free (node);
+} /* End of selectindex_freenode() */
+
+/***************************************************************************
+ * selectindex_findentry:
+ *
+ * Find the hash table slot for a literal source name using linear
+ * probing.  The table is always at least half empty.
+ *
+ * Return pointer to the matching entry or the empty slot where the
+ * source name would be stored.
+ ***************************************************************************/
+static SelectIndexEntry *
+selectindex_findentry (SelectIndex *index, char *srcname)
+{
+  unsigned int hash;
+
+  hash = selection_hash (srcname) & (index->tablesize - 1);
+
+  while (index->table[hash].srcname && strcmp (index->table[hash].srcname, srcname))
+    hash = (hash + 1) & (index->tablesize - 1);
+
+  return &index->table[hash];
+} /* End of selectindex_findentry() */
+
+/***************************************************************************
+ * selectindex_addentry:
+ *
+ * Add a selection ordinal to the hash table entry for a literal
+ * source name.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+selectindex_addentry (SelectIndex *index, char *srcname, int ordinal)
+{
+  SelectIndexEntry *entry;
+
+  entry          = selectindex_findentry (index, srcname);
+  entry->srcname = srcname;
+
+  return selectindex_addordinal (&entry->ordinals, &entry->ordinalcount,
+                                 &entry->ordinalmax, ordinal);
+} /* End of selectindex_addentry() */
+
+/***************************************************************************
+ * selectindex_addordinal:
+ *
+ * Append an ordinal to a dynamically allocated array.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+selectindex_addordinal (int **ordinals, int *count, int *max, int ordinal)
+{
+  int *newordinals;
+
+  if (*count >= *max)
+  {
+    if (!(newordinals = (int *)realloc (*ordinals, ((*max) ? *max * 2 : 2) * sizeof (int))))
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return -1;
+    }
+
+    *ordinals = newordinals;
+    *max      = (*max) ? *max * 2 : 2;
+  }
+
+  (*ordinals)[(*count)++] = ordinal;
+
+  return 0;
+} /* End of selectindex_addordinal() */
+
+/***************************************************************************
+ * selectindex_addresult:
+ *
+ * Append an ordinal to a match result, moving the ordinals from the
+ * internal buffer to allocated memory when needed.  On error any
+ * allocated memory is freed.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+selectindex_addresult (SelectIndexResult *result, int ordinal)
+{
+  int *newordinals;
+
+  if (result->count >= result->max)
+  {
+    if (result->ordinals == result->buffer)
+    {
+      if ((newordinals = (int *)malloc (result->max * 2 * sizeof (int))))
+        memcpy (newordinals, result->buffer, result->count * sizeof (int));
+    }
+    else
+    {
+      newordinals = (int *)realloc (result->ordinals, result->max * 2 * sizeof (int));
+    }
+
+    if (!newordinals)
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      if (result->ordinals != result->buffer)
+        free (result->ordinals);
+      result->ordinals = result->buffer;
+      return -1;
+    }
+
+    result->ordinals = newordinals;
+    result->max *= 2;
+  }
+
+  result->ordinals[result->count++] = ordinal;
+
+  return 0;
+} /* End of selectindex_addresult() */
+
+/***************************************************************************
+ * selectindex_keycmp:
+ *
+ * qsort() comparison of SelectIndexKey entries by fields and ordinal.
+ ***************************************************************************/
+static int
+selectindex_keycmp (const void *a, const void *b)
+{
+  const SelectIndexKey *keya = (const SelectIndexKey *)a;
+  const SelectIndexKey *keyb = (const SelectIndexKey *)b;
+  int level;
+  int cmp;
+
+  for (level = 0; level < SELECTINDEX_FIELDS; level++)
+    if ((cmp = strcmp (keya->fields[level], keyb->fields[level])))
+      return cmp;
+
+  return (keya->ordinal > keyb->ordinal) - (keya->ordinal < keyb->ordinal);
+} /* End of selectindex_keycmp() */
+
+/***************************************************************************
+ * selectindex_intcmp:
+ *
+ * qsort() comparison of integers.
+ ***************************************************************************/
+static int
+selectindex_intcmp (const void *a, const void *b)
+{
+  int inta = *(const int *)a;
+  int intb = *(const int *)b;
+
+  return (inta > intb) - (inta < intb);
+} /* End of selectindex_intcmp() */
 
 /***************************************************************************
  * ms_addselect:
@@ -171,6 +1288,14 @@ ms_addselect (Selections **ppselections, char *srcname,
       /* Add time window selection to beginning of window list */
       newst->next          = matchsl->timewindows;
       matchsl->timewindows = newst;
+
+      /* Discard sorted window array, the list is no longer sorted */
+      if (matchsl->windowarray)
+      {
+        free (matchsl->windowarray);
+        matchsl->windowarray = NULL;
+        matchsl->windowcount = 0;
+      }
     }
     else
     {
@@ -215,64 +1340,12 @@ ms_addselect_comp (Selections **ppselections, char *net, char *sta, char *loc,
                    char *chan, char *qual, hptime_t starttime, hptime_t endtime)
 {
   char srcname[100];
-  char selnet[20];
-  char selsta[20];
-  char selloc[20];
-  char selchan[20];
-  char selqual[20];
 
   if (!ppselections)
     return -1;
 
-  if (net)
-  {
-    strncpy (selnet, net, sizeof (selnet));
-    selnet[sizeof (selnet) - 1] = '\0';
-  }
-  else
-    strcpy (selnet, "*");
-
-  if (sta)
-  {
-    strncpy (selsta, sta, sizeof (selsta));
-    selsta[sizeof (selsta) - 1] = '\0';
-  }
-  else
-    strcpy (selsta, "*");
-
-  if (loc)
-  {
-    /* Test for special case blank location ID */
-    if (!strcmp (loc, "--"))
-      selloc[0] = '\0';
-    else
-    {
-      strncpy (selloc, loc, sizeof (selloc));
-      selloc[sizeof (selloc) - 1] = '\0';
-    }
-  }
-  else
-    strcpy (selloc, "*");
-
-  if (chan)
-  {
-    strncpy (selchan, chan, sizeof (selchan));
-    selchan[sizeof (selchan) - 1] = '\0';
-  }
-  else
-    strcpy (selchan, "*");
-
-  if (qual)
-  {
-    strncpy (selqual, qual, sizeof (selqual));
-    selqual[sizeof (selqual) - 1] = '\0';
-  }
-  else
-    strcpy (selqual, "?");
-
   /* Create the srcname globbing match for this entry */
-  snprintf (srcname, sizeof (srcname), "%s_%s_%s_%s_%s",
-            selnet, selsta, selloc, selchan, selqual);
+  selection_compname (srcname, sizeof (srcname), net, sta, loc, chan, qual);
 
   /* Add selection to list */
   if (ms_addselect (ppselections, srcname, starttime, endtime))
@@ -289,6 +1362,11 @@ ms_addselect_comp (Selections **ppselections, char *net, char *sta, char *loc,
  * allocated memory unreachable (leaked), it is expected that this is
  * a program failing condition.
  *
+ * Entries are added to the list as with ms_addselect_comp(), using a
+ * hash table to find existing entries for a source name.  The time
+ * windows of all entries are sorted and merged with
+ * ms_sortselecttimes() after reading.
+ *
  * As a special case if the filename is "-", selection lines will be
  * read from stdin.
  *
@@ -298,9 +1376,13 @@ int
 ms_readselectionsfile (Selections **ppselections, char *filename)
 {
   FILE *fp;
+  SelectHash hash = {NULL, 0, 0};
+  Selections *select;
+  Selections **slot;
   hptime_t starttime;
   hptime_t endtime;
   char selectline[200];
+  char srcname[100];
   char *selnet;
   char *selsta;
   char *selloc;
@@ -316,6 +1398,19 @@ ms_readselectionsfile (Selections **ppselections, char *filename)
   if (!ppselections || !filename)
     return -1;
 
+  /* Add existing entries to hash table, the first entry for a name is used */
+  for (select = *ppselections; select; select = select->next)
+  {
+    if (!(slot = selecthash_find (&hash, select->srcname)))
+      return -1;
+
+    if (!*slot)
+    {
+      *slot = select;
+      hash.count++;
+    }
+  }
+
   if (strcmp (filename, "-"))
   {
     if (!(fp = fopen (filename, "rb")))
@@ -428,6 +1523,7 @@ ms_readselectionsfile (Selections **ppselections, char *filename)
       if (starttime == HPTERROR)
       {
         ms_log (2, "Cannot convert data selection start time (line %d): %s\n", linecount, selstart);
+        free (hash.slots);
         return -1;
       }
     }
@@ -442,6 +1538,7 @@ ms_readselectionsfile (Selections **ppselections, char *filename)
       if (endtime == HPTERROR)
       {
         ms_log (2, "Cannot convert data selection end time (line %d): %s\n", linecount, selend);
+        free (hash.slots);
         return -1;
       }
     }
@@ -450,10 +1547,13 @@ ms_readselectionsfile (Selections **ppselections, char *filename)
       endtime = HPTERROR;
     }
 
-    /* Add selection to list */
-    if (ms_addselect_comp (ppselections, selnet, selsta, selloc, selchan, selqual, starttime, endtime))
+    /* Add selection to list, finding existing entries in the hash table */
+    selection_compname (srcname, sizeof (srcname), selnet, selsta, selloc, selchan, selqual);
+
+    if (selecthash_add (&hash, ppselections, srcname, starttime, endtime))
     {
       ms_log (2, "[%s] Error adding selection on line %d\n", filename, linecount);
+      free (hash.slots);
       return -1;
     }
 
@@ -463,6 +1563,13 @@ ms_readselectionsfile (Selections **ppselections, char *filename)
   if (fp != stdin)
     fclose (fp);
 
+  if (hash.slots)
+    free (hash.slots);
+
+  /* Sort and merge time windows */
+  if (ms_sortselecttimes (*ppselections))
+    return -1;
+
   return selectcount;
 } /* End of ms_readselectionsfile() */
 
@@ -498,6 +1605,9 @@ ms_freeselections (Selections *selections)
         selecttime = selecttimenext;
       }
 
+      if (select->windowarray)
+        free (select->windowarray);
+
       free (select);
 
       select = selectnext;
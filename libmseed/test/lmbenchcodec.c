@@ -0,0 +1,757 @@
+/***************************************************************************
+ * lmbenchcodec.c
+ *
+ * A program for benchmarking the libmseed data encoders and decoders,
+ * record packing and record unpacking.
+ *
+ * Synthetic signals (noise, tides and spikes) are packed into records
+ * of each data encoding at several record lengths.  For each
+ * combination the following operations are timed:
+ *
+ *   encode    : msr_encode_*() of all samples into record data areas
+ *   decode    : msr_decode_*() of the data area of each record
+ *   pack      : msr_pack() of all samples
+ *   unpackhdr : msr_unpack() of each record without data samples
+ *   unpack    : msr_unpack() of each record with data samples
+ *
+ * The unpacked samples are compared to the original signal.  Results
+ * are printed as comma separated values, one line per operation, with
+ * the time per sample and the throughput of encoded bytes.
+ *
+ * modified 2026.289
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libmseed.h>
+#include <packdata.h>
+#include <unpackdata.h>
+
+#define PACKAGE "lmbenchcodec"
+#define VERSION "[libmseed " LIBMSEED_VERSION " " PACKAGE " ]"
+
+#define MAXRECLENS 8
+
+/* Operations benchmarked for each signal, encoding and record length */
+enum
+{
+  OP_ENCODE,
+  OP_DECODE,
+  OP_PACK,
+  OP_UNPACKHDR,
+  OP_UNPACK,
+  OP_COUNT
+};
+
+/* Samples of a signal in each sample type */
+typedef struct Signal_s
+{
+  const char *name;
+  int32_t *idata;   /* 32-bit integers */
+  int32_t *sdata;   /* 32-bit integers clipped to 16-bit range */
+  float *fdata;     /* 32-bit floats */
+  double *ddata;    /* 64-bit doubles */
+} Signal;
+
+/* Parameters of the benchmark for a signal, encoding and record length */
+typedef struct Bench_s
+{
+  Signal *signal;
+  int encoding;
+  int reclen;
+  void *samples;    /* Signal samples for the encoding */
+  char sampletype;
+  int samplesize;
+  int recordcount;
+  int dataoffset;   /* Offset to the data area of each record */
+  int *samplecounts;
+  void *output;     /* Buffer for decoded samples */
+  MSRecord *msr;
+} Bench;
+
+static const char *opnames[OP_COUNT] = {"encode", "decode", "pack", "unpackhdr", "unpack"};
+
+static const int encodings[] = {DE_INT16, DE_INT32, DE_FLOAT32,
+                                DE_FLOAT64, DE_STEIM1, DE_STEIM2};
+
+static flag quiet        = 0;
+static flag byteorder    = 1;
+static int numsamples    = 86400;
+static double mintime    = 0.1;
+static int reclens[MAXRECLENS];
+static int reclencount   = 0;
+
+static char *records   = NULL;
+static int recordsize  = 0;
+static int recordalloc = 0;
+
+static int makesignals (Signal *signals);
+static void freesignal (Signal *signal);
+static int benchcodec (Signal *signal, int encoding, int reclen);
+static int runoperation (Bench *bench, int operation);
+static int verifyrecords (Bench *bench);
+static const char *encodingname (int encoding);
+static uint32_t randomvalue (uint32_t *seed);
+static void record_handler (char *record, int reclen, void *handlerdata);
+static int parameter_proc (int argcount, char **argvec);
+static void print_stderr (char *message);
+static void usage (void);
+
+/* Binary I/O for Windows platforms */
+#ifdef LMP_WIN
+  unsigned int _CRT_fmode = _O_BINARY;
+#endif
+
+int
+main (int argc, char **argv)
+{
+  Signal signals[3];
+  int sidx;
+  int eidx;
+  int ridx;
+
+  /* Redirect libmseed logging facility to stderr for consistency */
+  ms_loginit (print_stderr, NULL, print_stderr, NULL);
+
+  /* Process given parameters (command line and parameter file) */
+  if (parameter_proc (argc, argv) < 0)
+    return -1;
+
+  if (makesignals (signals))
+    return 1;
+
+  printf ("operation,encoding,signal,reclen,records,samples,bytes");
+
+  if (!quiet)
+    printf (",ns_per_sample,mb_per_s");
+
+  printf ("\n");
+
+  for (sidx = 0; sidx < 3; sidx++)
+    for (eidx = 0; eidx < (int)(sizeof (encodings) / sizeof (encodings[0])); eidx++)
+      for (ridx = 0; ridx < reclencount; ridx++)
+        if (benchcodec (&signals[sidx], encodings[eidx], reclens[ridx]))
+          return 1;
+
+  for (sidx = 0; sidx < 3; sidx++)
+    freesignal (&signals[sidx]);
+
+  free (records);
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * makesignals:
+ *
+ * Generate the synthetic signals, sampled at 1 Hz:
+ *
+ * noise  : approximately Gaussian noise with a standard deviation of
+ *          about 1000 counts
+ * tides  : the sum of the four largest tidal constituents with an
+ *          amplitude of about 2^21 counts and a few counts of noise
+ * spikes : low level noise with occasional exponentially decaying
+ *          spikes of up to 2^22 counts
+ *
+ * Sinusoids are generated with a rotation recurrence, avoiding a
+ * dependency on the math library.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+makesignals (Signal *signals)
+{
+  /* Periods in seconds and amplitudes in counts of M2, S2, K1 and O1 */
+  static const double periods[4]    = {44714.2, 43200.0, 86164.1, 92949.6};
+  static const double amplitudes[4] = {900000.0, 420000.0, 530000.0, 380000.0};
+  double cosine[4];
+  double sine[4];
+  double xvalue[4];
+  double yvalue[4];
+  double omega;
+  double tide;
+  double spike = 0.0;
+  double next;
+  uint32_t seed = 1;
+  int32_t noise;
+  int32_t value;
+  int sidx;
+  int cidx;
+  int idx;
+
+  signals[0].name = "noise";
+  signals[1].name = "tides";
+  signals[2].name = "spikes";
+
+  for (cidx = 0; cidx < 4; cidx++)
+  {
+    /* Series for cos() and sin() of the small angle per sample */
+    omega         = 2.0 * 3.14159265358979323846 / periods[cidx];
+    cosine[cidx]  = 1.0 - omega * omega / 2.0 + omega * omega * omega * omega / 24.0;
+    sine[cidx]    = omega - omega * omega * omega / 6.0;
+    xvalue[cidx]  = amplitudes[cidx];
+    yvalue[cidx]  = 0.0;
+  }
+
+  for (sidx = 0; sidx < 3; sidx++)
+  {
+    if (!(signals[sidx].idata = (int32_t *)malloc (numsamples * sizeof (int32_t))) ||
+        !(signals[sidx].sdata = (int32_t *)malloc (numsamples * sizeof (int32_t))) ||
+        !(signals[sidx].fdata = (float *)malloc (numsamples * sizeof (float))) ||
+        !(signals[sidx].ddata = (double *)malloc (numsamples * sizeof (double))))
+    {
+      fprintf (stderr, "Could not allocate buffer, out of memory?\n");
+      return -1;
+    }
+  }
+
+  for (idx = 0; idx < numsamples; idx++)
+  {
+    /* Sum of four uniform values approximates Gaussian noise */
+    noise = 0;
+    for (cidx = 0; cidx < 4; cidx++)
+      noise += (int32_t) (randomvalue (&seed) % 1733) - 866;
+
+    signals[0].idata[idx] = noise;
+
+    tide = 0.0;
+    for (cidx = 0; cidx < 4; cidx++)
+    {
+      tide += xvalue[cidx];
+      next         = xvalue[cidx] * cosine[cidx] - yvalue[cidx] * sine[cidx];
+      yvalue[cidx] = xvalue[cidx] * sine[cidx] + yvalue[cidx] * cosine[cidx];
+      xvalue[cidx] = next;
+    }
+
+    signals[1].idata[idx] = (int32_t)tide + noise / 400;
+
+    if (randomvalue (&seed) % 500 == 0)
+      spike = (double)((int32_t) (randomvalue (&seed) % (1 << 23)) - (1 << 22));
+    else
+      spike *= 0.8;
+
+    signals[2].idata[idx] = (int32_t)spike + noise / 40;
+  }
+
+  for (sidx = 0; sidx < 3; sidx++)
+  {
+    for (idx = 0; idx < numsamples; idx++)
+    {
+      value = signals[sidx].idata[idx];
+
+      signals[sidx].sdata[idx] = (value > 32767) ? 32767 : (value < -32768) ? -32768 : value;
+      signals[sidx].fdata[idx] = (float)value;
+      signals[sidx].ddata[idx] = (double)value;
+    }
+  }
+
+  return 0;
+} /* End of makesignals() */
+
+/***************************************************************************
+ * freesignal:
+ * Free the sample buffers of a signal.
+ ***************************************************************************/
+static void
+freesignal (Signal *signal)
+{
+  free (signal->idata);
+  free (signal->sdata);
+  free (signal->fdata);
+  free (signal->ddata);
+} /* End of freesignal() */
+
+/***************************************************************************
+ * benchcodec:
+ *
+ * Pack a signal into records of the specified encoding and record
+ * length, verify the records and time each operation.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+benchcodec (Signal *signal, int encoding, int reclen)
+{
+  Bench bench;
+  int64_t bytes;
+  int operation;
+  int iterations;
+  clock_t start;
+  clock_t elapsed;
+  double seconds;
+
+  memset (&bench, 0, sizeof (Bench));
+  bench.signal   = signal;
+  bench.encoding = encoding;
+  bench.reclen   = reclen;
+
+  switch (encoding)
+  {
+  case DE_INT16:
+    bench.samples    = signal->sdata;
+    bench.sampletype = 'i';
+    bench.samplesize = sizeof (int32_t);
+    break;
+  case DE_FLOAT32:
+    bench.samples    = signal->fdata;
+    bench.sampletype = 'f';
+    bench.samplesize = sizeof (float);
+    break;
+  case DE_FLOAT64:
+    bench.samples    = signal->ddata;
+    bench.sampletype = 'd';
+    bench.samplesize = sizeof (double);
+    break;
+  default:
+    bench.samples    = signal->idata;
+    bench.sampletype = 'i';
+    bench.samplesize = sizeof (int32_t);
+    break;
+  }
+
+  /* Pack the records once for the decoding operations */
+  if (runoperation (&bench, OP_PACK))
+    return -1;
+
+  bench.recordcount = recordsize / reclen;
+
+  if (!(bench.samplecounts = (int *)malloc (bench.recordcount * sizeof (int))) ||
+      !(bench.output = malloc ((size_t)numsamples * bench.samplesize)))
+  {
+    fprintf (stderr, "Could not allocate buffer, out of memory?\n");
+    return -1;
+  }
+
+  if (verifyrecords (&bench))
+    return -1;
+
+  bytes = (int64_t)bench.recordcount * (reclen - bench.dataoffset);
+
+  for (operation = 0; operation < OP_COUNT; operation++)
+  {
+    iterations = 0;
+    start      = clock ();
+
+    do
+    {
+      if (runoperation (&bench, operation))
+        return -1;
+
+      iterations++;
+      elapsed = clock () - start;
+    } while (!quiet && elapsed < mintime * CLOCKS_PER_SEC);
+
+    printf ("%s,%s,%s,%d,%d,%d,%lld", opnames[operation], encodingname (encoding),
+            signal->name, reclen, bench.recordcount, numsamples,
+            (long long)((operation == OP_ENCODE || operation == OP_DECODE) ? bytes : (int64_t)recordsize));
+
+    if (!quiet)
+    {
+      seconds = (double)elapsed / CLOCKS_PER_SEC / iterations;
+
+      printf (",%.3f,%.1f", seconds * 1e9 / numsamples,
+              (seconds > 0.0) ? ((operation == OP_ENCODE || operation == OP_DECODE) ? bytes : recordsize) / seconds / 1e6 : 0.0);
+    }
+
+    printf ("\n");
+  }
+
+  /* Verify the records repacked by the pack operation */
+  if (verifyrecords (&bench))
+    return -1;
+
+  msr_free (&bench.msr);
+  free (bench.samplecounts);
+  free (bench.output);
+
+  return 0;
+} /* End of benchcodec() */
+
+/***************************************************************************
+ * runoperation:
+ *
+ * Run a single pass of an operation over all samples or records.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+runoperation (Bench *bench, int operation)
+{
+  char dataarea[MAXRECLEN];
+  char *record;
+  int swapflag   = (byteorder != ms_bigendianhost ());
+  int datalength = bench->reclen - bench->dataoffset;
+  int32_t diff0;
+  int offset;
+  int count;
+  int ridx;
+  int rv = 0;
+
+  if (operation == OP_ENCODE)
+  {
+    for (offset = 0; offset < numsamples; offset += rv)
+    {
+      count = numsamples - offset;
+      diff0 = (offset) ? bench->signal->idata[offset] - bench->signal->idata[offset - 1] : 0;
+
+      switch (bench->encoding)
+      {
+      case DE_INT16:
+        rv = msr_encode_int16 ((int32_t *)bench->samples + offset, count, (int16_t *)dataarea, datalength, swapflag);
+        break;
+      case DE_INT32:
+        rv = msr_encode_int32 ((int32_t *)bench->samples + offset, count, (int32_t *)dataarea, datalength, swapflag);
+        break;
+      case DE_FLOAT32:
+        rv = msr_encode_float32 ((float *)bench->samples + offset, count, (float *)dataarea, datalength, swapflag);
+        break;
+      case DE_FLOAT64:
+        rv = msr_encode_float64 ((double *)bench->samples + offset, count, (double *)dataarea, datalength, swapflag);
+        break;
+      case DE_STEIM1:
+        rv = msr_encode_steim1 ((int32_t *)bench->samples + offset, count, (int32_t *)dataarea, datalength, diff0, swapflag);
+        break;
+      case DE_STEIM2:
+        rv = msr_encode_steim2 ((int32_t *)bench->samples + offset, count, (int32_t *)dataarea, datalength, diff0, "BENCH", swapflag);
+        break;
+      }
+
+      if (rv <= 0)
+      {
+        ms_log (2, "Error encoding %s samples at offset %d\n", encodingname (bench->encoding), offset);
+        return -1;
+      }
+    }
+  }
+  else if (operation == OP_DECODE)
+  {
+    for (ridx = 0, offset = 0; ridx < bench->recordcount; ridx++, offset += rv)
+    {
+      record = records + (size_t)ridx * bench->reclen + bench->dataoffset;
+      count  = bench->samplecounts[ridx];
+
+      switch (bench->encoding)
+      {
+      case DE_INT16:
+        rv = msr_decode_int16 ((int16_t *)record, count, (int32_t *)bench->output + offset,
+                               (numsamples - offset) * bench->samplesize, swapflag);
+        break;
+      case DE_INT32:
+        rv = msr_decode_int32 ((int32_t *)record, count, (int32_t *)bench->output + offset,
+                               (numsamples - offset) * bench->samplesize, swapflag);
+        break;
+      case DE_FLOAT32:
+        rv = msr_decode_float32 ((float *)record, count, (float *)bench->output + offset,
+                                 (numsamples - offset) * bench->samplesize, swapflag);
+        break;
+      case DE_FLOAT64:
+        rv = msr_decode_float64 ((double *)record, count, (double *)bench->output + offset,
+                                 (numsamples - offset) * bench->samplesize, swapflag);
+        break;
+      case DE_STEIM1:
+        rv = msr_decode_steim1 ((int32_t *)record, datalength, count, (int32_t *)bench->output + offset,
+                                (numsamples - offset) * bench->samplesize, "BENCH", swapflag);
+        break;
+      case DE_STEIM2:
+        rv = msr_decode_steim2 ((int32_t *)record, datalength, count, (int32_t *)bench->output + offset,
+                                (numsamples - offset) * bench->samplesize, "BENCH", swapflag);
+        break;
+      }
+
+      if (rv != count)
+      {
+        ms_log (2, "Error decoding %s record %d\n", encodingname (bench->encoding), ridx);
+        return -1;
+      }
+    }
+  }
+  else if (operation == OP_PACK)
+  {
+    if (!(bench->msr = msr_init (bench->msr)))
+    {
+      fprintf (stderr, "Could not allocate MSRecord, out of memory?\n");
+      return -1;
+    }
+
+    strcpy (bench->msr->network, "XX");
+    strcpy (bench->msr->station, "BENCH");
+    strcpy (bench->msr->channel, "LHZ");
+    bench->msr->dataquality = 'R';
+    bench->msr->starttime   = ms_timestr2hptime ("2012-01-01T00:00:00");
+    bench->msr->samprate    = 1.0;
+    bench->msr->reclen      = bench->reclen;
+    bench->msr->encoding    = bench->encoding;
+    bench->msr->byteorder   = byteorder;
+    bench->msr->numsamples  = numsamples;
+    bench->msr->samplecnt   = numsamples;
+    bench->msr->datasamples = bench->samples;
+    bench->msr->sampletype  = bench->sampletype;
+
+    recordsize = 0;
+    rv         = msr_pack (bench->msr, record_handler, NULL, NULL, 1, 0);
+
+    bench->msr->datasamples = NULL;
+
+    if (rv < 0)
+    {
+      ms_log (2, "Error packing %s records\n", encodingname (bench->encoding));
+      return -1;
+    }
+  }
+  else
+  {
+    for (ridx = 0; ridx < bench->recordcount; ridx++)
+    {
+      record = records + (size_t)ridx * bench->reclen;
+
+      if (msr_unpack (record, bench->reclen, &bench->msr, (operation == OP_UNPACK), 0) != MS_NOERROR)
+      {
+        ms_log (2, "Error unpacking %s record %d\n", encodingname (bench->encoding), ridx);
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+} /* End of runoperation() */
+
+/***************************************************************************
+ * verifyrecords:
+ *
+ * Unpack each record, collect the sample counts and compare the
+ * samples to the signal.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+verifyrecords (Bench *bench)
+{
+  int offset = 0;
+  int ridx;
+
+  if (bench->recordcount * bench->reclen != recordsize)
+  {
+    ms_log (2, "Packed records are not all %d bytes\n", bench->reclen);
+    return -1;
+  }
+
+  for (ridx = 0; ridx < bench->recordcount; ridx++)
+  {
+    if (msr_unpack (records + (size_t)ridx * bench->reclen, bench->reclen,
+                    &bench->msr, 1, 0) != MS_NOERROR)
+    {
+      ms_log (2, "Error unpacking %s record %d\n", encodingname (bench->encoding), ridx);
+      return -1;
+    }
+
+    if (ridx == 0)
+      bench->dataoffset = bench->msr->fsdh->data_offset;
+
+    if (bench->msr->fsdh->data_offset != bench->dataoffset ||
+        offset + bench->msr->numsamples > numsamples ||
+        memcmp ((char *)bench->samples + (size_t)offset * bench->samplesize, bench->msr->datasamples,
+                (size_t)bench->msr->numsamples * bench->samplesize))
+    {
+      ms_log (2, "Samples of %s record %d do not match the %s signal\n",
+              encodingname (bench->encoding), ridx, bench->signal->name);
+      return -1;
+    }
+
+    bench->samplecounts[ridx] = (int)bench->msr->numsamples;
+    offset += (int)bench->msr->numsamples;
+  }
+
+  if (offset != numsamples)
+  {
+    ms_log (2, "Unpacked %d of %d %s samples\n", offset, numsamples, bench->signal->name);
+    return -1;
+  }
+
+  return 0;
+} /* End of verifyrecords() */
+
+/***************************************************************************
+ * encodingname:
+ * Return a short name for a data encoding.
+ ***************************************************************************/
+static const char *
+encodingname (int encoding)
+{
+  switch (encoding)
+  {
+  case DE_INT16:
+    return "INT16";
+  case DE_INT32:
+    return "INT32";
+  case DE_FLOAT32:
+    return "FLOAT32";
+  case DE_FLOAT64:
+    return "FLOAT64";
+  case DE_STEIM1:
+    return "STEIM1";
+  case DE_STEIM2:
+    return "STEIM2";
+  }
+
+  return "UNKNOWN";
+} /* End of encodingname() */
+
+/***************************************************************************
+ * randomvalue:
+ * Return the next value of a linear congruential generator.
+ ***************************************************************************/
+static uint32_t
+randomvalue (uint32_t *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+
+  return *seed >> 2;
+} /* End of randomvalue() */
+
+/***************************************************************************
+ * record_handler:
+ * Append record data to the record buffer.
+ ***************************************************************************/
+static void
+record_handler (char *record, int reclen, void *handlerdata)
+{
+  if (recordsize + reclen > recordalloc)
+  {
+    recordalloc = (recordalloc) ? recordalloc * 2 : 1048576;
+
+    while (recordsize + reclen > recordalloc)
+      recordalloc *= 2;
+
+    if (!(records = (char *)realloc (records, recordalloc)))
+    {
+      fprintf (stderr, "Could not allocate buffer, out of memory?\n");
+      exit (1);
+    }
+  }
+
+  memcpy (records + recordsize, record, reclen);
+  recordsize += reclen;
+} /* End of record_handler() */
+
+/***************************************************************************
+ * parameter_proc:
+ *
+ * Process the command line parameters.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+parameter_proc (int argcount, char **argvec)
+{
+  int optind;
+  int reclen;
+
+  /* Process all command line arguments */
+  for (optind = 1; optind < argcount; optind++)
+  {
+    if (strcmp (argvec[optind], "-V") == 0)
+    {
+      ms_log (1, "%s version: %s\n", PACKAGE, VERSION);
+      exit (0);
+    }
+    else if (strcmp (argvec[optind], "-h") == 0)
+    {
+      usage ();
+      exit (0);
+    }
+    else if (strcmp (argvec[optind], "-q") == 0)
+    {
+      quiet = 1;
+    }
+    else if (strcmp (argvec[optind], "-L") == 0)
+    {
+      byteorder = 0;
+    }
+    else if (strcmp (argvec[optind], "-s") == 0 && optind + 1 < argcount)
+    {
+      numsamples = strtol (argvec[++optind], NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-t") == 0 && optind + 1 < argcount)
+    {
+      mintime = strtod (argvec[++optind], NULL);
+    }
+    else if (strcmp (argvec[optind], "-r") == 0 && optind + 1 < argcount)
+    {
+      reclen = strtol (argvec[++optind], NULL, 10);
+
+      if ((reclen & (reclen - 1)) || reclen < 128 || reclen > MAXRECLEN)
+      {
+        ms_log (2, "Invalid record length: %s\n", argvec[optind]);
+        exit (1);
+      }
+
+      if (reclencount >= MAXRECLENS)
+      {
+        ms_log (2, "Too many record lengths, maximum is %d\n", MAXRECLENS);
+        exit (1);
+      }
+
+      reclens[reclencount++] = reclen;
+    }
+    else
+    {
+      ms_log (2, "Unknown option: %s\n", argvec[optind]);
+      exit (1);
+    }
+  }
+
+  if (numsamples <= 0)
+  {
+    ms_log (2, "Sample count must be positive\n");
+    exit (1);
+  }
+
+  /* Default record lengths */
+  if (!reclencount)
+  {
+    reclens[reclencount++] = 256;
+    reclens[reclencount++] = 512;
+    reclens[reclencount++] = 4096;
+  }
+
+  return 0;
+} /* End of parameter_proc() */
+
+/***************************************************************************
+ * print_stderr():
+ * Print messsage to stderr.
+ ***************************************************************************/
+static void
+print_stderr (char *message)
+{
+  fprintf (stderr, "%s", message);
+} /* End of print_stderr() */
+
+/***************************************************************************
+ * usage:
+ * Print the usage message and exit.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "%s version: %s\n\n", PACKAGE, VERSION);
+  fprintf (stderr, "Usage: %s [options]\n\n", PACKAGE);
+  fprintf (stderr,
+           " ## Options ##\n"
+           " -V             Report program version\n"
+           " -h             Show this usage message\n"
+           " -q             Verify and run each operation once, do not report timings\n"
+           " -L             Pack little-endian records, default is big-endian\n"
+           " -s count       Number of samples in each signal, default 86400\n"
+           " -t seconds     Minimum time to run each operation, default 0.1\n"
+           " -r bytes       Record length, may be repeated, default 256, 512 and 4096\n"
+           "\n"
+           "This program packs synthetic noise, tide and spike signals into\n"
+           "records of each data encoding and record length and reports the\n"
+           "time per sample and throughput of encoded bytes of each operation\n"
+           "as comma separated values\n"
+           "\n");
+} /* End of usage() */
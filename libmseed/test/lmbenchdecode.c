@@ -0,0 +1,458 @@
+/***************************************************************************
+ * lmbenchdecode.c
+ *
+ * A program for benchmarking and comparing the libmseed Steim-1 and
+ * Steim-2 decoders at each SIMD level.
+ *
+ * Records are read from a file or, if no file is specified, packed
+ * from synthetic data using every Steim difference width in both
+ * encodings and byte orders.  The records are decoded at each SIMD
+ * level, the samples are compared to the scalar decoders and the
+ * throughput is reported.
+ *
+ * modified 2026.289
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libmseed.h>
+#include <unpackdata.h>
+
+#define PACKAGE "lmbenchdecode"
+#define VERSION "[libmseed " LIBMSEED_VERSION " " PACKAGE " ]"
+
+/* Decoding parameters for a Steim record */
+typedef struct DecodeRecord_s
+{
+  int32_t *input;
+  int inputlength;
+  int samplecount;
+  int swapflag;
+} DecodeRecord;
+
+static flag quiet      = 0;
+static int iterations  = 10;
+static int reclen      = 4096;
+static char *inputfile = 0;
+
+static char *records   = NULL;
+static int recordsize  = 0;
+static int recordalloc = 0;
+
+static int benchencoding (int encoding);
+static int readrecords (char *filename);
+static int packrecords (void);
+static void record_handler (char *record, int reclen, void *handlerdata);
+static int parameter_proc (int argcount, char **argvec);
+static void print_stderr (char *message);
+static void usage (void);
+
+static const char *levelnames[] = {"scalar", "SSE4.1", "AVX2"};
+
+/* Binary I/O for Windows platforms */
+#ifdef LMP_WIN
+  unsigned int _CRT_fmode = _O_BINARY;
+#endif
+
+int
+main (int argc, char **argv)
+{
+  int decoded = 0;
+  int rv;
+
+  /* Redirect libmseed logging facility to stderr for consistency */
+  ms_loginit (print_stderr, NULL, print_stderr, NULL);
+
+  /* Process given parameters (command line and parameter file) */
+  if (parameter_proc (argc, argv) < 0)
+    return -1;
+
+  if ((inputfile) ? readrecords (inputfile) : packrecords ())
+    return 1;
+
+  if ((rv = benchencoding (DE_STEIM1)) < 0)
+    return 1;
+  decoded += rv;
+
+  if ((rv = benchencoding (DE_STEIM2)) < 0)
+    return 1;
+  decoded += rv;
+
+  free (records);
+
+  if (!decoded)
+  {
+    ms_log (2, "No Steim records to decode\n");
+    return 1;
+  }
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * benchencoding:
+ *
+ * Decode all records of the specified Steim encoding at each SIMD
+ * level, compare the samples to the scalar decoder and report the
+ * throughput.
+ *
+ * Returns the number of records decoded on success, and -1 on failure
+ ***************************************************************************/
+static int
+benchencoding (int encoding)
+{
+  MSRecord *msr        = NULL;
+  DecodeRecord *decode = NULL;
+  int32_t *reference   = NULL;
+  int32_t *output      = NULL;
+  int64_t totalsamples = 0;
+  int64_t offset       = 0;
+  int decodecount      = 0;
+  int outputlength     = 0;
+  int mismatch;
+  int level;
+  int iter;
+  int idx;
+  int rv;
+  clock_t start;
+  double seconds;
+
+  /* Collect decoding parameters for each record */
+  while (offset < recordsize)
+  {
+    if ((rv = ms_detect (records + offset, recordsize - offset)) <= 0)
+    {
+      ms_log (2, "Cannot detect record at offset %lld\n", (long long)offset);
+      return -1;
+    }
+
+    if (msr_unpack (records + offset, rv, &msr, 0, 0) != MS_NOERROR)
+    {
+      ms_log (2, "Cannot unpack record at offset %lld\n", (long long)offset);
+      return -1;
+    }
+
+    if (msr->encoding == encoding && msr->samplecnt > 0)
+    {
+      if (!(decode = (DecodeRecord *)realloc (decode, (decodecount + 1) * sizeof (DecodeRecord))))
+      {
+        fprintf (stderr, "Could not allocate buffer, out of memory?\n");
+        return -1;
+      }
+
+      decode[decodecount].input       = (int32_t *)(records + offset + msr->fsdh->data_offset);
+      decode[decodecount].inputlength = rv - msr->fsdh->data_offset;
+      decode[decodecount].samplecount = msr->samplecnt;
+      decode[decodecount].swapflag    = (msr->byteorder != ms_bigendianhost ());
+
+      outputlength += msr->samplecnt;
+      decodecount++;
+    }
+
+    offset += rv;
+  }
+
+  msr_free (&msr);
+
+  if (!decodecount)
+    return 0;
+
+  if (!(reference = (int32_t *)malloc (outputlength * sizeof (int32_t))) ||
+      !(output = (int32_t *)malloc (outputlength * sizeof (int32_t))))
+  {
+    fprintf (stderr, "Could not allocate buffer, out of memory?\n");
+    return -1;
+  }
+
+  printf ("%d Steim-%d records, %d samples, %d iterations\n",
+          decodecount, (encoding == DE_STEIM1) ? 1 : 2, outputlength, iterations);
+
+  for (level = 0; level <= 2; level++)
+  {
+    decodesimd   = level;
+    totalsamples = 0;
+    start        = clock ();
+
+    for (iter = 0; iter < iterations; iter++)
+    {
+      offset = 0;
+
+      for (idx = 0; idx < decodecount; idx++)
+      {
+        if (encoding == DE_STEIM1)
+          rv = msr_decode_steim1 (decode[idx].input, decode[idx].inputlength,
+                                  decode[idx].samplecount, output + offset,
+                                  outputlength - offset, inputfile, decode[idx].swapflag);
+        else
+          rv = msr_decode_steim2 (decode[idx].input, decode[idx].inputlength,
+                                  decode[idx].samplecount, output + offset,
+                                  outputlength - offset, inputfile, decode[idx].swapflag);
+
+        if (rv < 0)
+        {
+          ms_log (2, "Error decoding record %d at level %d\n", idx, level);
+          return -1;
+        }
+
+        offset += rv;
+      }
+
+      totalsamples += offset;
+    }
+
+    seconds = (double)(clock () - start) / CLOCKS_PER_SEC;
+
+    if (level == 0)
+      memcpy (reference, output, offset * sizeof (int32_t));
+
+    mismatch = memcmp (reference, output, offset * sizeof (int32_t));
+
+    printf ("%-6s: %s", levelnames[level], (mismatch) ? "DIFFERENT" : "identical");
+
+    if (!quiet)
+      printf (", %.1f Msamples/s", (seconds > 0.0) ? totalsamples / seconds / 1e6 : 0.0);
+
+    printf ("\n");
+  }
+
+  free (decode);
+  free (reference);
+  free (output);
+
+  return decodecount;
+} /* End of benchencoding() */
+
+/***************************************************************************
+ * readrecords:
+ *
+ * Read all records in a file into the record buffer.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+readrecords (char *filename)
+{
+  FILE *fp;
+  char buffer[65536];
+  size_t readsize;
+
+  if (!(fp = fopen (filename, "rb")))
+  {
+    ms_log (2, "Cannot open %s\n", filename);
+    return -1;
+  }
+
+  while ((readsize = fread (buffer, 1, sizeof (buffer), fp)) > 0)
+    record_handler (buffer, (int)readsize, NULL);
+
+  fclose (fp);
+
+  return (records) ? 0 : -1;
+} /* End of readrecords() */
+
+/***************************************************************************
+ * packrecords:
+ *
+ * Pack synthetic Steim-1 and Steim-2 records in both byte orders into
+ * the record buffer.  The data are a bounded random walk with the
+ * difference width changing every 64 samples through all Steim-2
+ * widths, which include all Steim-1 widths.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+packrecords (void)
+{
+  static const int widths[] = {4, 5, 6, 8, 10, 15, 30};
+  MSRecord *msr    = NULL;
+  int32_t *data    = NULL;
+  int numsamples   = 1000000;
+  uint32_t seed    = 1;
+  int32_t sample   = 0;
+  int32_t range;
+  int32_t diff;
+  int encoding;
+  int byteorder;
+  int idx;
+
+  if (!(data = (int32_t *)malloc (numsamples * sizeof (int32_t))))
+  {
+    fprintf (stderr, "Could not allocate buffer, out of memory?\n");
+    return -1;
+  }
+
+  for (idx = 0; idx < numsamples; idx++)
+  {
+    range = 1 << (widths[(idx / 64) % 7] - 1);
+    seed  = seed * 1103515245 + 12345;
+    diff  = (int32_t) ((seed >> 2) % (2 * range - 1)) - (range - 1);
+
+    if ((sample > (1 << 28) && diff > 0) || (sample < -(1 << 28) && diff < 0))
+      diff = -diff;
+
+    data[idx] = sample += diff;
+  }
+
+  for (idx = 0; idx < 4; idx++)
+  {
+    encoding  = (idx < 2) ? DE_STEIM1 : DE_STEIM2;
+    byteorder = idx % 2;
+
+    if (!(msr = msr_init (msr)))
+    {
+      fprintf (stderr, "Could not allocate MSRecord, out of memory?\n");
+      return -1;
+    }
+
+    strcpy (msr->network, "XX");
+    strcpy (msr->station, "TEST");
+    strcpy (msr->channel, "LHZ");
+    msr->dataquality = 'R';
+    msr->starttime   = ms_timestr2hptime ("2012-01-01T00:00:00");
+    msr->samprate    = 1.0;
+    msr->reclen      = reclen;
+    msr->encoding    = encoding;
+    msr->byteorder   = byteorder;
+    msr->numsamples  = numsamples;
+    msr->samplecnt   = numsamples;
+    msr->datasamples = data;
+    msr->sampletype  = 'i';
+
+    if (msr_pack (msr, record_handler, NULL, NULL, 1, 0) < 0)
+    {
+      ms_log (2, "Error packing synthetic records\n");
+      return -1;
+    }
+
+    msr->datasamples = NULL;
+  }
+
+  msr_free (&msr);
+  free (data);
+
+  return 0;
+} /* End of packrecords() */
+
+/***************************************************************************
+ * record_handler:
+ * Append record data to the record buffer.
+ ***************************************************************************/
+static void
+record_handler (char *record, int reclen, void *handlerdata)
+{
+  if (recordsize + reclen > recordalloc)
+  {
+    recordalloc = (recordalloc) ? recordalloc * 2 : 1048576;
+
+    while (recordsize + reclen > recordalloc)
+      recordalloc *= 2;
+
+    if (!(records = (char *)realloc (records, recordalloc)))
+    {
+      fprintf (stderr, "Could not allocate buffer, out of memory?\n");
+      exit (1);
+    }
+  }
+
+  memcpy (records + recordsize, record, reclen);
+  recordsize += reclen;
+} /* End of record_handler() */
+
+/***************************************************************************
+ * parameter_proc:
+ *
+ * Process the command line parameters.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+parameter_proc (int argcount, char **argvec)
+{
+  int optind;
+
+  /* Process all command line arguments */
+  for (optind = 1; optind < argcount; optind++)
+  {
+    if (strcmp (argvec[optind], "-V") == 0)
+    {
+      ms_log (1, "%s version: %s\n", PACKAGE, VERSION);
+      exit (0);
+    }
+    else if (strcmp (argvec[optind], "-h") == 0)
+    {
+      usage ();
+      exit (0);
+    }
+    else if (strcmp (argvec[optind], "-q") == 0)
+    {
+      quiet = 1;
+    }
+    else if (strcmp (argvec[optind], "-n") == 0)
+    {
+      iterations = strtol (argvec[++optind], NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-r") == 0)
+    {
+      reclen = strtol (argvec[++optind], NULL, 10);
+    }
+    else if (strncmp (argvec[optind], "-", 1) == 0 &&
+             strlen (argvec[optind]) > 1)
+    {
+      ms_log (2, "Unknown option: %s\n", argvec[optind]);
+      exit (1);
+    }
+    else if (!inputfile)
+    {
+      inputfile = argvec[optind];
+    }
+    else
+    {
+      ms_log (2, "Unknown option: %s\n", argvec[optind]);
+      exit (1);
+    }
+  }
+
+  if (iterations <= 0)
+  {
+    ms_log (2, "Iterations must be positive\n");
+    exit (1);
+  }
+
+  return 0;
+} /* End of parameter_proc() */
+
+/***************************************************************************
+ * print_stderr():
+ * Print messsage to stderr.
+ ***************************************************************************/
+static void
+print_stderr (char *message)
+{
+  fprintf (stderr, "%s", message);
+} /* End of print_stderr() */
+
+/***************************************************************************
+ * usage:
+ * Print the usage message and exit.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "%s version: %s\n\n", PACKAGE, VERSION);
+  fprintf (stderr, "Usage: %s [options] [file]\n\n", PACKAGE);
+  fprintf (stderr,
+           " ## Options ##\n"
+           " -V             Report program version\n"
+           " -h             Show this usage message\n"
+           " -q             Compare samples only, do not report throughput\n"
+           " -n count       Decode the records count times, default 10\n"
+           " -r bytes       Record length for synthetic records, default 4096\n"
+           "\n"
+           "This program decodes the Steim records in file, or synthetic\n"
+           "records if no file is specified, at each SIMD level and compares\n"
+           "the samples to the scalar decoders\n"
+           "\n");
+} /* End of usage() */
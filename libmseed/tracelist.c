@@ -14,6 +14,7 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "convertdata.h"
 
 MSTraceSeg *mstl_msr2seg (MSRecord *msr, hptime_t endtime);
 MSTraceSeg *mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence);
@@ -837,32 +838,36 @@ mstl_convertsamples (MSTraceSeg *seg, char type, flag truncate)
   {
     if (seg->sampletype == 'f') /* Convert floats to integers with simple rounding */
     {
-      for (idx = 0; idx < seg->numsamples; idx++)
-      {
-        /* Check for loss of sub-integer */
-        if (!truncate && (fdata[idx] - (int32_t)fdata[idx]) > 0.000001)
-        {
-          ms_log (1, "mstl_convertsamples: Warning, loss of precision when converting floats to integers, loss: %g\n",
-                  (fdata[idx] - (int32_t)fdata[idx]));
-          return -1;
-        }
+      /* Check for loss of sub-integer */
+      for (idx = 0; !truncate && idx < seg->numsamples; idx++)
+        if ((fdata[idx] - (int32_t)fdata[idx]) > 0.000001)
+          break;
 
-        idata[idx] = (int32_t) (fdata[idx] + 0.5);
+      /* Samples before any loss of precision are converted, as when done one at a time */
+      ms_convert_float_int32 (fdata, idata, (truncate) ? seg->numsamples : idx);
+
+      if (!truncate && idx < seg->numsamples)
+      {
+        ms_log (1, "mstl_convertsamples: Warning, loss of precision when converting floats to integers, loss: %g\n",
+                (fdata[idx] - (int32_t)fdata[idx]));
+        return -1;
       }
     }
     else if (seg->sampletype == 'd') /* Convert doubles to integers with simple rounding */
     {
-      for (idx = 0; idx < seg->numsamples; idx++)
-      {
-        /* Check for loss of sub-integer */
-        if (!truncate && (ddata[idx] - (int32_t)ddata[idx]) > 0.000001)
-        {
-          ms_log (1, "mstl_convertsamples: Warning, loss of precision when converting doubles to integers, loss: %g\n",
-                  (ddata[idx] - (int32_t)ddata[idx]));
-          return -1;
-        }
+      /* Check for loss of sub-integer */
+      for (idx = 0; !truncate && idx < seg->numsamples; idx++)
+        if ((ddata[idx] - (int32_t)ddata[idx]) > 0.000001)
+          break;
 
-        idata[idx] = (int32_t) (ddata[idx] + 0.5);
+      /* Samples before any loss of precision are converted, as when done one at a time */
+      ms_convert_double_int32 (ddata, idata, (truncate) ? seg->numsamples : idx);
+
+      if (!truncate && idx < seg->numsamples)
+      {
+        ms_log (1, "mstl_convertsamples: Warning, loss of precision when converting doubles to integers, loss: %g\n",
+                (ddata[idx] - (int32_t)ddata[idx]));
+        return -1;
       }
 
       /* Reallocate buffer for reduced size needed */
@@ -881,13 +886,11 @@ mstl_convertsamples (MSTraceSeg *seg, char type, flag truncate)
   {
     if (seg->sampletype == 'i') /* Convert integers to floats */
     {
-      for (idx     = 0; idx < seg->numsamples; idx++)
-        fdata[idx] = (float)idata[idx];
+      ms_convert_int32_float (idata, fdata, seg->numsamples);
     }
     else if (seg->sampletype == 'd') /* Convert doubles to floats */
     {
-      for (idx     = 0; idx < seg->numsamples; idx++)
-        fdata[idx] = (float)ddata[idx];
+      ms_convert_double_float (ddata, fdata, seg->numsamples);
 
       /* Reallocate buffer for reduced size needed */
       if (!(seg->datasamples = realloc (seg->datasamples, (size_t) (seg->numsamples * sizeof (float)))))
@@ -911,15 +914,13 @@ mstl_convertsamples (MSTraceSeg *seg, char type, flag truncate)
 
     if (seg->sampletype == 'i') /* Convert integers to doubles */
     {
-      for (idx     = 0; idx < seg->numsamples; idx++)
-        ddata[idx] = (double)idata[idx];
+      ms_convert_int32_double (idata, ddata, seg->numsamples);
 
       free (idata);
     }
     else if (seg->sampletype == 'f') /* Convert floats to doubles */
     {
-      for (idx     = 0; idx < seg->numsamples; idx++)
-        ddata[idx] = (double)fdata[idx];
+      ms_convert_float_double (fdata, ddata, seg->numsamples);
 
       free (fdata);
     }
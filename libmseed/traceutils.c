@@ -14,6 +14,7 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "convertdata.h"
 
 static int mst_groupsort_cmp (MSTrace *mst1, MSTrace *mst2, flag quality);
 
@@ -1131,32 +1132,36 @@ mst_convertsamples (MSTrace *mst, char type, flag truncate)
   {
     if (mst->sampletype == 'f') /* Convert floats to integers with simple rounding */
     {
-      for (idx = 0; idx < mst->numsamples; idx++)
-      {
-        /* Check for loss of sub-integer */
-        if (!truncate && (fdata[idx] - (int32_t)fdata[idx]) > 0.000001)
-        {
-          ms_log (1, "mst_convertsamples: Warning, loss of precision when converting floats to integers, loss: %g\n",
-                  (fdata[idx] - (int32_t)fdata[idx]));
-          return -1;
-        }
+      /* Check for loss of sub-integer */
+      for (idx = 0; !truncate && idx < mst->numsamples; idx++)
+        if ((fdata[idx] - (int32_t)fdata[idx]) > 0.000001)
+          break;
 
-        idata[idx] = (int32_t) (fdata[idx] + 0.5);
+      /* Samples before any loss of precision are converted, as when done one at a time */
+      ms_convert_float_int32 (fdata, idata, (truncate) ? mst->numsamples : idx);
+
+      if (!truncate && idx < mst->numsamples)
+      {
+        ms_log (1, "mst_convertsamples: Warning, loss of precision when converting floats to integers, loss: %g\n",
+                (fdata[idx] - (int32_t)fdata[idx]));
+        return -1;
       }
     }
     else if (mst->sampletype == 'd') /* Convert doubles to integers with simple rounding */
     {
-      for (idx = 0; idx < mst->numsamples; idx++)
-      {
-        /* Check for loss of sub-integer */
-        if (!truncate && (ddata[idx] - (int32_t)ddata[idx]) > 0.000001)
-        {
-          ms_log (1, "mst_convertsamples: Warning, loss of precision when converting doubles to integers, loss: %g\n",
-                  (ddata[idx] - (int32_t)ddata[idx]));
-          return -1;
-        }
+      /* Check for loss of sub-integer */
+      for (idx = 0; !truncate && idx < mst->numsamples; idx++)
+        if ((ddata[idx] - (int32_t)ddata[idx]) > 0.000001)
+          break;
 
-        idata[idx] = (int32_t) (ddata[idx] + 0.5);
+      /* Samples before any loss of precision are converted, as when done one at a time */
+      ms_convert_double_int32 (ddata, idata, (truncate) ? mst->numsamples : idx);
+
+      if (!truncate && idx < mst->numsamples)
+      {
+        ms_log (1, "mst_convertsamples: Warning, loss of precision when converting doubles to integers, loss: %g\n",
+                (ddata[idx] - (int32_t)ddata[idx]));
+        return -1;
       }
 
       /* Reallocate buffer for reduced size needed */
@@ -1175,13 +1180,11 @@ mst_convertsamples (MSTrace *mst, char type, flag truncate)
   {
     if (mst->sampletype == 'i') /* Convert integers to floats */
     {
-      for (idx     = 0; idx < mst->numsamples; idx++)
-        fdata[idx] = (float)idata[idx];
+      ms_convert_int32_float (idata, fdata, mst->numsamples);
     }
     else if (mst->sampletype == 'd') /* Convert doubles to floats */
     {
-      for (idx     = 0; idx < mst->numsamples; idx++)
-        fdata[idx] = (float)ddata[idx];
+      ms_convert_double_float (ddata, fdata, mst->numsamples);
 
       /* Reallocate buffer for reduced size needed */
       if (!(mst->datasamples = realloc (mst->datasamples, (size_t) (mst->numsamples * sizeof (float)))))
@@ -1205,15 +1208,13 @@ mst_convertsamples (MSTrace *mst, char type, flag truncate)
 
     if (mst->sampletype == 'i') /* Convert integers to doubles */
     {
-      for (idx     = 0; idx < mst->numsamples; idx++)
-        ddata[idx] = (double)idata[idx];
+      ms_convert_int32_double (idata, ddata, mst->numsamples);
 
       free (idata);
     }
     else if (mst->sampletype == 'f') /* Convert floats to doubles */
     {
-      for (idx     = 0; idx < mst->numsamples; idx++)
-        ddata[idx] = (double)fdata[idx];
+      ms_convert_float_double (fdata, ddata, mst->numsamples);
 
       free (fdata);
     }
@@ -25,6 +25,14 @@
 #include "unpackdata.h"
 
 /* Function(s) internal to this file */
+static int unpack_record (MSPackContext *ctx, char *record, int reclen,
+                          MSRecord **ppmsr, flag dataflag, flag verbose);
+static int unpack_data (MSPackContext *ctx, MSRecord *msr, int swapflag,
+                        flag verbose);
+static int unpack_blktchain (MSPackContext *ctx, MSRecord *msr, char *record,
+                             int reclen, flag headerswapflag, flag defer,
+                             flag setfields, BlktLink **lastlink,
+                             char *srcname, flag verbose);
 static int check_environment (int verbose);
 
 /* Header and data byte order flags controlled by environment variables */
@@ -37,6 +45,10 @@ flag unpackdatabyteorder   = -2;
 int unpackencodingformat   = -2;
 int unpackencodingfallback = -2;
 
+/* Lazy blockette unpacking controlled by environment variable */
+/* -2 = not checked, -1 = checked but not set, 0 = off or 1 = on */
+flag unpacklazyblockettes = -2;
+
 /***************************************************************************
  * msr_unpack:
  *
@@ -68,21 +80,325 @@ int unpackencodingfallback = -2;
 int
 msr_unpack (char *record, int reclen, MSRecord **ppmsr,
             flag dataflag, flag verbose)
+{
+  return unpack_record (NULL, record, reclen, ppmsr, dataflag, verbose);
+} /* End of msr_unpack() */
+
+/***************************************************************************
+ * msr_unpack_r:
+ *
+ * Unpack a SEED data record as msr_unpack() into the record owned by
+ * a pack context, see ms_initpackcontext().  The blockette links,
+ * stream state and data sample buffer of the previously unpacked
+ * record are reused, so unpacking records with the same blockettes
+ * and no more samples than before does not allocate memory.  The
+ * data sample buffer is retained when 'dataflag' is false, with
+ * MSRecord->numsamples set to 0.
+ *
+ * The record at *ppmsr is owned by the context and valid until the
+ * next call or ms_freepackcontext().
+ *
+ * Returns MS_NOERROR and sets *ppmsr on success, otherwise returns a
+ * libmseed error code (listed in libmseed.h).
+ ***************************************************************************/
+int
+msr_unpack_r (MSPackContext *ctx, char *record, int reclen, MSRecord **ppmsr,
+              flag dataflag, flag verbose)
+{
+  StreamState *ststate = NULL;
+  int retval;
+
+  if (!ctx || !ppmsr)
+  {
+    ms_log (2, "msr_unpack_r(): ctx and ppmsr arguments cannot be NULL\n");
+    return MS_GENERROR;
+  }
+
+  /* Retain blockette links and stream state of the previous record */
+  if (ctx->msr)
+  {
+    msr_recycle_blktchain (ctx, ctx->msr);
+
+    ststate            = ctx->msr->ststate;
+    ctx->msr->ststate = NULL;
+  }
+
+  retval = unpack_record (ctx, record, reclen, &ctx->msr, dataflag, verbose);
+
+  /* Restore a reset stream state */
+  if (ststate && ctx->msr)
+  {
+    memset (ststate, 0, sizeof (StreamState));
+    ctx->msr->ststate = ststate;
+  }
+  else if (ststate)
+  {
+    free (ststate);
+  }
+
+  *ppmsr = ctx->msr;
+
+  return retval;
+} /* End of msr_unpack_r() */
+
+/***************************************************************************
+ * msr_unpack_recycle:
+ *
+ * Unpack a SEED data record as msr_unpack() into the MSRecord at
+ * *ppmsr, which remains owned by the caller.  The blockette chain of
+ * the MSRecord is first moved to the pack context and the blockette
+ * links of the unpacked record are taken from the context, so
+ * repeatedly unpacking records into the same MSRecord does not
+ * allocate memory for the header.  Data samples are handled as by
+ * msr_unpack().  If ctx is NULL this is identical to msr_unpack().
+ *
+ * Returns MS_NOERROR and populates the MSRecord struct at *ppmsr on
+ * success, otherwise returns a libmseed error code (listed in
+ * libmseed.h).
+ ***************************************************************************/
+int
+msr_unpack_recycle (MSPackContext *ctx, char *record, int reclen,
+                    MSRecord **ppmsr, flag dataflag, flag verbose)
+{
+  if (ctx && ppmsr && *ppmsr)
+    msr_recycle_blktchain (ctx, *ppmsr);
+
+  return unpack_record (ctx, record, reclen, ppmsr, dataflag, verbose);
+} /* End of msr_unpack_recycle() */
+
+/***************************************************************************
+ * msr_unpack_blockettes:
+ *
+ * Unpack all blockettes of a record that was unpacked lazily, i.e.
+ * when MSRecord->blktsdeferred is set.  With lazy unpacking, enabled
+ * with MS_UNPACKLAZYBLOCKETTES(1) or the UNPACK_LAZY_BLOCKETTES
+ * environment variable, only Blockettes 100, 1000 and 1001 are added
+ * to the blockette chain by msr_unpack(), msr_unpack_recycle() and
+ * the record readers.  The blockette chain is rebuilt from the
+ * original record at MSRecord->record, which must still be valid.
+ * The common header fields of the MSRecord are not changed.
+ *
+ * Routines that use the full blockette chain, e.g. msr_print() with
+ * details, msr_duplicate() and msr_pack(), call this routine.
+ *
+ * Returns MS_NOERROR on success, otherwise returns a libmseed error
+ * code (listed in libmseed.h).
+ ***************************************************************************/
+int
+msr_unpack_blockettes (MSRecord *msr, flag verbose)
+{
+  struct fsdh_s fsdh;
+  flag headerswapflag = 0;
+  char srcname[50];
+  int reclen;
+
+  if (!msr || !msr->blktsdeferred)
+    return MS_NOERROR;
+
+  msr->blktsdeferred = 0;
+
+  if (!msr->record || !msr->fsdh)
+  {
+    ms_log (2, "msr_unpack_blockettes(): Original record is not available\n");
+    return MS_GENERROR;
+  }
+
+  /* Determine header byte order as done by msr_unpack() */
+  memcpy (&fsdh, msr->record, sizeof (struct fsdh_s));
+
+  if (!MS_ISVALIDYEARDAY (fsdh.start_time.year, fsdh.start_time.day))
+    headerswapflag = 1;
+
+  if (unpackheaderbyteorder >= 0)
+    headerswapflag = (ms_bigendianhost () != unpackheaderbyteorder) ? 1 : 0;
+
+  /* Length of the original record */
+  reclen = (msr->Blkt1000) ? (1 << msr->Blkt1000->reclen) : msr->reclen;
+
+  if (msr_srcname (msr, srcname, 1) == NULL)
+    return MS_GENERROR;
+
+  msr_free_blktchain (msr);
+
+  unpack_blktchain (NULL, msr, msr->record, reclen, headerswapflag,
+                    0, 0, NULL, srcname, verbose);
+
+  return MS_NOERROR;
+} /* End of msr_unpack_blockettes() */
+
+/***************************************************************************
+ * ms_recheaderinfo:
+ *
+ * Determine the source name, including the quality indicator, start
+ * time, end time and sample count of a raw SEED data record directly
+ * from the fixed section of the data header and Blockettes 100 and
+ * 1001, without allocating memory.  The values are the same as
+ * msr_srcname(), MSRecord->starttime, msr_endtime() and
+ * MSRecord->samplecnt of the record unpacked with msr_unpack().  This
+ * is intended to test records against selection criteria before
+ * unpacking them.
+ *
+ * Any of srcname, starttime, endtime and samplecnt may be NULL if
+ * the value is not needed.  The passed srcname must have enough room
+ * for the resulting string.
+ *
+ * Returns MS_NOERROR on success, otherwise returns a libmseed error
+ * code (listed in libmseed.h).
+ ***************************************************************************/
+int
+ms_recheaderinfo (char *record, int reclen, char *srcname,
+                  hptime_t *starttime, hptime_t *endtime, int64_t *samplecnt)
+{
+  MSRecord msr;
+  struct fsdh_s fsdh;
+  struct blkt_100_s blkt_100;
+  struct blkt_1001_s blkt_1001;
+  flag headerswapflag = 0;
+  uint16_t blkt_type;
+  uint16_t next_blkt;
+  uint32_t blkt_offset;
+  uint32_t blkt_length;
+
+  if (!record)
+    return MS_GENERROR;
+
+  if (!MS_ISVALIDHEADER (record))
+    return MS_NOTSEED;
+
+  if (reclen < MINRECLEN || reclen > MAXRECLEN)
+    return MS_OUTOFRANGE;
+
+  /* Check environment variables if necessary */
+  if (unpackheaderbyteorder == -2 ||
+      unpackdatabyteorder == -2 ||
+      unpackencodingformat == -2 ||
+      unpackencodingfallback == -2 ||
+      unpacklazyblockettes == -2)
+    if (check_environment (0))
+      return MS_GENERROR;
+
+  memcpy (&fsdh, record, sizeof (struct fsdh_s));
+
+  /* Determine header byte order as done by msr_unpack() */
+  if (!MS_ISVALIDYEARDAY (fsdh.start_time.year, fsdh.start_time.day))
+    headerswapflag = 1;
+
+  if (unpackheaderbyteorder >= 0)
+    headerswapflag = (ms_bigendianhost () != unpackheaderbyteorder) ? 1 : 0;
+
+  if (headerswapflag)
+  {
+    MS_SWAPBTIME (&fsdh.start_time);
+    ms_gswap2a (&fsdh.numsamples);
+    ms_gswap2a (&fsdh.samprate_fact);
+    ms_gswap2a (&fsdh.samprate_mult);
+    ms_gswap4a (&fsdh.time_correct);
+    ms_gswap2a (&fsdh.blockette_offset);
+  }
+
+  /* Populate the fields of a record on the stack needed for times */
+  memset (&msr, 0, sizeof (MSRecord));
+  msr.fsdh        = &fsdh;
+  msr.dataquality = fsdh.dataquality;
+  msr.samplecnt   = fsdh.numsamples;
+
+  /* Find Blockettes 100 and 1001 with the checks of unpack_blktchain() */
+  blkt_offset = fsdh.blockette_offset;
+
+  while ((blkt_offset != 0) &&
+         ((int)blkt_offset < reclen) &&
+         (blkt_offset < MAXRECLEN))
+  {
+    memcpy (&blkt_type, record + blkt_offset, 2);
+    memcpy (&next_blkt, record + blkt_offset + 2, 2);
+
+    if (headerswapflag)
+    {
+      ms_gswap2 (&blkt_type);
+      ms_gswap2 (&next_blkt);
+    }
+
+    blkt_length = ms_blktlen (blkt_type, record + blkt_offset, headerswapflag);
+
+    if (blkt_length == 0 || (int)(blkt_offset + blkt_length) > reclen)
+      break;
+
+    if (blkt_type == 100)
+    {
+      memcpy (&blkt_100, record + blkt_offset + 4, sizeof (struct blkt_100_s));
+
+      if (headerswapflag)
+        ms_gswap4 (&blkt_100.samprate);
+
+      msr.Blkt100 = &blkt_100;
+    }
+    else if (blkt_type == 1001)
+    {
+      memcpy (&blkt_1001, record + blkt_offset + 4, sizeof (struct blkt_1001_s));
+
+      msr.Blkt1001 = &blkt_1001;
+    }
+
+    /* Stop at offsets to the next blockette that are not beyond the
+     * current blockette or are beyond the record length */
+    if (next_blkt && (next_blkt < (blkt_offset + blkt_length) || next_blkt > reclen))
+      break;
+
+    blkt_offset = next_blkt;
+  }
+
+  if (srcname)
+  {
+    ms_strncpcleantail (msr.network, fsdh.network, 2);
+    ms_strncpcleantail (msr.station, fsdh.station, 5);
+    ms_strncpcleantail (msr.location, fsdh.location, 2);
+    ms_strncpcleantail (msr.channel, fsdh.channel, 3);
+
+    msr_srcname (&msr, srcname, 1);
+  }
+
+  msr.starttime = msr_starttime (&msr);
+  msr.samprate  = msr_samprate (&msr);
+
+  if (starttime)
+    *starttime = msr.starttime;
+
+  if (endtime)
+    *endtime = msr_endtime (&msr);
+
+  if (samplecnt)
+    *samplecnt = msr.samplecnt;
+
+  return MS_NOERROR;
+} /* End of ms_recheaderinfo() */
+
+/***************************************************************************
+ * unpack_record:
+ *
+ * Unpack a SEED data record as described for msr_unpack(), reusing
+ * the blockette links of a pack context if ctx is not NULL.  The data
+ * sample buffer is only reused for the record owned by the context,
+ * i.e. when ppmsr is &ctx->msr.
+ *
+ * Returns MS_NOERROR and populates the MSRecord struct at *ppmsr on
+ * success, otherwise returns a libmseed error code (listed in
+ * libmseed.h).
+ ***************************************************************************/
+static int
+unpack_record (MSPackContext *ctx, char *record, int reclen, MSRecord **ppmsr,
+               flag dataflag, flag verbose)
 {
   flag headerswapflag = 0;
   flag dataswapflag   = 0;
   int retval;
 
+  MSPackContext *datactx = NULL;
   MSRecord *msr = NULL;
   char sequence_number[7];
   char srcname[50];
 
   /* For blockette parsing */
   BlktLink *blkt_link = 0;
-  uint16_t blkt_type;
-  uint16_t next_blkt;
-  uint32_t blkt_offset;
-  uint32_t blkt_length;
   int blkt_count = 0;
 
   if (!ppmsr)
@@ -109,6 +425,13 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     return MS_OUTOFRANGE;
   }
 
+  /* Only the record owned by a context reuses the sample buffer */
+  if (ctx && ppmsr == &ctx->msr)
+    datactx = ctx;
+
+  if (ctx && !*ppmsr)
+    ctx->allocations++;
+
   /* Initialize the MSRecord */
   if (!(*ppmsr = msr_init (*ppmsr)))
     return MS_GENERROR;
@@ -124,12 +447,19 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   if (unpackheaderbyteorder == -2 ||
       unpackdatabyteorder == -2 ||
       unpackencodingformat == -2 ||
-      unpackencodingfallback == -2)
+      unpackencodingfallback == -2 ||
+      unpacklazyblockettes == -2)
     if (check_environment (verbose))
       return MS_GENERROR;
 
-  /* Allocate and copy fixed section of data header */
-  msr->fsdh = realloc (msr->fsdh, sizeof (struct fsdh_s));
+  /* Allocate and copy fixed section of data header, a retained header is reused */
+  if (!msr->fsdh)
+  {
+    msr->fsdh = malloc (sizeof (struct fsdh_s));
+
+    if (ctx)
+      ctx->allocations++;
+  }
 
   if (msr->fsdh == NULL)
   {
@@ -193,8 +523,148 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
       ms_log (1, "%s: Byte swapping NOT needed for unpacking of header\n", srcname);
   }
 
+  /* Traverse the blockettes, deferring those not needed if requested */
+  blkt_count = unpack_blktchain (ctx, msr, record, reclen, headerswapflag,
+                                 (unpacklazyblockettes > 0 && !datactx), 1,
+                                 &blkt_link, srcname, verbose);
+
+  /* Check for a Blockette 1000 */
+  if (msr->Blkt1000 == 0)
+  {
+    if (verbose > 1)
+    {
+      ms_log (1, "%s: Warning: No Blockette 1000 found\n", srcname);
+    }
+  }
+
+  /* Check that the data offset is after the blockette chain */
+  if (blkt_link && msr->fsdh->numsamples && msr->fsdh->data_offset < (blkt_link->blktoffset + blkt_link->blktdatalen + 4))
+  {
+    ms_log (1, "%s: Warning: Data offset in fixed header (%d) is within the blockette chain ending at %d\n",
+            srcname, msr->fsdh->data_offset, (blkt_link->blktoffset + blkt_link->blktdatalen + 4));
+  }
+
+  /* Check that the blockette count matches the number parsed */
+  if (msr->fsdh->numblockettes != blkt_count)
+  {
+    ms_log (1, "%s: Warning: Number of blockettes in fixed header (%d) does not match the number parsed (%d)\n",
+            srcname, msr->fsdh->numblockettes, blkt_count);
+  }
+
+  /* Populate remaining common header fields */
+  msr->starttime = msr_starttime (msr);
+  msr->samprate  = msr_samprate (msr);
+
+  /* Set MSRecord->byteorder if data byte order is forced */
+  if (unpackdatabyteorder >= 0)
+  {
+    msr->byteorder = unpackdatabyteorder;
+  }
+
+  /* Check if encoding format is forced */
+  if (unpackencodingformat >= 0)
+  {
+    msr->encoding = unpackencodingformat;
+  }
+
+  /* Use encoding format fallback if defined and no encoding is set,
+     also make sure the byteorder is set by default to big endian */
+  if (unpackencodingfallback >= 0 && msr->encoding == -1)
+  {
+    msr->encoding = unpackencodingfallback;
+
+    if (msr->byteorder == -1)
+    {
+      msr->byteorder = 1;
+    }
+  }
+
+  /* Unpack the data samples if requested */
+  if (dataflag && msr->samplecnt > 0)
+  {
+    flag dswapflag     = headerswapflag;
+    flag bigendianhost = ms_bigendianhost ();
+
+    /* Determine byte order of the data and set the dswapflag as
+       needed; if no Blkt1000 or UNPACK_DATA_BYTEORDER environment
+       variable setting assume the order is the same as the header */
+    if (msr->Blkt1000 != 0 && unpackdatabyteorder < 0)
+    {
+      dswapflag = 0;
+
+      /* If BE host and LE data need swapping */
+      if (bigendianhost && msr->byteorder == 0)
+        dswapflag = 1;
+      /* If LE host and BE data (or bad byte order value) need swapping */
+      else if (!bigendianhost && msr->byteorder > 0)
+        dswapflag = 1;
+    }
+    else if (unpackdatabyteorder >= 0)
+    {
+      dswapflag = dataswapflag;
+    }
+
+    if (verbose > 2 && dswapflag)
+      ms_log (1, "%s: Byte swapping needed for unpacking of data samples\n", srcname);
+    else if (verbose > 2)
+      ms_log (1, "%s: Byte swapping NOT needed for unpacking of data samples\n", srcname);
+
+    retval = unpack_data (datactx, msr, dswapflag, verbose);
+
+    if (retval < 0)
+      return retval;
+    else
+      msr->numsamples = retval;
+  }
+  else if (datactx)
+  {
+    /* Retain the data sample buffer for reuse */
+    msr->numsamples = 0;
+  }
+  else
+  {
+    if (msr->datasamples)
+      free (msr->datasamples);
+
+    msr->datasamples = 0;
+    msr->numsamples  = 0;
+  }
+
+  return MS_NOERROR;
+} /* End of unpack_record() */
+
+/***************************************************************************
+ * unpack_blktchain:
+ *
+ * Traverse the blockettes of a SEED data record and add them to the
+ * blockette chain of the MSRecord, byte swapping values if
+ * 'headerswapflag' is true.
+ *
+ * If 'defer' is true only Blockettes 100, 1000 and 1001 are added
+ * and MSRecord->blktsdeferred is set if other blockettes are present.
+ * If 'setfields' is true the common header fields determined by
+ * blockettes (record length, encoding, byte order and sample rate)
+ * are set in the MSRecord.
+ *
+ * The last blockette link added is returned at 'lastlink'.
+ *
+ * Returns the number of blockettes traversed.
+ ***************************************************************************/
+static int
+unpack_blktchain (MSPackContext *ctx, MSRecord *msr, char *record, int reclen,
+                  flag headerswapflag, flag defer, flag setfields,
+                  BlktLink **lastlink, char *srcname, flag verbose)
+{
+  BlktLink *blkt_link = 0;
+  uint16_t blkt_type;
+  uint16_t next_blkt;
+  uint32_t blkt_offset;
+  uint32_t blkt_length;
+  int blkt_count = 0;
+
   /* Traverse the blockettes */
   blkt_offset = msr->fsdh->blockette_offset;
+  msr->blktsdeferred = 0;
 
   while ((blkt_offset != 0) &&
          ((int)blkt_offset < reclen) &&
@@ -232,13 +702,18 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
       break;
     }
 
-    if (blkt_type == 100)
+    if (defer && blkt_type != 100 && blkt_type != 1000 && blkt_type != 1001)
+    { /* Leave other blockettes for msr_unpack_blockettes() */
+      msr->blktsdeferred = 1;
+    }
+
+    else if (blkt_type == 100)
     { /* Found a Blockette 100 */
       struct blkt_100_s *blkt_100;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_100_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_100_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -252,16 +727,17 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
         ms_gswap4 (&blkt_100->samprate);
       }
 
-      msr->samprate = msr->Blkt100->samprate;
+      if (setfields)
+        msr->samprate = msr->Blkt100->samprate;
     }
 
     else if (blkt_type == 200)
     { /* Found a Blockette 200 */
       struct blkt_200_s *blkt_200;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_200_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_200_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -283,9 +759,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     { /* Found a Blockette 201 */
       struct blkt_201_s *blkt_201;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_201_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_201_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -307,9 +783,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     { /* Found a Blockette 300 */
       struct blkt_300_s *blkt_300;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_300_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_300_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -332,9 +808,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     { /* Found a Blockette 310 */
       struct blkt_310_s *blkt_310;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_310_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_310_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -357,9 +833,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     { /* Found a Blockette 320 */
       struct blkt_320_s *blkt_320;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_320_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_320_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -381,9 +857,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     { /* Found a Blockette 390 */
       struct blkt_390_s *blkt_390;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_390_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_390_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -404,9 +880,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     { /* Found a Blockette 395 */
       struct blkt_395_s *blkt_395;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_395_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_395_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -425,9 +901,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     { /* Found a Blockette 400 */
       struct blkt_400_s *blkt_400;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_400_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_400_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -448,9 +924,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     { /* Found a Blockette 405 */
       struct blkt_405_s *blkt_405;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_405_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_405_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -475,9 +951,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     { /* Found a Blockette 500 */
       struct blkt_500_s *blkt_500;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_500_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_500_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -498,9 +974,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     { /* Found a Blockette 1000 */
       struct blkt_1000_s *blkt_1000;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_1000_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_1000_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -509,25 +985,28 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
 
       blkt_1000 = (struct blkt_1000_s *)blkt_link->blktdata;
 
-      /* Calculate record length in bytes as 2^(blkt_1000->reclen) */
-      msr->reclen = (uint32_t)1 << blkt_1000->reclen;
-
-      /* Compare against the specified length */
-      if (msr->reclen != reclen && verbose)
+      if (setfields)
       {
-        ms_log (2, "msr_unpack(%s): Record length in Blockette 1000 (%d) != specified length (%d)\n",
-                srcname, msr->reclen, reclen);
+        /* Calculate record length in bytes as 2^(blkt_1000->reclen) */
+        msr->reclen = (uint32_t)1 << blkt_1000->reclen;
+
+        /* Compare against the specified length */
+        if (msr->reclen != reclen && verbose)
+        {
+          ms_log (2, "msr_unpack(%s): Record length in Blockette 1000 (%d) != specified length (%d)\n",
+                  srcname, msr->reclen, reclen);
+        }
+
+        msr->encoding  = blkt_1000->encoding;
+        msr->byteorder = blkt_1000->byteorder;
       }
-
-      msr->encoding  = blkt_1000->encoding;
-      msr->byteorder = blkt_1000->byteorder;
     }
 
     else if (blkt_type == 1001)
     { /* Found a Blockette 1001 */
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    sizeof (struct blkt_1001_s),
-                                    blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           sizeof (struct blkt_1001_s),
+                                           blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -548,8 +1027,8 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
       /* Minus four bytes for the blockette type and next fields */
       b2klen -= 4;
 
-      blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                    b2klen, blkt_type, 0);
+      blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                           b2klen, blkt_type, 0);
       if (!blkt_link)
         break;
 
@@ -570,9 +1049,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     { /* Unknown blockette type */
       if (blkt_length >= 4)
       {
-        blkt_link = msr_addblockette (msr, record + blkt_offset,
-                                      blkt_length - 4,
-                                      blkt_type, 0);
+        blkt_link = msr_addblockette_r (ctx, msr, record + blkt_offset,
+                                             blkt_length - 4,
+                                             blkt_type, 0);
 
         if (!blkt_link)
           break;
@@ -606,105 +1085,11 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     blkt_count++;
   } /* End of while looping through blockettes */
 
-  /* Check for a Blockette 1000 */
-  if (msr->Blkt1000 == 0)
-  {
-    if (verbose > 1)
-    {
-      ms_log (1, "%s: Warning: No Blockette 1000 found\n", srcname);
-    }
-  }
-
-  /* Check that the data offset is after the blockette chain */
-  if (blkt_link && msr->fsdh->numsamples && msr->fsdh->data_offset < (blkt_link->blktoffset + blkt_link->blktdatalen + 4))
-  {
-    ms_log (1, "%s: Warning: Data offset in fixed header (%d) is within the blockette chain ending at %d\n",
-            srcname, msr->fsdh->data_offset, (blkt_link->blktoffset + blkt_link->blktdatalen + 4));
-  }
-
-  /* Check that the blockette count matches the number parsed */
-  if (msr->fsdh->numblockettes != blkt_count)
-  {
-    ms_log (1, "%s: Warning: Number of blockettes in fixed header (%d) does not match the number parsed (%d)\n",
-            srcname, msr->fsdh->numblockettes, blkt_count);
-  }
+  if (lastlink)
+    *lastlink = blkt_link;
 
-  /* Populate remaining common header fields */
-  msr->starttime = msr_starttime (msr);
-  msr->samprate  = msr_samprate (msr);
-
-  /* Set MSRecord->byteorder if data byte order is forced */
-  if (unpackdatabyteorder >= 0)
-  {
-    msr->byteorder = unpackdatabyteorder;
-  }
-
-  /* Check if encoding format is forced */
-  if (unpackencodingformat >= 0)
-  {
-    msr->encoding = unpackencodingformat;
-  }
-
-  /* Use encoding format fallback if defined and no encoding is set,
-     also make sure the byteorder is set by default to big endian */
-  if (unpackencodingfallback >= 0 && msr->encoding == -1)
-  {
-    msr->encoding = unpackencodingfallback;
-
-    if (msr->byteorder == -1)
-    {
-      msr->byteorder = 1;
-    }
-  }
-
-  /* Unpack the data samples if requested */
-  if (dataflag && msr->samplecnt > 0)
-  {
-    flag dswapflag     = headerswapflag;
-    flag bigendianhost = ms_bigendianhost ();
-
-    /* Determine byte order of the data and set the dswapflag as
-       needed; if no Blkt1000 or UNPACK_DATA_BYTEORDER environment
-       variable setting assume the order is the same as the header */
-    if (msr->Blkt1000 != 0 && unpackdatabyteorder < 0)
-    {
-      dswapflag = 0;
-
-      /* If BE host and LE data need swapping */
-      if (bigendianhost && msr->byteorder == 0)
-        dswapflag = 1;
-      /* If LE host and BE data (or bad byte order value) need swapping */
-      else if (!bigendianhost && msr->byteorder > 0)
-        dswapflag = 1;
-    }
-    else if (unpackdatabyteorder >= 0)
-    {
-      dswapflag = dataswapflag;
-    }
-
-    if (verbose > 2 && dswapflag)
-      ms_log (1, "%s: Byte swapping needed for unpacking of data samples\n", srcname);
-    else if (verbose > 2)
-      ms_log (1, "%s: Byte swapping NOT needed for unpacking of data samples\n", srcname);
-
-    retval = msr_unpack_data (msr, dswapflag, verbose);
-
-    if (retval < 0)
-      return retval;
-    else
-      msr->numsamples = retval;
-  }
-  else
-  {
-    if (msr->datasamples)
-      free (msr->datasamples);
-
-    msr->datasamples = 0;
-    msr->numsamples  = 0;
-  }
-
-  return MS_NOERROR;
-} /* End of msr_unpack() */
+  return blkt_count;
+} /* End of unpack_blktchain() */
 
 /************************************************************************
  *  msr_unpack_data:
@@ -720,6 +1105,22 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
 int
 msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
 {
+  return unpack_data (NULL, msr, swapflag, verbose);
+} /* End of msr_unpack_data() */
+
+/************************************************************************
+ *  unpack_data:
+ *
+ *  Unpack Mini-SEED data samples as described for msr_unpack_data(),
+ *  reusing the data sample buffer tracked by a pack context if ctx
+ *  is not NULL.  The buffer is only grown, never shrunk or freed.
+ *
+ *  Return number of samples unpacked or negative libmseed error code.
+ ************************************************************************/
+static int
+unpack_data (MSPackContext *ctx, MSRecord *msr, int swapflag, flag verbose)
+{
+  void *datasamples;
   int datasize;       /* byte size of data samples in record */
   int nsamples;       /* number of samples unpacked	     */
   int unpacksize;     /* byte size of unpacked samples	     */
@@ -795,7 +1196,26 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
   unpacksize = (int)msr->samplecnt * samplesize;
 
   /* (Re)Allocate space for the unpacked data */
-  if (unpacksize > 0)
+  if (ctx && unpacksize > 0)
+  {
+    if ((size_t)unpacksize > ctx->datasize || !msr->datasamples)
+    {
+      if (!(datasamples = realloc (msr->datasamples, unpacksize)))
+      {
+        ms_log (2, "msr_unpack_data(%s): Cannot (re)allocate memory\n", srcname);
+        return MS_GENERROR;
+      }
+
+      msr->datasamples = datasamples;
+      ctx->datasize    = unpacksize;
+      ctx->allocations++;
+    }
+  }
+  else if (ctx)
+  {
+    msr->numsamples = 0;
+  }
+  else if (unpacksize > 0)
   {
     msr->datasamples = realloc (msr->datasamples, unpacksize);
 
@@ -961,7 +1381,7 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
   }
 
   return nsamples;
-} /* End of msr_unpack_data() */
+} /* End of unpack_data() */
 
 /************************************************************************
  *  check_environment:
@@ -1032,6 +1452,28 @@ check_environment (int verbose)
     }
   }
 
+  /* Read possible environmental variable that enables lazy blockette unpacking */
+  if (unpacklazyblockettes == -2)
+  {
+    if ((envvariable = getenv ("UNPACK_LAZY_BLOCKETTES")))
+    {
+      if (*envvariable != '0' && *envvariable != '1')
+      {
+        ms_log (2, "Environment variable UNPACK_LAZY_BLOCKETTES must be set to '0' or '1'\n");
+        return -1;
+      }
+
+      unpacklazyblockettes = (*envvariable == '1') ? 1 : 0;
+
+      if (verbose > 2 && unpacklazyblockettes)
+        ms_log (1, "UNPACK_LAZY_BLOCKETTES=1, deferring unpacking of blockettes\n");
+    }
+    else
+    {
+      unpacklazyblockettes = -1;
+    }
+  }
+
   /* Read possible environmental variable that forces encoding format */
   if (unpackencodingformat == -2)
   {
@@ -11,11 +11,21 @@
 #include <stdlib.h>
 
 #include "libmseed.h"
+#include "convertdata.h"
 #include "unpackdata.h"
 
+/* SIMD Steim decoding for x86 with GCC compatible compilers */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STEIM_SIMD 1
+#include <immintrin.h>
+#endif
+
 /* Control for printing debugging information */
 int decodedebug = 0;
 
+/* Control for SIMD decoding: -1 = detect, 0 = scalar, 1 = SSE4.1, 2 = AVX2 */
+int decodesimd = -1;
+
 /* Extract bit range.  Byte order agnostic & defined when used with unsigned values */
 #define EXTRACTBITRANGE(VALUE, STARTBIT, LENGTH) ((VALUE >> STARTBIT) & ((1U << LENGTH) - 1))
 
@@ -36,8 +46,7 @@ int
 msr_decode_int16 (int16_t *input, int samplecount, int32_t *output,
                   int outputlength, int swapflag)
 {
-  int16_t sample;
-  int idx;
+  int count;
 
   if (samplecount <= 0)
     return 0;
@@ -45,19 +54,13 @@ msr_decode_int16 (int16_t *input, int samplecount, int32_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
-  {
-    sample = input[idx];
-
-    if (swapflag)
-      ms_gswap2a (&sample);
+  count = outputlength / (int)sizeof (int32_t);
+  if (count > samplecount)
+    count = samplecount;
 
-    output[idx] = (int32_t)sample;
+  ms_convert_int16_int32 (input, output, count, swapflag);
 
-    outputlength -= sizeof (int32_t);
-  }
-
-  return idx;
+  return count;
 } /* End of msr_decode_int16() */
 
 /************************************************************************
@@ -72,8 +75,7 @@ int
 msr_decode_int32 (int32_t *input, int samplecount, int32_t *output,
                   int outputlength, int swapflag)
 {
-  int32_t sample;
-  int idx;
+  int count;
 
   if (samplecount <= 0)
     return 0;
@@ -81,19 +83,16 @@ msr_decode_int32 (int32_t *input, int samplecount, int32_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
-  {
-    sample = input[idx];
+  count = outputlength / (int)sizeof (int32_t);
+  if (count > samplecount)
+    count = samplecount;
 
-    if (swapflag)
-      ms_gswap4a (&sample);
+  if (swapflag)
+    ms_gswap4n (output, input, count);
+  else
+    memcpy (output, input, count * sizeof (int32_t));
 
-    output[idx] = sample;
-
-    outputlength -= sizeof (int32_t);
-  }
-
-  return idx;
+  return count;
 } /* End of msr_decode_int32() */
 
 /************************************************************************
@@ -108,8 +107,7 @@ int
 msr_decode_float32 (float *input, int samplecount, float *output,
                     int outputlength, int swapflag)
 {
-  float sample;
-  int idx;
+  int count;
 
   if (samplecount <= 0)
     return 0;
@@ -117,19 +115,16 @@ msr_decode_float32 (float *input, int samplecount, float *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (float); idx++)
-  {
-    memcpy (&sample, &input[idx], sizeof (float));
+  count = outputlength / (int)sizeof (float);
+  if (count > samplecount)
+    count = samplecount;
 
-    if (swapflag)
-      ms_gswap4a (&sample);
+  if (swapflag)
+    ms_gswap4n (output, input, count);
+  else
+    memcpy (output, input, count * sizeof (float));
 
-    output[idx] = sample;
-
-    outputlength -= sizeof (float);
-  }
-
-  return idx;
+  return count;
 } /* End of msr_decode_float32() */
 
 /************************************************************************
@@ -144,8 +139,7 @@ int
 msr_decode_float64 (double *input, int samplecount, double *output,
                     int outputlength, int swapflag)
 {
-  double sample;
-  int idx;
+  int count;
 
   if (samplecount <= 0)
     return 0;
@@ -153,20 +147,473 @@ msr_decode_float64 (double *input, int samplecount, double *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (double); idx++)
+  count = outputlength / (int)sizeof (double);
+  if (count > samplecount)
+    count = samplecount;
+
+  if (swapflag)
+    ms_gswap8n (output, input, count);
+  else
+    memcpy (output, input, count * sizeof (double));
+
+  return count;
+} /* End of msr_decode_float64() */
+
+#if STEIM_SIMD
+/************************************************************************
+ * SIMD Steim decoding
+ *
+ * Frames are decoded in two steps: all differences in the frame are
+ * expanded into a buffer, each data word is broadcast to all vector
+ * lanes, shifted left (Steim2) or byte shuffled (Steim1) to place
+ * each difference at the top of a lane and arithmetic shifted right
+ * to sign extend it, with per-layout tables.  The samples are then
+ * produced with a vector prefix sum of the differences.
+ *
+ * Kernels are compiled for SSE4.1 and AVX2 using function target
+ * attributes and selected at run time with steim_simdlevel().
+ ************************************************************************/
+
+/* Maximum differences expanded per frame including vector overrun */
+#define STEIM_FRAMEDIFFS (15 * 7 + 8)
+
+/* Shift tables for a data word layout, lmult are 2^lshift for SSE4.1 */
+typedef struct SteimLayout_s
+{
+  int count;          /* Number of differences, -1 if undefined */
+  int rshift;         /* Arithmetic right shift, all lanes */
+  int32_t lshift[8];  /* Left shift for each lane */
+  uint32_t lmult[8];  /* Left shift multiplier for each lane */
+} SteimLayout;
+
+/* Steim2 layouts indexed by (nibble << 2 | dnib).  Four 1-byte differences
+ * are in byte order and shifted from the unswapped word. */
+static const SteimLayout steim2layouts[16] = {
+    {0, 0, {0}, {0}},
+    {0, 0, {0}, {0}},
+    {0, 0, {0}, {0}},
+    {0, 0, {0}, {0}},
+    {4, 24, {24, 16, 8, 0, 0, 0, 0, 0}, {0x1000000, 0x10000, 0x100, 0x1, 0x1, 0x1, 0x1, 0x1}},
+    {4, 24, {24, 16, 8, 0, 0, 0, 0, 0}, {0x1000000, 0x10000, 0x100, 0x1, 0x1, 0x1, 0x1, 0x1}},
+    {4, 24, {24, 16, 8, 0, 0, 0, 0, 0}, {0x1000000, 0x10000, 0x100, 0x1, 0x1, 0x1, 0x1, 0x1}},
+    {4, 24, {24, 16, 8, 0, 0, 0, 0, 0}, {0x1000000, 0x10000, 0x100, 0x1, 0x1, 0x1, 0x1, 0x1}},
+    {-1, 0, {0}, {0}},
+    {1, 2, {2, 0, 0, 0, 0, 0, 0, 0}, {0x4, 0x1, 0x1, 0x1, 0x1, 0x1, 0x1, 0x1}},
+    {2, 17, {2, 17, 0, 0, 0, 0, 0, 0}, {0x4, 0x20000, 0x1, 0x1, 0x1, 0x1, 0x1, 0x1}},
+    {3, 22, {2, 12, 22, 0, 0, 0, 0, 0}, {0x4, 0x1000, 0x400000, 0x1, 0x1, 0x1, 0x1, 0x1}},
+    {5, 26, {2, 8, 14, 20, 26, 0, 0, 0}, {0x4, 0x100, 0x4000, 0x100000, 0x4000000, 0x1, 0x1, 0x1}},
+    {6, 27, {2, 7, 12, 17, 22, 27, 0, 0}, {0x4, 0x80, 0x1000, 0x20000, 0x400000, 0x8000000, 0x1, 0x1}},
+    {7, 28, {4, 8, 12, 16, 20, 24, 28, 0}, {0x10, 0x100, 0x1000, 0x10000, 0x100000, 0x1000000, 0x10000000, 0x1}},
+    {-1, 0, {0}, {0}}};
+
+/* Steim1 byte shuffles indexed by [swapflag][nibble], placing the bytes
+ * of each difference at the top of a lane, 0x80 clears a byte. */
+static const uint8_t steim1shuffles[2][4][16] = {
+    {{0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+     {0x80, 0x80, 0x80, 0, 0x80, 0x80, 0x80, 1, 0x80, 0x80, 0x80, 2, 0x80, 0x80, 0x80, 3},
+     {0x80, 0x80, 0, 1, 0x80, 0x80, 2, 3, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+     {0, 1, 2, 3, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80}},
+    {{0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+     {0x80, 0x80, 0x80, 0, 0x80, 0x80, 0x80, 1, 0x80, 0x80, 0x80, 2, 0x80, 0x80, 0x80, 3},
+     {0x80, 0x80, 1, 0, 0x80, 0x80, 3, 2, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80},
+     {3, 2, 1, 0, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80}}};
+
+/* Steim1 difference count and sign extension shift indexed by nibble */
+static const int steim1counts[4] = {0, 4, 2, 1};
+static const int steim1rshifts[4] = {0, 24, 16, 0};
+
+/* Kernel signatures: expand the differences of a frame, prefix sum differences */
+typedef int (*steim_expand_fn) (const int32_t *input, int swapflag, int startword,
+                                int needed, uint32_t *words, int32_t *diffs, int *badword);
+typedef int32_t (*steim_prefixsum_fn) (const int32_t *diffs, int count,
+                                       int32_t *output, int32_t last);
+
+/************************************************************************
+ * steim_simdlevel:
+ *
+ * Determine the SIMD instruction set used for decoding, limited to
+ * what the CPU supports.  If decodesimd is not set (-1) the level is
+ * detected and can be limited by setting the UNPACK_DATA_SIMD
+ * environment variable to a level, '0' disables SIMD decoding.
+ *
+ * Return 0 for scalar decoding, 1 for SSE4.1 and 2 for AVX2.
+ ************************************************************************/
+static int
+steim_simdlevel (void)
+{
+  static int supported = -1;
+  char *envvariable;
+  int level = 0;
+
+  if (supported < 0)
   {
-    memcpy (&sample, &input[idx], sizeof (double));
+    __builtin_cpu_init ();
+
+    if (__builtin_cpu_supports ("avx2"))
+      level = 2;
+    else if (__builtin_cpu_supports ("sse4.1"))
+      level = 1;
+
+    supported = level;
+  }
+
+  if (decodesimd < 0)
+  {
+    if ((envvariable = getenv ("UNPACK_DATA_SIMD")))
+      decodesimd = strtol (envvariable, NULL, 10);
+    else
+      decodesimd = supported;
+  }
+
+  return (decodesimd < supported) ? decodesimd : supported;
+} /* End of steim_simdlevel() */
+
+/************************************************************************
+ * steim2_expand_avx2:
+ *
+ * Expand the Steim2 differences of data words from startword in a
+ * frame into diffs until at least needed differences are expanded.
+ * The frame words, byte swapped if requested, are stored in words.
+ *
+ * Return number of differences expanded or -1 on undefined word
+ * layouts, the word is stored in badword.
+ ************************************************************************/
+__attribute__ ((target ("avx2"))) static int
+steim2_expand_avx2 (const int32_t *input, int swapflag, int startword,
+                    int needed, uint32_t *words, int32_t *diffs, int *badword)
+{
+  const SteimLayout *layout;
+  uint32_t raw[16];
+  uint32_t nibbles;
+  __m256i lo, hi, value;
+  int nibble;
+  int widx;
+  int count = 0;
+
+  lo = _mm256_loadu_si256 ((const __m256i *)input);
+  hi = _mm256_loadu_si256 ((const __m256i *)(input + 8));
+  _mm256_storeu_si256 ((__m256i *)raw, lo);
+  _mm256_storeu_si256 ((__m256i *)(raw + 8), hi);
+
+  if (swapflag)
+  {
+    const __m256i swapmask = _mm256_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                               3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    lo = _mm256_shuffle_epi8 (lo, swapmask);
+    hi = _mm256_shuffle_epi8 (hi, swapmask);
+  }
+
+  _mm256_storeu_si256 ((__m256i *)words, lo);
+  _mm256_storeu_si256 ((__m256i *)(words + 8), hi);
+
+  nibbles = words[0];
+
+  for (widx = startword; widx < 16 && count < needed; widx++)
+  {
+    nibble = EXTRACTBITRANGE (nibbles, (30 - (2 * widx)), 2);
+    layout = &steim2layouts[(nibble << 2) | (words[widx] >> 30)];
+
+    if (layout->count <= 0)
+    {
+      if (layout->count < 0)
+      {
+        *badword = widx;
+        return -1;
+      }
+      continue;
+    }
+
+    value = _mm256_set1_epi32 ((nibble == 1) ? raw[widx] : words[widx]);
+    value = _mm256_sllv_epi32 (value, _mm256_loadu_si256 ((const __m256i *)layout->lshift));
+    value = _mm256_sra_epi32 (value, _mm_cvtsi32_si128 (layout->rshift));
+    _mm256_storeu_si256 ((__m256i *)(diffs + count), value);
+
+    count += layout->count;
+  }
+
+  return count;
+} /* End of steim2_expand_avx2() */
+
+/************************************************************************
+ * steim2_expand_sse41:
+ *
+ * SSE4.1 version of steim2_expand_avx2(), variable left shifts are
+ * done by multiplication.
+ ************************************************************************/
+__attribute__ ((target ("sse4.1"))) static int
+steim2_expand_sse41 (const int32_t *input, int swapflag, int startword,
+                     int needed, uint32_t *words, int32_t *diffs, int *badword)
+{
+  const SteimLayout *layout;
+  uint32_t raw[16];
+  uint32_t nibbles;
+  __m128i frame[4], value, shift;
+  int nibble;
+  int widx;
+  int idx;
+  int count = 0;
+
+  for (idx = 0; idx < 4; idx++)
+  {
+    frame[idx] = _mm_loadu_si128 ((const __m128i *)(input + 4 * idx));
+    _mm_storeu_si128 ((__m128i *)(raw + 4 * idx), frame[idx]);
 
     if (swapflag)
-      ms_gswap8a (&sample);
+      frame[idx] = _mm_shuffle_epi8 (frame[idx], _mm_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4,
+                                                                11, 10, 9, 8, 15, 14, 13, 12));
 
-    output[idx] = sample;
+    _mm_storeu_si128 ((__m128i *)(words + 4 * idx), frame[idx]);
+  }
+
+  nibbles = words[0];
+
+  for (widx = startword; widx < 16 && count < needed; widx++)
+  {
+    nibble = EXTRACTBITRANGE (nibbles, (30 - (2 * widx)), 2);
+    layout = &steim2layouts[(nibble << 2) | (words[widx] >> 30)];
 
-    outputlength -= sizeof (double);
+    if (layout->count <= 0)
+    {
+      if (layout->count < 0)
+      {
+        *badword = widx;
+        return -1;
+      }
+      continue;
+    }
+
+    value = _mm_set1_epi32 ((nibble == 1) ? raw[widx] : words[widx]);
+    shift = _mm_cvtsi32_si128 (layout->rshift);
+
+    _mm_storeu_si128 ((__m128i *)(diffs + count),
+                      _mm_sra_epi32 (_mm_mullo_epi32 (value, _mm_loadu_si128 ((const __m128i *)layout->lmult)), shift));
+
+    if (layout->count > 4)
+      _mm_storeu_si128 ((__m128i *)(diffs + count + 4),
+                        _mm_sra_epi32 (_mm_mullo_epi32 (value, _mm_loadu_si128 ((const __m128i *)(layout->lmult + 4))), shift));
+
+    count += layout->count;
   }
 
-  return idx;
-} /* End of msr_decode_float64() */
+  return count;
+} /* End of steim2_expand_sse41() */
+
+/************************************************************************
+ * steim1_expand_sse41:
+ *
+ * Expand the Steim1 differences of data words from startword in a
+ * frame into diffs until at least needed differences are expanded,
+ * see steim2_expand_avx2().  Each word is expanded with a single
+ * shuffle and shift, AVX2 offers no wider layout so this kernel is
+ * used at both levels.
+ *
+ * Return number of differences expanded, Steim1 has no undefined
+ * word layouts.
+ ************************************************************************/
+__attribute__ ((target ("sse4.1"))) static int
+steim1_expand_sse41 (const int32_t *input, int swapflag, int startword,
+                     int needed, uint32_t *words, int32_t *diffs, int *badword)
+{
+  const __m128i swapmask = _mm_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  __m128i value;
+  uint32_t nibbles;
+  int nibble;
+  int widx;
+  int idx;
+  int count = 0;
+
+  (void)badword;
+
+  for (idx = 0; idx < 4; idx++)
+  {
+    value = _mm_loadu_si128 ((const __m128i *)(input + 4 * idx));
+    _mm_storeu_si128 ((__m128i *)(words + 4 * idx),
+                      (swapflag) ? _mm_shuffle_epi8 (value, swapmask) : value);
+  }
+
+  nibbles = words[0];
+  swapflag = (swapflag) ? 1 : 0;
+
+  for (widx = startword; widx < 16 && count < needed; widx++)
+  {
+    nibble = EXTRACTBITRANGE (nibbles, (30 - (2 * widx)), 2);
+
+    if (nibble == 0)
+      continue;
+
+    value = _mm_set1_epi32 (input[widx]);
+    value = _mm_shuffle_epi8 (value, _mm_loadu_si128 ((const __m128i *)steim1shuffles[swapflag][nibble]));
+    value = _mm_sra_epi32 (value, _mm_cvtsi32_si128 (steim1rshifts[nibble]));
+    _mm_storeu_si128 ((__m128i *)(diffs + count), value);
+
+    count += steim1counts[nibble];
+  }
+
+  return count;
+} /* End of steim1_expand_sse41() */
+
+/************************************************************************
+ * steim_prefixsum_avx2:
+ *
+ * Calculate count samples from differences, each sample is the
+ * previous sample plus the difference, starting from last.
+ *
+ * Return the last sample calculated.
+ ************************************************************************/
+__attribute__ ((target ("avx2"))) static int32_t
+steim_prefixsum_avx2 (const int32_t *diffs, int count, int32_t *output, int32_t last)
+{
+  const __m256i carrylanes = _mm256_setr_epi32 (0, 0, 0, 0, 3, 3, 3, 3);
+  const __m256i lastlane = _mm256_set1_epi32 (7);
+  __m256i sum;
+  __m256i carry;
+  __m256i base = _mm256_set1_epi32 (last);
+  int idx;
+
+  for (idx = 0; idx + 8 <= count; idx += 8)
+  {
+    /* Prefix sum within each 128-bit lane, then carry low lane total to high lane */
+    sum = _mm256_loadu_si256 ((const __m256i *)(diffs + idx));
+    sum = _mm256_add_epi32 (sum, _mm256_slli_si256 (sum, 4));
+    sum = _mm256_add_epi32 (sum, _mm256_slli_si256 (sum, 8));
+    carry = _mm256_permutevar8x32_epi32 (sum, carrylanes);
+    sum = _mm256_add_epi32 (sum, _mm256_blend_epi32 (_mm256_setzero_si256 (), carry, 0xF0));
+    sum = _mm256_add_epi32 (sum, base);
+
+    _mm256_storeu_si256 ((__m256i *)(output + idx), sum);
+
+    base = _mm256_permutevar8x32_epi32 (sum, lastlane);
+  }
+
+  last = _mm_cvtsi128_si32 (_mm256_castsi256_si128 (base));
+
+  for (; idx < count; idx++)
+  {
+    last = (int32_t) ((uint32_t)last + (uint32_t)diffs[idx]);
+    output[idx] = last;
+  }
+
+  return last;
+} /* End of steim_prefixsum_avx2() */
+
+/************************************************************************
+ * steim_prefixsum_sse41:
+ *
+ * SSE4.1 version of steim_prefixsum_avx2().
+ ************************************************************************/
+__attribute__ ((target ("sse4.1"))) static int32_t
+steim_prefixsum_sse41 (const int32_t *diffs, int count, int32_t *output, int32_t last)
+{
+  __m128i sum;
+  __m128i base = _mm_set1_epi32 (last);
+  int idx;
+
+  for (idx = 0; idx + 4 <= count; idx += 4)
+  {
+    sum = _mm_loadu_si128 ((const __m128i *)(diffs + idx));
+    sum = _mm_add_epi32 (sum, _mm_slli_si128 (sum, 4));
+    sum = _mm_add_epi32 (sum, _mm_slli_si128 (sum, 8));
+    sum = _mm_add_epi32 (sum, base);
+
+    _mm_storeu_si128 ((__m128i *)(output + idx), sum);
+
+    base = _mm_shuffle_epi32 (sum, 0xFF);
+  }
+
+  last = _mm_cvtsi128_si32 (base);
+
+  for (; idx < count; idx++)
+  {
+    last = (int32_t) ((uint32_t)last + (uint32_t)diffs[idx]);
+    output[idx] = last;
+  }
+
+  return last;
+} /* End of steim_prefixsum_sse41() */
+
+/************************************************************************
+ * msr_decode_steim_simd:
+ *
+ * Decode Steim1 or Steim2 (version) encoded miniSEED data using the
+ * SIMD kernels for the specified level, see msr_decode_steim2() for
+ * arguments.  Decoded samples, warnings and errors are identical to
+ * the scalar decoders.
+ *
+ * Return number of samples in output buffer on success, -1 on error.
+ ************************************************************************/
+static int
+msr_decode_steim_simd (int version, int level, int32_t *input, int inputlength,
+                       int samplecount, int32_t *output, char *srcname, int swapflag)
+{
+  steim_expand_fn expand;
+  steim_prefixsum_fn prefixsum = (level >= 2) ? steim_prefixsum_avx2 : steim_prefixsum_sse41;
+  int32_t *outputptr = output;
+  int32_t diffs[STEIM_FRAMEDIFFS];
+  uint32_t words[16];
+  int32_t X0 = 0;
+  int32_t Xn = 0;
+  int32_t last = 0;
+  int32_t *diffptr;
+  int maxframes = inputlength / 64;
+  int frameidx;
+  int badword;
+  int count;
+
+  if (version == 1)
+    expand = steim1_expand_sse41;
+  else
+    expand = (level >= 2) ? steim2_expand_avx2 : steim2_expand_sse41;
+
+  for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
+  {
+    count = expand (input + (16 * frameidx), swapflag, (frameidx == 0) ? 3 : 1,
+                    samplecount, words, diffs, &badword);
+
+    if (frameidx == 0)
+    {
+      X0 = words[1];
+      Xn = words[2];
+    }
+
+    if (count < 0)
+    {
+      if ((words[badword] >> 30) == 0)
+        ms_log (2, "%s: Impossible Steim2 dnib=00 for nibble=10\n", srcname);
+      else
+        ms_log (2, "%s: Impossible Steim2 dnib=11 for nibble=11\n", srcname);
+
+      return -1;
+    }
+
+    if (count > samplecount)
+      count = samplecount;
+
+    diffptr = diffs;
+
+    /* Ignore first difference, instead store X0 */
+    if (outputptr == output && count > 0)
+    {
+      *outputptr++ = last = X0;
+      diffptr++;
+      count--;
+      samplecount--;
+    }
+
+    last = prefixsum (diffptr, count, outputptr, last);
+    outputptr += count;
+    samplecount -= count;
+  }
+
+  /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
+  if (outputptr != output && *(outputptr - 1) != Xn)
+  {
+    ms_log (1, "%s: Warning: Data integrity check for Steim%d failed, Last sample=%d, Xn=%d\n",
+            srcname, version, *(outputptr - 1), Xn);
+  }
+
+  return (outputptr - output);
+} /* End of msr_decode_steim_simd() */
+#endif /* STEIM_SIMD */
 
 /************************************************************************
  * msr_decode_steim1:
@@ -192,6 +639,9 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
   int widx;
   int diffcount;
   int idx;
+#if STEIM_SIMD
+  int level;
+#endif
 
   union dword {
     int8_t d8[4];
@@ -205,6 +655,12 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
   if (!input || !output || outputlength <= 0 || maxframes <= 0)
     return -1;
 
+#if STEIM_SIMD
+  if (!decodedebug && (level = steim_simdlevel ()) > 0)
+    return msr_decode_steim_simd (1, level, input, inputlength, samplecount,
+                                  output, srcname, swapflag);
+#endif
+
   if (decodedebug)
     ms_log (1, "Decoding %d Steim1 frames, swapflag: %d, srcname: %s\n",
             maxframes, swapflag, (srcname) ? srcname : "");
@@ -348,6 +804,9 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
   int diffcount;
   int dnib;
   int idx;
+#if STEIM_SIMD
+  int level;
+#endif
 
   union dword {
     int8_t d8[4];
@@ -360,6 +819,12 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
   if (!input || !output || outputlength <= 0 || maxframes <= 0)
     return -1;
 
+#if STEIM_SIMD
+  if (!decodedebug && (level = steim_simdlevel ()) > 0)
+    return msr_decode_steim_simd (2, level, input, inputlength, samplecount,
+                                  output, srcname, swapflag);
+#endif
+
   if (decodedebug)
     ms_log (1, "Decoding %d Steim2 frames, swapflag: %d, srcname: %s\n",
             maxframes, swapflag, (srcname) ? srcname : "");
@@ -17,6 +17,9 @@ extern "C" {
 /* Control for printing debugging information, declared in unpackdata.c */
 extern int decodedebug;
 
+/* Control for SIMD decoding, declared in unpackdata.c */
+extern int decodesimd;
+
 extern int msr_decode_int16 (int16_t *input, int samplecount, int32_t *output,
                              int outputlength, int swapflag);
 extern int msr_decode_int32 (int32_t *input, int samplecount, int32_t *output,
@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
 #include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,6 +32,7 @@
 #include <libmseed.h>
 
 #include "dsarchive.h"
+#include "steimtrim.h"
 
 #define VERSION "1.1"
 #define PACKAGE "datafilter"
@@ -51,22 +53,173 @@ typedef struct Archive_s
   struct Archive_s *next;
 } Archive;
 
-static int readfile (Filelink *flp);
+/* Output record container, used to buffer records produced by worker threads */
+typedef struct OutputRecord_s
+{
+  MSRecord msr; /* Copy of record details, pointer members are not valid */
+  struct fsdh_s fsdh; /* Copy of fixed section of data header */
+  size_t offset; /* Offset of raw record in work unit buffer */
+} OutputRecord;
+
+/* Output queue slot, a copy of a record queued for the writer thread */
+typedef struct OutputSlot_s
+{
+  MSRecord msr; /* Copy of record details, pointer members are not valid */
+  struct fsdh_s fsdh; /* Copy of fixed section of data header */
+  char *record; /* Raw record buffer, reused for records queued in the slot */
+  int recordsize; /* Allocated size of raw record buffer */
+} OutputSlot;
+
+/* Bounded single-producer/single-consumer queue of records written by
+ * the writer thread.  The tail is only stored by the producer and the
+ * head only by the writer thread, the indexes are kept on separate
+ * cache lines.  A side waiting on a full or empty queue sets its
+ * waiting flag and sleeps on the condition variable, the other side
+ * only takes the lock when the flag is set and a batch of slots is
+ * filled or freed, limiting thread wake ups. */
+typedef struct OutputQueue_s
+{
+  OutputSlot *slots; /* Ring of slots, size is a power of 2 */
+  unsigned int size; /* Number of slots */
+  unsigned int batch; /* Number of slots filled or freed before waking a waiting side */
+  char pad1[64];
+  unsigned int head; /* Next slot to write, stored by the writer thread */
+  char pad2[64];
+  unsigned int tail; /* Next slot to fill, stored by the producer */
+  char pad3[64];
+  int done; /* Flag indicating no more records will be queued */
+  int writerwaiting; /* Flag indicating the writer thread is waiting for records */
+  int producerwaiting; /* Flag indicating the producer is waiting for free slots */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} OutputQueue;
+
+/* Work unit for parallel processing, one per input file or file chunk */
+typedef struct WorkUnit_s
+{
+  Filelink *flp; /* Input file to process */
+  flag chunk; /* Unit is a chunk of a split input file, flp is owned by the unit */
+  int status; /* Processing status: 0 = pending, 1 = active, 2 = complete */
+  int retval; /* Return value of readfile() */
+  char *buffer; /* Buffer of raw output records */
+  size_t buffersize; /* Allocated size of record buffer */
+  size_t bufferlength; /* Used length of record buffer */
+  OutputRecord *records; /* Output record details */
+  int recordcount; /* Number of output records */
+  int recordmax; /* Allocated number of output records */
+} WorkUnit;
+
+/* Queue of work units shared by worker threads and the writer */
+typedef struct WorkQueue_s
+{
+  WorkUnit *units; /* Work units in input order */
+  int unitcount; /* Number of work units */
+  int nextunit; /* Next unit to be processed by a worker */
+  int nextwrite; /* Next unit to be written, units are written in order */
+  int maxahead; /* Maximum number of units processed ahead of the writer */
+  int stop; /* Flag indicating workers should stop */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} WorkQueue;
+
+/* Per source name match outcome, cached by readfile() */
+typedef struct MatchEntry_s
+{
+  char *srcname; /* Source name, NULL for an empty table slot */
+  int skip; /* Skip reason: 0 = not skipped, 1 = match, 2 = reject, 3 = selection */
+  Selections **matches; /* Selections with matching source names, in list order */
+  int matchcount; /* Number of matching selections */
+} MatchEntry;
+
+/* Hash table of match outcomes keyed by source name */
+typedef struct MatchCache_s
+{
+  MatchEntry *entries; /* Table of entries, size is a power of 2 */
+  unsigned int size; /* Number of table slots */
+  unsigned int count; /* Number of used table slots */
+  uint64_t hits; /* Count of lookups found in the table */
+  uint64_t misses; /* Count of lookups added to the table */
+} MatchCache;
+
+/* Set of regular expressions matched against source names, patterns
+ * that are literals, optionally anchored, are matched using a hash
+ * table and the remaining patterns are combined into a single regex */
+typedef struct RegexSet_s
+{
+  char **literals; /* Hash table of literal keys: literal type followed by literal */
+  unsigned int size; /* Number of hash table slots, a power of 2 */
+  unsigned int count; /* Number of literal keys */
+  flag lengths[4][100]; /* Flags for literal lengths present, by literal type */
+  char *pattern; /* Alternation of patterns that are not literals */
+  int patterncount; /* Number of patterns in alternation */
+  regex_t *regex; /* Compiled alternation, NULL if all patterns are literals */
+} RegexSet;
+
+/* Record output target, used as handler data for outputrecord() */
+typedef struct OutputTarget_s
+{
+  MSRecord *msr; /* Record details of output record */
+  WorkUnit *unit; /* Work unit to buffer records in, NULL to write directly */
+} OutputTarget;
+
+/* Raw record filter state, used as filter data for filterrecord() */
+typedef struct RecordFilter_s
+{
+  Filelink *flp; /* File being read */
+  MatchCache *cache; /* Source name match outcomes */
+  off_t selectedoffset; /* File offset of last selected record, -1 if none */
+  MatchEntry *matchentry; /* Match entry of last selected record */
+  int matchidx; /* Selection index of last selected record */
+  SelectTime *matchstp; /* Selection time window of last selected record */
+  uint64_t skipped; /* Count of records skipped before unpacking */
+} RecordFilter;
+
+static int readfile (Filelink *flp, WorkUnit *unit);
+static int selectrecord (MatchCache *cache, char *srcname, hptime_t recstarttime,
+                         hptime_t recendtime, int64_t samplecnt, MatchEntry **matchentry,
+                         int *matchidx, SelectTime **matchstp);
+static int filterrecord (char *record, int recordlen, off_t offset, void *filterdata);
 static int trimrecord (MSRecord *msr, hptime_t recendtime,
                        hptime_t newstart, hptime_t newend,
-                       Filelink *flp, int64_t fpos);
-static void writerecord (char *record, int reclen, void *handlerdata);
-static int findselectlimits (Selections *select, char *srcname,
+                       Filelink *flp, int64_t fpos, WorkUnit *unit,
+                       MSPackContext *packctx);
+static int trimrawrecord (MSRecord *msr, int64_t starttrim, int64_t endtrim,
+                          hptime_t newstarttime, WorkUnit *unit,
+                          MSPackContext *packctx);
+static int64_t trimcount (hptime_t distance, hptime_t hpdelta, int64_t maxcount);
+static void outputrecord (char *record, int reclen, void *handlerdata);
+static int bufferrecord (WorkUnit *unit, char *record, int reclen, MSRecord *msr);
+static void copyrecord (MSRecord *copy, struct fsdh_s *fsdh, MSRecord *msr, int reclen);
+static int queuerecord (char *record, int reclen, MSRecord *msr);
+static int writerecord (char *record, int reclen, MSRecord *msr);
+static int startwriter (int slots);
+static void stopwriter (void);
+static void *writerthread (void *arg);
+static int processparallel (int threadcount);
+static void *workerthread (void *arg);
+static void primehandler (char *record, int reclen, void *handlerdata);
+static int splitfile (Filelink *flp, uint64_t chunksize, Filelink **chunklist);
+static int64_t findrecordstart (FILE *fp, uint64_t base, uint64_t offset,
+                                uint64_t limit, uint64_t end);
+static MatchEntry *matchsrcname (MatchCache *cache, char *srcname);
+static void freematchcache (MatchCache *cache);
+static int findselectlimits (Selections **matches, int matchcount, char *srcname,
                              hptime_t starttime, hptime_t endtime,
                              hptime_t *selectstart, hptime_t *selectend);
 static void printwritten (MSTraceList *mstl);
 static int processparam (int argcount, char **argvec);
 static char *getoptval (int argcount, char **argvec, int argopt);
+static int parsesize (const char *value, uint64_t *size);
 static int setofilelimit (int limit);
 static int addfile (char *filename);
 static int addlistfile (char *filename);
 static int addarchive (const char *path, const char *layout);
-static int readregexfile (char *regexfile, char **pppattern);
+static int readregexfile (char *regexfile, RegexSet **ppset);
+static int addregex (RegexSet **ppset, char *pattern);
+static int compileregexset (RegexSet *set);
+static int matchregexset (RegexSet *set, char *srcname);
+static char **findliteral (RegexSet *set, char *key);
 static void usage (int level);
 
 static flag verbose = 0;
@@ -75,9 +228,15 @@ static int reclen = -1; /* Input data record length, autodetected in most cases
 static hptime_t starttime = HPTERROR; /* Limit to records containing or after starttime */
 static hptime_t endtime = HPTERROR; /* Limit to records containing or before endtime */
 
-static regex_t *match = 0; /* Compiled match regex */
-static regex_t *reject = 0; /* Compiled reject regex */
+static RegexSet *match = 0; /* Compiled match regexes */
+static RegexSet *reject = 0; /* Compiled reject regexes */
 static flag skipzerosamps = 0; /* Controls skipping of records with zero samples */
+static flag usemmap = 0; /* Controls reading of input files via memory mapping */
+static int workers = 0; /* Number of worker threads, parallel processing if > 1 */
+static uint64_t splitsize = 67108864; /* Split input files larger than this for parallel processing, 0 = never */
+
+static int queueslots = 1024; /* Records queued for the writer thread, 0 = write directly */
+static OutputQueue *outqueue = 0; /* Queue of records for the writer thread, NULL if not running */
 
 static char *outputfile = 0; /* Single output file */
 static flag outputmode = 0; /* Mode for single output file: 0=overwrite, 1=append */
@@ -86,6 +245,7 @@ static Archive *archiveroot = 0; /* Output file structures */
 static Filelink *filelist = 0; /* List of input files */
 static Filelink *filelisttail = 0; /* Tail of list of input files */
 static Selections *selections = 0; /* List of data selections */
+static SelectIndex *selectindex = 0; /* Index of data selections for matching */
 
 static char *writtenfile = 0; /* File to write summary of output records */
 static char *writtenprefix = 0; /* Prefix for summary of output records */
@@ -93,6 +253,13 @@ static MSTraceList *writtentl = 0; /* TraceList of output records */
 
 static uint64_t totalrecsout = 0;
 static uint64_t totalbytesout = 0;
+static uint64_t outputerrors = 0; /* Output records that could not be buffered, queued or written */
+static uint64_t matchcachehits = 0; /* Source name match outcomes found in cache */
+static uint64_t matchcachemisses = 0; /* Source name match outcomes determined */
+static uint64_t totalrecsin = 0; /* Records read from input files */
+static uint64_t totalrecsskipped = 0; /* Records skipped before unpacking */
+static uint64_t bufferallocs = 0; /* Allocations for reused record buffers */
+static pthread_mutex_t statslock = PTHREAD_MUTEX_INITIALIZER; /* Lock for updating match cache and read counts */
 
 static FILE *ofp = 0;
 
@@ -105,6 +272,7 @@ main (int argc, char **argv)
   char *ab = "ab";
   char *mode;
   char *leapsecondfile = NULL;
+  int retval = 0;
 
   /* Set default error message prefix */
   ms_loginit (NULL, NULL, NULL, "ERROR: ");
@@ -113,6 +281,10 @@ main (int argc, char **argv)
   if (processparam (argc, argv) < 0)
     return 1;
 
+  /* Only Blockettes 100, 1000 and 1001 are needed to select records,
+   * other blockettes are unpacked when records are printed or repacked */
+  MS_UNPACKLAZYBLOCKETTES (1);
+
   /* Read leap second list file if env. var. LIBMSEED_LEAPSECOND_FILE is set */
   if ((leapsecondfile = getenv ("LIBMSEED_LEAPSECOND_FILE")))
   {
@@ -154,23 +326,56 @@ main (int argc, char **argv)
               outputfile, strerror (errno));
       return 1;
     }
+
+    /* Use the archive write buffer size for the output file */
+    if (ds_bufsize > 0)
+      setvbuf (ofp, NULL, _IOFBF, ds_bufsize);
   }
 
-  /* Process each input file in the order they were specified */
-  flp = filelist;
+  /* Write output records in a writer thread, overlapping output with reading */
+  if ((ofp || archiveroot) && queueslots > 0)
+  {
+    if (startwriter (queueslots))
+      return 1;
+  }
 
-  while (flp != 0)
+  /* Process input files in parallel, output is written in input order */
+  if (workers > 1)
   {
-    if (readfile (flp))
+    if (processparallel (workers))
+    {
+      stopwriter ();
       return 1;
+    }
+  }
+  /* Process each input file in the order they were specified */
+  else
+  {
+    flp = filelist;
+
+    while (flp != 0)
+    {
+      if (readfile (flp, NULL))
+      {
+        stopwriter ();
+        return 1;
+      }
 
-    flp = flp->next;
+      flp = flp->next;
+    }
   }
 
+  /* Write remaining queued records */
+  stopwriter ();
+
   /* Close output files */
   if (ofp)
   {
-    fclose (ofp);
+    if (fclose (ofp))
+    {
+      ms_log (2, "Cannot write to '%s' (%s)\n", outputfile, strerror (errno));
+      retval = 1;
+    }
     ofp = 0;
   }
 
@@ -184,10 +389,24 @@ main (int argc, char **argv)
     }
   }
 
+  if (outputerrors)
+  {
+    ms_log (2, "%" PRIu64 " output records could not be written\n", outputerrors);
+    retval = 1;
+  }
+
   if (verbose)
   {
     ms_log (1, "Wrote %" PRIu64 " bytes of %" PRIu64 " records to output file(s)\n",
             totalbytesout, totalrecsout);
+
+    if (match || reject || selections)
+      ms_log (1, "Match cache: %" PRIu64 " hits, %" PRIu64 " misses\n",
+              matchcachehits, matchcachemisses);
+
+    ms_log (1, "Read %" PRIu64 " records, %" PRIu64 " skipped before unpacking, with %" PRIu64
+               " record buffer allocations\n",
+            totalrecsin, totalrecsskipped, bufferallocs);
   }
 
   if (writtenfile)
@@ -196,7 +415,7 @@ main (int argc, char **argv)
     mstl_free (&writtentl, 1);
   }
 
-  return 0;
+  return retval;
 } /* End of main() */
 
 /***************************************************************************
@@ -204,17 +423,27 @@ main (int argc, char **argv)
  *
  * Read input file and output records that match selection criteria.
  *
+ * If a work unit is specified output records are buffered in the unit
+ * for later writing, otherwise they are written directly.
+ *
  * Returns 0 on success and -1 otherwise.
  ***************************************************************************/
 static int
-readfile (Filelink *flp)
+readfile (Filelink *flp, WorkUnit *unit)
 {
   MSFileParam *msfp = NULL;
   MSRecord *msr = NULL;
+  OutputTarget target;
   off_t fpos = 0;
 
-  Selections *matchsp = 0;
   SelectTime *matchstp = 0;
+  MatchCache cache = {NULL, 0, 0, 0, 0};
+  RecordFilter filter;
+  MatchEntry *matchentry = NULL;
+  MSPackContext *packctx = NULL;
+  uint64_t recsin = 0;
+  uint64_t allocs = 0;
+  int matchidx = 0;
 
   hptime_t recstarttime = HPTERROR;
   hptime_t recendtime = HPTERROR;
@@ -225,10 +454,14 @@ readfile (Filelink *flp)
   hptime_t selecttime = HPTERROR;
 
   char srcname[100] = {0};
-  char timestr[32] = {0};
   int retcode;
+  int retval = 0;
   int rv;
 
+  /* Select input reader, memory mapped or buffered */
+  int (*readmsr) (MSFileParam **, MSRecord **, const char *, int, off_t *, int *,
+                  flag, flag, Selections *, flag) = (usemmap) ? ms_readmsr_mmap : ms_readmsr_main;
+
   if (!flp)
     return -1;
 
@@ -244,8 +477,20 @@ readfile (Filelink *flp)
   /* Instruct libmseed to start at specified offset by setting a negative file position */
   fpos = -flp->startoffset; /* Unset value is a 0, making this a non-operation */
 
+  /* Test raw record headers against the selection criteria before unpacking */
+  memset (&filter, 0, sizeof (filter));
+  filter.flp = flp;
+  filter.cache = &cache;
+  filter.selectedoffset = -1;
+
+  if (starttime != HPTERROR || endtime != HPTERROR || match || reject || selections || skipzerosamps)
+  {
+    if (ms_readmsr_setfilter (&msfp, filterrecord, &filter))
+      return -1;
+  }
+
   /* Loop over the input file */
-  while ((retcode = ms_readmsr_main (&msfp, &msr, flp->filename, reclen, &fpos, NULL, 1, 0, selections, verbose - 2)) == MS_NOERROR)
+  while ((retcode = readmsr (&msfp, &msr, flp->filename, reclen, &fpos, NULL, 1, 0, selections, verbose - 2)) == MS_NOERROR)
   {
     /* Break out as EOF if we have read past end offset */
     if (flp->endoffset > 0 && fpos >= flp->endoffset)
@@ -254,94 +499,45 @@ readfile (Filelink *flp)
       break;
     }
 
+    recsin++;
+
     recstarttime = msr->starttime;
     recendtime = msr_endtime (msr);
 
     /* Generate the srcname with the quality code */
     msr_srcname (msr, srcname, 1);
 
-    /* Check if record should be skipped due to zero samples */
-    if (skipzerosamps && msr->samplecnt == 0)
+    /* Use the selection determined by the record filter, otherwise test the record */
+    if (filter.selectedoffset == fpos)
     {
-      if (verbose >= 3)
-      {
-        ms_hptime2seedtimestr (recstarttime, timestr, 1);
-        ms_log (1, "Skipping (zero samples) %s, %s\n", srcname, timestr);
-      }
-      continue;
+      matchentry = filter.matchentry;
+      matchidx = filter.matchidx;
+      matchstp = filter.matchstp;
     }
-
-    /* Check if record matches start time criteria: starts after or contains starttime */
-    if ((starttime != HPTERROR) && (recstarttime < starttime && !(recstarttime <= starttime && recendtime >= starttime)))
+    else if ((rv = selectrecord (&cache, srcname, recstarttime, recendtime, msr->samplecnt,
+                                 &matchentry, &matchidx, &matchstp)) <= 0)
     {
-      if (verbose >= 3)
+      if (rv < 0)
       {
-        ms_hptime2seedtimestr (recstarttime, timestr, 1);
-        ms_log (1, "Skipping (starttime) %s, %s\n", srcname, timestr);
+        ms_log (2, "Cannot determine match for %s\n", srcname);
+        retcode = MS_GENERROR;
+        break;
       }
-      continue;
-    }
 
-    /* Check if record matches end time criteria: ends after or contains endtime */
-    if ((endtime != HPTERROR) && (recendtime > endtime && !(recstarttime <= endtime && recendtime >= endtime)))
-    {
-      if (verbose >= 3)
-      {
-        ms_hptime2seedtimestr (recstarttime, timestr, 1);
-        ms_log (1, "Skipping (endtime) %s, %s\n", srcname, timestr);
-      }
       continue;
     }
 
-    /* Check if record is matched by the match regex */
-    if (match)
-    {
-      if (regexec (match, srcname, 0, 0, 0) != 0)
-      {
-        if (verbose >= 3)
-        {
-          ms_hptime2seedtimestr (recstarttime, timestr, 1);
-          ms_log (1, "Skipping (match) %s, %s\n", srcname, timestr);
-        }
-        continue;
-      }
-    }
-
-    /* Check if record is rejected by the reject regex */
-    if (reject)
-    {
-      if (regexec (reject, srcname, 0, 0, 0) == 0)
-      {
-        if (verbose >= 3)
-        {
-          ms_hptime2seedtimestr (recstarttime, timestr, 1);
-          ms_log (1, "Skipping (reject) %s, %s\n", srcname, timestr);
-        }
-        continue;
-      }
-    }
-
-    /* Check if record is matched by selection */
-    if (selections)
-    {
-      if (!(matchsp = ms_matchselect (selections, srcname, recstarttime, recendtime, &matchstp)))
-      {
-        if (verbose >= 3)
-        {
-          ms_hptime2seedtimestr (recstarttime, timestr, 1);
-          ms_log (1, "Skipping (selection) %s, %s\n", srcname, timestr);
-        }
-        continue;
-      }
-    }
-
     if (verbose > 2)
       msr_print (msr, verbose - 3);
 
     /* If record is not completely selected search for joint selection limits */
+    selectstart = HPTERROR;
+    selectend = HPTERROR;
+
     if (matchstp && !(matchstp->starttime <= recstarttime && matchstp->endtime >= recendtime))
     {
-      if (findselectlimits (matchsp, srcname, recstarttime, recendtime, &selectstart, &selectend))
+      if (findselectlimits (matchentry->matches + matchidx, matchentry->matchcount - matchidx, srcname,
+                            recstarttime, recendtime, &selectstart, &selectend))
       {
         ms_log (2, "Problem in findselectlimits(), please report\n");
       }
@@ -386,7 +582,14 @@ readfile (Filelink *flp)
      * send to the record writer) or we send it directly to the record writer. */
     if (newstart != HPTERROR || newend != HPTERROR)
     {
-      rv = trimrecord (msr, recendtime, newstart, newend, flp, (int64_t)fpos);
+      /* Buffers for unpacking and repacking are reused for all trimmed records */
+      if (!packctx && !(packctx = ms_initpackcontext ()))
+      {
+        retval = -1;
+        break;
+      }
+
+      rv = trimrecord (msr, recendtime, newstart, newend, flp, (int64_t)fpos, unit, packctx);
 
       if (rv == -1)
       {
@@ -401,7 +604,9 @@ readfile (Filelink *flp)
     }
     else
     {
-      writerecord (msr->record, msr->reclen, msr);
+      target.msr = msr;
+      target.unit = unit;
+      outputrecord (msr->record, msr->reclen, &target);
     }
 
     /* Break out as EOF if record is at or beyond end offset */
@@ -416,16 +621,178 @@ readfile (Filelink *flp)
   if (retcode != MS_ENDOFFILE)
   {
     ms_log (2, "Cannot read %s: %s\n", flp->filename, ms_errorstr (retcode));
-    ms_readmsr_main (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, NULL, 0);
-    return -1;
+    retval = -1;
   }
 
+  /* Records skipped by the record filter were read but never unpacked */
+  recsin += filter.skipped;
+
+  /* Count allocations for header and trimming buffers before cleanup */
+  if (msfp && msfp->packctx)
+    allocs += msfp->packctx->allocations;
+  if (packctx)
+    allocs += packctx->allocations;
+
   /* Make sure everything is cleaned up */
-  ms_readmsr_main (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, NULL, 0);
+  readmsr (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, NULL, 0);
 
-  return 0;
+  pthread_mutex_lock (&statslock);
+  matchcachehits += cache.hits;
+  matchcachemisses += cache.misses;
+  totalrecsin += recsin;
+  totalrecsskipped += filter.skipped;
+  bufferallocs += allocs;
+  pthread_mutex_unlock (&statslock);
+
+  freematchcache (&cache);
+  ms_freepackcontext (&packctx);
+
+  return retval;
 } /* End of readfile() */
 
+/***************************************************************************
+ * selectrecord():
+ *
+ * Test a record, described by its source name, start and end times
+ * and sample count, against the zero sample, start time, end time,
+ * match, reject and selection criteria.  Source name outcomes are
+ * cached in cache.  For selected records the matching selection
+ * entry, index of the first selection with a matching time window
+ * and that time window are returned at matchentry, matchidx and
+ * matchstp, matchstp is NULL if no selections are used.
+ *
+ * Returns 1 if the record is selected, 0 if it should be skipped and
+ * -1 on error.
+ ***************************************************************************/
+static int
+selectrecord (MatchCache *cache, char *srcname, hptime_t recstarttime,
+              hptime_t recendtime, int64_t samplecnt, MatchEntry **matchentry,
+              int *matchidx, SelectTime **matchstp)
+{
+  char timestr[32] = {0};
+
+  *matchstp = NULL;
+
+  /* Check if record should be skipped due to zero samples */
+  if (skipzerosamps && samplecnt == 0)
+  {
+    if (verbose >= 3)
+    {
+      ms_hptime2seedtimestr (recstarttime, timestr, 1);
+      ms_log (1, "Skipping (zero samples) %s, %s\n", srcname, timestr);
+    }
+    return 0;
+  }
+
+  /* Check if record matches start time criteria: starts after or contains starttime */
+  if ((starttime != HPTERROR) && (recstarttime < starttime && !(recstarttime <= starttime && recendtime >= starttime)))
+  {
+    if (verbose >= 3)
+    {
+      ms_hptime2seedtimestr (recstarttime, timestr, 1);
+      ms_log (1, "Skipping (starttime) %s, %s\n", srcname, timestr);
+    }
+    return 0;
+  }
+
+  /* Check if record matches end time criteria: ends after or contains endtime */
+  if ((endtime != HPTERROR) && (recendtime > endtime && !(recstarttime <= endtime && recendtime >= endtime)))
+  {
+    if (verbose >= 3)
+    {
+      ms_hptime2seedtimestr (recstarttime, timestr, 1);
+      ms_log (1, "Skipping (endtime) %s, %s\n", srcname, timestr);
+    }
+    return 0;
+  }
+
+  /* Check if record is matched by the match and reject regexes and by
+   * selection source names, the outcome is cached for each source name */
+  if (match || reject || selections)
+  {
+    if (!(*matchentry = matchsrcname (cache, srcname)))
+      return -1;
+
+    if ((*matchentry)->skip)
+    {
+      if (verbose >= 3)
+      {
+        ms_hptime2seedtimestr (recstarttime, timestr, 1);
+        ms_log (1, "Skipping (%s) %s, %s\n",
+                ((*matchentry)->skip == 1) ? "match" : ((*matchentry)->skip == 2) ? "reject" : "selection",
+                srcname, timestr);
+      }
+      return 0;
+    }
+  }
+
+  /* Check if record is matched by selection time windows */
+  if (selections)
+  {
+    for (*matchidx = 0; *matchidx < (*matchentry)->matchcount; (*matchidx)++)
+    {
+      if ((*matchstp = ms_matchselecttime ((*matchentry)->matches[*matchidx], recstarttime, recendtime)))
+        break;
+    }
+
+    if (!*matchstp)
+    {
+      if (verbose >= 3)
+      {
+        ms_hptime2seedtimestr (recstarttime, timestr, 1);
+        ms_log (1, "Skipping (selection) %s, %s\n", srcname, timestr);
+      }
+      return 0;
+    }
+  }
+
+  return 1;
+} /* End of selectrecord() */
+
+/***************************************************************************
+ * filterrecord():
+ *
+ * Test a raw record against the selection criteria before it is
+ * unpacked, called by the libmseed record readers.  The values needed
+ * are determined from the raw header with ms_recheaderinfo().  The
+ * selection outcome of a selected record is stored in the RecordFilter
+ * for use by readfile().
+ *
+ * Returns 0 if the record should be skipped, otherwise 1.
+ ***************************************************************************/
+static int
+filterrecord (char *record, int recordlen, off_t offset, void *filterdata)
+{
+  RecordFilter *filter = (RecordFilter *)filterdata;
+  hptime_t recstarttime;
+  hptime_t recendtime;
+  int64_t samplecnt;
+  char srcname[100];
+  int rv;
+
+  /* Records beyond the end offset of a file chunk end reading */
+  if (filter->flp->endoffset > 0 && offset >= (off_t)filter->flp->endoffset)
+    return 1;
+
+  /* Leave records that cannot be tested to the full unpacking */
+  if (ms_recheaderinfo (record, recordlen, srcname, &recstarttime,
+                        &recendtime, &samplecnt) != MS_NOERROR)
+    return 1;
+
+  if ((rv = selectrecord (filter->cache, srcname, recstarttime, recendtime, samplecnt,
+                          &filter->matchentry, &filter->matchidx, &filter->matchstp)) == 0)
+  {
+    filter->skipped++;
+    return 0;
+  }
+
+  /* Store selection for readfile(), errors are reported there */
+  if (rv > 0)
+    filter->selectedoffset = offset;
+
+  return 1;
+} /* End of filterrecord() */
+
 /***************************************************************************
  * trimrecord():
  *
@@ -435,21 +802,29 @@ readfile (Filelink *flp)
  * as explicit new start/end times, this routine calculates which
  * samples fit within the new boundaries.
  *
+ * Output records are sent to outputrecord() for the specified work unit.
+ * Records are unpacked and packed using the buffers of packctx, the
+ * unpacked record is owned by the context.
+ *
  * Return 0 on success, -1 on failure or skip and -2 on unpacking errors.
  ***************************************************************************/
 static int
 trimrecord (MSRecord *msr, hptime_t recendtime,
             hptime_t newstart, hptime_t newend,
-            Filelink *flp, int64_t fpos)
+            Filelink *flp, int64_t fpos, WorkUnit *unit,
+            MSPackContext *packctx)
 {
   MSRecord *datamsr = NULL;
+  OutputTarget target;
   hptime_t hpdelta;
+  hptime_t newstarttime;
 
   char srcname[100] = {0};
   char stime[32] = {0};
   char etime[32] = {0};
 
-  int trimsamples;
+  int64_t starttrim;
+  int64_t endtrim;
   int samplesize;
   int64_t packedsamples;
   int packedrecords;
@@ -505,23 +880,18 @@ trimrecord (MSRecord *msr, hptime_t recendtime,
     }
 
     /* Write whole record to output */
-    writerecord (msr->record, msr->reclen, msr);
+    target.msr = msr;
+    target.unit = unit;
+    outputrecord (msr->record, msr->reclen, &target);
 
     return 0;
   }
 
-  /* Unpack data record header including data samples */
-  if ((retcode = msr_unpack (msr->record, msr->reclen, &datamsr, 1, verbose - 1)) != MS_NOERROR)
-  {
-    ms_log (2, "Cannot unpack miniSEED record: %s\n", ms_errorstr (retcode));
-    return -2;
-  }
-
   if (verbose > 1)
   {
-    msr_srcname (datamsr, srcname, 0);
-    ms_log (1, "Triming record: %s (%c)\n", srcname, datamsr->dataquality);
-    ms_hptime2seedtimestr (datamsr->starttime, stime, 1);
+    msr_srcname (msr, srcname, 0);
+    ms_log (1, "Triming record: %s (%c)\n", srcname, msr->dataquality);
+    ms_hptime2seedtimestr (msr->starttime, stime, 1);
     ms_hptime2seedtimestr (recendtime, etime, 1);
     ms_log (1, "       Start: %s        End: %s\n", stime, etime);
     if (newstart == HPTERROR)
@@ -536,81 +906,86 @@ trimrecord (MSRecord *msr, hptime_t recendtime,
   }
 
   /* Determine sample period in high precision time ticks */
-  hpdelta = (datamsr->samprate) ? (hptime_t) (HPTMODULUS / datamsr->samprate) : 0;
+  hpdelta = (msr->samprate) ? (hptime_t) (HPTMODULUS / msr->samprate) : 0;
 
-  /* Remove samples from the beginning of the record */
+  starttrim = 0;
+  endtrim = 0;
+  newstarttime = msr->starttime;
+
+  /* Determine the number of samples to trim from the beginning of the record */
   if (newstart != HPTERROR && hpdelta)
   {
-    hptime_t newstarttime;
-
-    /* Determine new start time and the number of samples to trim */
-    trimsamples = 0;
-    newstarttime = datamsr->starttime;
+    starttrim = trimcount (newstart - msr->starttime, hpdelta, msr->samplecnt);
+    newstarttime = msr->starttime + starttrim * hpdelta;
 
-    while (newstarttime < newstart && trimsamples < datamsr->samplecnt)
-    {
-      newstarttime += hpdelta;
-      trimsamples++;
-    }
-
-    if (trimsamples >= datamsr->samplecnt)
+    if (starttrim >= msr->samplecnt)
     {
       if (verbose > 1)
         ms_log (1, "All samples would be trimmed from record, skipping\n");
 
-      msr_free (&datamsr);
       return -1;
     }
 
     if (verbose > 2)
     {
       ms_hptime2seedtimestr (newstarttime, stime, 1);
-      ms_log (1, "Removing %d samples from the start, new start time: %s\n", trimsamples, stime);
+      ms_log (1, "Removing %" PRId64 " samples from the start, new start time: %s\n", starttrim, stime);
     }
-
-    samplesize = ms_samplesize (datamsr->sampletype);
-
-    memmove (datamsr->datasamples,
-             (char *)datamsr->datasamples + (samplesize * trimsamples),
-             samplesize * (datamsr->numsamples - trimsamples));
-
-    datamsr->numsamples -= trimsamples;
-    datamsr->samplecnt -= trimsamples;
-    datamsr->starttime = newstarttime;
   }
 
-  /* Remove samples from the end of the record */
+  /* Determine the number of samples to trim from the end of the record */
   if (newend != HPTERROR && hpdelta)
   {
     hptime_t newendtime;
 
-    /* Determine new end time and the number of samples to trim */
-    trimsamples = 0;
-    newendtime = recendtime;
-
-    while (newendtime > newend && trimsamples < datamsr->samplecnt)
-    {
-      newendtime -= hpdelta;
-      trimsamples++;
-    }
+    endtrim = trimcount (recendtime - newend, hpdelta, msr->samplecnt - starttrim);
+    newendtime = recendtime - endtrim * hpdelta;
 
-    if (trimsamples >= datamsr->samplecnt)
+    if (endtrim >= msr->samplecnt - starttrim)
     {
       if (verbose > 1)
         ms_log (1, "All samples would be trimmed from record, skipping\n");
 
-      msr_free (&datamsr);
       return -1;
     }
 
     if (verbose > 2)
     {
       ms_hptime2seedtimestr (newendtime, etime, 1);
-      ms_log (1, "Removing %d samples from the end, new end time: %s\n", trimsamples, etime);
+      ms_log (1, "Removing %" PRId64 " samples from the end, new end time: %s\n", endtrim, etime);
     }
+  }
+
+  /* Trim the raw record if possible, avoiding decoding of all samples */
+  if ((retcode = trimrawrecord (msr, starttrim, endtrim, newstarttime, unit, packctx)) != -1)
+    return retcode;
+
+  /* Unpack data record header including data samples */
+  if ((retcode = msr_unpack_r (packctx, msr->record, msr->reclen, &datamsr, 1, verbose - 1)) != MS_NOERROR)
+  {
+    ms_log (2, "Cannot unpack miniSEED record: %s\n", ms_errorstr (retcode));
+    return -2;
+  }
+
+  /* Remove samples from the beginning of the record */
+  if (starttrim > 0)
+  {
+    samplesize = ms_samplesize (datamsr->sampletype);
+
+    memmove (datamsr->datasamples,
+             (char *)datamsr->datasamples + (samplesize * starttrim),
+             samplesize * (datamsr->numsamples - starttrim));
+
+    datamsr->numsamples -= starttrim;
+    datamsr->samplecnt -= starttrim;
+    datamsr->starttime = newstarttime;
+  }
 
-    datamsr->numsamples -= trimsamples;
-    datamsr->samplecnt -= trimsamples;
+  /* Remove samples from the end of the record */
+  if (endtrim > 0)
+  {
+    datamsr->numsamples -= endtrim;
+    datamsr->samplecnt -= endtrim;
   }
 
   /* Repacking the record will apply any unapplied time corrections to the start time,
@@ -620,9 +995,11 @@ trimrecord (MSRecord *msr, hptime_t recendtime,
     datamsr->fsdh->act_flags |= (1 << 1);
   }
 
-  /* Pack the data record into the global record buffer used by writetraces() */
-  packedrecords = msr_pack (datamsr, &writerecord, datamsr,
-                            &packedsamples, 1, verbose - 1);
+  /* Pack the data record and send to output */
+  target.msr = datamsr;
+  target.unit = unit;
+  packedrecords = msr_pack_r (packctx, datamsr, &outputrecord, &target,
+                              &packedsamples, 1, verbose - 1);
 
   if (packedrecords != 1)
   {
@@ -636,56 +1013,423 @@ trimrecord (MSRecord *msr, hptime_t recendtime,
     }
   }
 
-  msr_free (&datamsr);
-
   return 0;
 } /* End of trimrecord() */
 
 /***************************************************************************
- * writerecord():
+ * trimrawrecord():
+ *
+ * Trim samples from a raw record without decoding all of the samples.
+ *
+ * For fixed sample size encodings (16 or 32-bit integers, 32 or 64-bit
+ * floats) the remaining sample bytes are shifted to the beginning of
+ * the data section, sample values and byte order are never changed.
+ * For Steim1 and Steim2 encodings only the frames containing the cut
+ * points are decoded and re-encoded, see steim_trim().
  *
- * Used by trimrecord() to save repacked miniSEED to global record
- * buffer.
+ * The start time, sample count and Blockette 1001 microsecond offset
+ * are updated in a copy of the header, built in the record buffer of
+ * packctx.
+ *
+ * Output records are sent to outputrecord() for the specified work unit.
+ *
+ * Return 0 on success, -1 if the record cannot be trimmed in place and
+ * -2 on errors.
  ***************************************************************************/
-static void
-writerecord (char *record, int reclen, void *handlerdata)
+static int
+trimrawrecord (MSRecord *msr, int64_t starttrim, int64_t endtrim,
+               hptime_t newstarttime, WorkUnit *unit, MSPackContext *packctx)
 {
-  MSRecord *msr = handlerdata;
-  Archive *arch;
-  MSTraceSeg *seg;
-  int64_t numsamples;
-  void *datasamples;
+  MSRecord *datamsr = NULL;
+  OutputTarget target;
+  struct fsdh_s *fsdh;
+  struct blkt_link_s *blkt;
+  hptime_t hptimems;
+  int8_t usecoffset;
+  uint16_t numsamples;
+  flag swapflag;
+  char *record;
+  int64_t keepsamples;
+  int samplesize = 0;
+  int dataoffset;
+  int retcode;
 
-  if (!record || reclen <= 0 || !handlerdata)
-    return;
+  if (!msr || !msr->record || !msr->fsdh || !msr->Blkt1000)
+    return -1;
 
-  /* Temporarily remove data samples from MSRecord, restored before returning */
-  datasamples = msr->datasamples;
-  numsamples = msr->numsamples;
-  msr->datasamples = NULL;
-  msr->numsamples = 0;
+  if (msr->encoding == DE_INT16)
+    samplesize = 2;
+  else if (msr->encoding == DE_INT32 || msr->encoding == DE_FLOAT32)
+    samplesize = 4;
+  else if (msr->encoding == DE_FLOAT64)
+    samplesize = 8;
+  else if (msr->encoding != DE_STEIM1 && msr->encoding != DE_STEIM2)
+    return -1;
 
-  /* Write to a single output file */
-  if (ofp)
+  keepsamples = msr->samplecnt - starttrim - endtrim;
+  dataoffset = msr->fsdh->data_offset;
+
+  /* Let the full unpack path report records with inconsistent data sections */
+  if (keepsamples <= 0 || dataoffset < 48 || dataoffset >= msr->reclen ||
+      (dataoffset + msr->samplecnt * samplesize) > msr->reclen)
+    return -1;
+
+  if (!(record = ms_packcontextbuffer (packctx, msr->reclen)))
   {
-    if (fwrite (record, reclen, 1, ofp) != 1)
-    {
-      ms_log (2, "Cannot write to '%s'\n", outputfile);
-    }
+    ms_log (2, "Cannot allocate memory for trimmed record\n");
+    return -2;
   }
 
-  /* Write to Archive(s) if specified and/or add to written list */
-  if (archiveroot)
+  memcpy (record, msr->record, dataoffset);
+  fsdh = (struct fsdh_s *)record;
+
+  /* The raw header is swapped if its year differs from the parsed header */
+  swapflag = (fsdh->start_time.year != msr->fsdh->start_time.year) ? 1 : 0;
+
+  if (samplesize)
   {
-    arch = archiveroot;
-    while (arch)
-    {
-      ds_streamproc (&arch->datastream, msr, 0, verbose - 1);
-      arch = arch->next;
-    }
+    /* Copy remaining samples to the start of the data section, clear the rest */
+    memcpy (record + dataoffset,
+            msr->record + dataoffset + (starttrim * samplesize),
+            keepsamples * samplesize);
+    memset (record + dataoffset + (keepsamples * samplesize), 0,
+            msr->reclen - dataoffset - (keepsamples * samplesize));
   }
-
-  if (writtenfile)
+  else if (steim_trim (record + dataoffset, msr->record + dataoffset,
+                       msr->reclen - dataoffset, msr->encoding, msr->byteorder,
+                       (int)msr->samplecnt, (int)starttrim, (int)endtrim) < 0)
+  {
+    return -1;
+  }
+
+  /* Update start time, rounded to tenths of milliseconds, and sample count */
+  ms_hptime2tomsusecoffset (newstarttime, &hptimems, &usecoffset);
+  ms_hptime2btime (hptimems, &fsdh->start_time);
+
+  numsamples = (uint16_t)keepsamples;
+  memcpy (&fsdh->numsamples, &numsamples, sizeof (uint16_t));
+
+  if (swapflag)
+  {
+    MS_SWAPBTIME (&fsdh->start_time);
+    ms_gswap2 (&fsdh->numsamples);
+  }
+
+  /* Any unapplied time correction is now included in the start time */
+  if (msr->fsdh->time_correct != 0 && !(msr->fsdh->act_flags & 0x02))
+    fsdh->act_flags |= (1 << 1);
+
+  /* Update microsecond offset in Blockette 1001 */
+  for (blkt = msr->blkts; blkt; blkt = blkt->next)
+  {
+    if (blkt->blkt_type == 1001 &&
+        (blkt->blktoffset + 4 + (int)sizeof (struct blkt_1001_s)) <= msr->reclen)
+      ((struct blkt_1001_s *)(record + blkt->blktoffset + 4))->usec = usecoffset;
+  }
+
+  /* Parse the trimmed header to describe the output record */
+  if ((retcode = msr_unpack_r (packctx, record, msr->reclen, &datamsr, 0, verbose - 1)) != MS_NOERROR)
+  {
+    ms_log (2, "Cannot unpack trimmed miniSEED record: %s\n", ms_errorstr (retcode));
+    return -2;
+  }
+
+  target.msr = datamsr;
+  target.unit = unit;
+  outputrecord (record, msr->reclen, &target);
+
+  return 0;
+} /* End of trimrawrecord() */
+
+/***************************************************************************
+ * trimcount():
+ *
+ * Calculate the number of sample periods of length hpdelta needed to
+ * cover the specified distance, i.e. the number of samples to trim from
+ * a record edge so that the new edge is at or beyond a boundary that is
+ * distance ticks into the record.  The count is limited to maxcount.
+ *
+ * Returns the number of samples to trim.
+ ***************************************************************************/
+static int64_t
+trimcount (hptime_t distance, hptime_t hpdelta, int64_t maxcount)
+{
+  int64_t count;
+
+  if (distance <= 0)
+    return 0;
+
+  if (hpdelta <= 0)
+    return maxcount;
+
+  count = (distance + hpdelta - 1) / hpdelta;
+
+  return (count < maxcount) ? count : maxcount;
+} /* End of trimcount() */
+
+/***************************************************************************
+ * outputrecord():
+ *
+ * Record handler for output records, handlerdata is an OutputTarget.
+ * Records are buffered in the target work unit if set, otherwise
+ * queued for the writer thread with queuerecord().
+ ***************************************************************************/
+static void
+outputrecord (char *record, int reclen, void *handlerdata)
+{
+  OutputTarget *target = handlerdata;
+
+  if (!record || reclen <= 0 || !handlerdata)
+    return;
+
+  if (target->unit)
+  {
+    if (bufferrecord (target->unit, record, reclen, target->msr))
+    {
+      ms_log (2, "Cannot buffer output record for %s\n", target->unit->flp->filename);
+      __atomic_add_fetch (&outputerrors, 1, __ATOMIC_RELAXED);
+    }
+  }
+  else
+  {
+    queuerecord (record, reclen, target->msr);
+  }
+} /* End of outputrecord() */
+
+/***************************************************************************
+ * bufferrecord():
+ *
+ * Add a copy of a record and it's details to the output buffer of a
+ * work unit.  The record is written later by the writer using
+ * writerecord().
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+bufferrecord (WorkUnit *unit, char *record, int reclen, MSRecord *msr)
+{
+  OutputRecord *outrec;
+  size_t newsize;
+  void *ptr;
+
+  if (!unit || !record || reclen <= 0 || !msr)
+    return -1;
+
+  /* Grow record buffer as needed */
+  if ((unit->bufferlength + reclen) > unit->buffersize)
+  {
+    newsize = (unit->buffersize) ? unit->buffersize * 2 : 262144;
+
+    while ((unit->bufferlength + reclen) > newsize)
+      newsize *= 2;
+
+    if ((ptr = realloc (unit->buffer, newsize)) == NULL)
+      return -1;
+
+    unit->buffer = ptr;
+    unit->buffersize = newsize;
+  }
+
+  /* Grow output record list as needed */
+  if (unit->recordcount >= unit->recordmax)
+  {
+    newsize = (unit->recordmax) ? unit->recordmax * 2 : 512;
+
+    if ((ptr = realloc (unit->records, newsize * sizeof (OutputRecord))) == NULL)
+      return -1;
+
+    unit->records = ptr;
+    unit->recordmax = newsize;
+  }
+
+  outrec = &unit->records[unit->recordcount];
+
+  /* The fsdh pointer is set when writing as the list may be relocated */
+  copyrecord (&outrec->msr, &outrec->fsdh, msr, reclen);
+
+  outrec->offset = unit->bufferlength;
+  memcpy (unit->buffer + unit->bufferlength, record, reclen);
+
+  unit->bufferlength += reclen;
+  unit->recordcount++;
+
+  return 0;
+} /* End of bufferrecord() */
+
+/***************************************************************************
+ * copyrecord():
+ *
+ * Copy the details of a record for writing later, members that are
+ * not retained are cleared.  The fixed section of data header is
+ * copied to fsdh, a non-NULL fsdh pointer in the copy indicates the
+ * header copy is valid and must be pointed to fsdh before writing.
+ ***************************************************************************/
+static void
+copyrecord (MSRecord *copy, struct fsdh_s *fsdh, MSRecord *msr, int reclen)
+{
+  *copy = *msr;
+  copy->record = NULL;
+  copy->reclen = reclen;
+  copy->fsdh = NULL;
+  copy->blkts = NULL;
+  copy->Blkt100 = NULL;
+  copy->Blkt1000 = NULL;
+  copy->Blkt1001 = NULL;
+  copy->blktsdeferred = 0;
+  copy->datasamples = NULL;
+  copy->numsamples = 0;
+  copy->ststate = NULL;
+
+  if (msr->fsdh)
+  {
+    *fsdh = *msr->fsdh;
+    copy->fsdh = msr->fsdh;
+  }
+} /* End of copyrecord() */
+
+/***************************************************************************
+ * queuerecord():
+ *
+ * Queue a copy of a record and it's details for the writer thread,
+ * waiting for a free slot when the queue is full.  Records are written
+ * in the order they are queued.  If the writer thread is not running
+ * the record is written directly with writerecord().
+ *
+ * Only a single thread may queue records.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+queuerecord (char *record, int reclen, MSRecord *msr)
+{
+  OutputQueue *queue = outqueue;
+  OutputSlot *slot;
+  unsigned int tail;
+  void *ptr;
+
+  if (!record || reclen <= 0 || !msr)
+    return -1;
+
+  if (!queue)
+  {
+    if (writerecord (record, reclen, msr))
+    {
+      __atomic_add_fetch (&outputerrors, 1, __ATOMIC_RELAXED);
+      return -1;
+    }
+
+    return 0;
+  }
+
+  tail = queue->tail;
+
+  /* Wait for the writer thread to free a batch of slots */
+  if ((tail - __atomic_load_n (&queue->head, __ATOMIC_ACQUIRE)) >= queue->size)
+  {
+    pthread_mutex_lock (&queue->lock);
+    __atomic_store_n (&queue->producerwaiting, 1, __ATOMIC_SEQ_CST);
+
+    while ((tail - __atomic_load_n (&queue->head, __ATOMIC_SEQ_CST)) > (queue->size - queue->batch))
+      pthread_cond_wait (&queue->cond, &queue->lock);
+
+    __atomic_store_n (&queue->producerwaiting, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock (&queue->lock);
+  }
+
+  slot = &queue->slots[tail & (queue->size - 1)];
+
+  /* Grow slot record buffer as needed, buffers are retained for reuse */
+  if (reclen > slot->recordsize)
+  {
+    if ((ptr = realloc (slot->record, reclen)) == NULL)
+    {
+      ms_log (2, "Cannot allocate memory for queued output record\n");
+      __atomic_add_fetch (&outputerrors, 1, __ATOMIC_RELAXED);
+      return -1;
+    }
+
+    slot->record = ptr;
+    slot->recordsize = reclen;
+  }
+
+  memcpy (slot->record, record, reclen);
+  copyrecord (&slot->msr, &slot->fsdh, msr, reclen);
+
+  /* Publish the slot and wake the writer thread if it is waiting for
+   * a batch that is now filled */
+  __atomic_store_n (&queue->tail, ++tail, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n (&queue->writerwaiting, __ATOMIC_SEQ_CST) &&
+      (tail - __atomic_load_n (&queue->head, __ATOMIC_ACQUIRE)) >= queue->batch)
+  {
+    pthread_mutex_lock (&queue->lock);
+    pthread_cond_signal (&queue->cond);
+    pthread_mutex_unlock (&queue->lock);
+  }
+
+  return 0;
+} /* End of queuerecord() */
+
+/***************************************************************************
+ * writerecord():
+ *
+ * Write a record to the output file and/or archive(s) and add it to
+ * the written list.  The MSRecord provides the details of the record
+ * being written.
+ *
+ * Returns 0 on success and -1 if the record could not be written to
+ * all outputs.
+ ***************************************************************************/
+static int
+writerecord (char *record, int reclen, MSRecord *msr)
+{
+  Archive *arch;
+  MSTraceSeg *seg;
+  int64_t numsamples;
+  void *datasamples;
+  char *msrrecord;
+  int msrreclen;
+  int retval = 0;
+
+  if (!record || reclen <= 0 || !msr)
+    return -1;
+
+  /* Temporarily remove data samples from MSRecord, restored before returning */
+  datasamples = msr->datasamples;
+  numsamples = msr->numsamples;
+  msr->datasamples = NULL;
+  msr->numsamples = 0;
+
+  /* Temporarily set record to the one being written, a repacked record
+   * differs from the record the MSRecord was unpacked from */
+  msrrecord = msr->record;
+  msrreclen = msr->reclen;
+  msr->record = record;
+  msr->reclen = reclen;
+
+  /* Write to a single output file */
+  if (ofp)
+  {
+    if (fwrite (record, reclen, 1, ofp) != 1)
+    {
+      ms_log (2, "Cannot write to '%s'\n", outputfile);
+      retval = -1;
+    }
+  }
+
+  /* Write to Archive(s) if specified and/or add to written list */
+  if (archiveroot)
+  {
+    arch = archiveroot;
+    while (arch)
+    {
+      if (ds_streamproc (&arch->datastream, msr, 0, verbose - 1))
+        retval = -1;
+      arch = arch->next;
+    }
+  }
+
+  if (writtenfile)
   {
     if ((seg = mstl_addmsr (writtentl, msr, 1, 1, -1.0, -1.0)) == NULL)
     {
@@ -709,39 +1453,767 @@ writerecord (char *record, int reclen, void *handlerdata)
     }
   }
 
-  /* Restore data samples and count */
-  msr->datasamples = datasamples;
-  msr->numsamples = numsamples;
-
-  totalrecsout++;
-  totalbytesout += reclen;
-} /* End of writerecord() */
+  /* Restore data samples, count and record */
+  msr->datasamples = datasamples;
+  msr->numsamples = numsamples;
+  msr->record = msrrecord;
+  msr->reclen = msrreclen;
+
+  totalrecsout++;
+  totalbytesout += reclen;
+
+  return retval;
+} /* End of writerecord() */
+
+/***************************************************************************
+ * startwriter():
+ *
+ * Start the writer thread with a queue of the specified number of
+ * slots, rounded up to a power of 2.  Records queued with
+ * queuerecord() are written by the thread until stopwriter() is
+ * called.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+startwriter (int slots)
+{
+  OutputQueue *queue;
+  unsigned int size = 1;
+
+  while (size < (unsigned int)slots)
+    size <<= 1;
+
+  if ((queue = (OutputQueue *)calloc (1, sizeof (OutputQueue))) == NULL ||
+      (queue->slots = (OutputSlot *)calloc (size, sizeof (OutputSlot))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for output queue\n");
+    free (queue);
+    return -1;
+  }
+
+  queue->size = size;
+  queue->batch = (size >= 4) ? size / 4 : 1;
+  pthread_mutex_init (&queue->lock, NULL);
+  pthread_cond_init (&queue->cond, NULL);
+
+  if (pthread_create (&queue->thread, NULL, writerthread, queue))
+  {
+    ms_log (2, "Cannot create writer thread: %s\n", strerror (errno));
+    pthread_mutex_destroy (&queue->lock);
+    pthread_cond_destroy (&queue->cond);
+    free (queue->slots);
+    free (queue);
+    return -1;
+  }
+
+  outqueue = queue;
+
+  return 0;
+} /* End of startwriter() */
+
+/***************************************************************************
+ * stopwriter():
+ *
+ * Stop the writer thread after all queued records are written and
+ * release the queue.  Nothing is done if the writer is not running.
+ ***************************************************************************/
+static void
+stopwriter (void)
+{
+  OutputQueue *queue = outqueue;
+  unsigned int idx;
+
+  if (!queue)
+    return;
+
+  __atomic_store_n (&queue->done, 1, __ATOMIC_SEQ_CST);
+
+  pthread_mutex_lock (&queue->lock);
+  pthread_cond_signal (&queue->cond);
+  pthread_mutex_unlock (&queue->lock);
+
+  pthread_join (queue->thread, NULL);
+
+  for (idx = 0; idx < queue->size; idx++)
+    free (queue->slots[idx].record);
+
+  pthread_mutex_destroy (&queue->lock);
+  pthread_cond_destroy (&queue->cond);
+  free (queue->slots);
+  free (queue);
+
+  outqueue = NULL;
+} /* End of stopwriter() */
+
+/***************************************************************************
+ * writerthread():
+ *
+ * Writer thread routine, write records from the output queue with
+ * writerecord() in queue order until the queue is empty and stopping
+ * is requested.  The output file, archives, written list and output
+ * totals are only used by this thread while it is running.
+ ***************************************************************************/
+static void *
+writerthread (void *arg)
+{
+  OutputQueue *queue = arg;
+  OutputSlot *slot;
+  unsigned int head = queue->head;
+
+  for (;;)
+  {
+    /* When empty wait for a batch of records to be queued or stopping */
+    if (head == __atomic_load_n (&queue->tail, __ATOMIC_ACQUIRE))
+    {
+      pthread_mutex_lock (&queue->lock);
+      __atomic_store_n (&queue->writerwaiting, 1, __ATOMIC_SEQ_CST);
+
+      while ((__atomic_load_n (&queue->tail, __ATOMIC_SEQ_CST) - head) < queue->batch &&
+             !__atomic_load_n (&queue->done, __ATOMIC_SEQ_CST))
+        pthread_cond_wait (&queue->cond, &queue->lock);
+
+      __atomic_store_n (&queue->writerwaiting, 0, __ATOMIC_RELAXED);
+      pthread_mutex_unlock (&queue->lock);
+
+      if (head == __atomic_load_n (&queue->tail, __ATOMIC_ACQUIRE))
+        break;
+    }
+
+    slot = &queue->slots[head & (queue->size - 1)];
+    slot->msr.record = slot->record;
+
+    if (slot->msr.fsdh)
+      slot->msr.fsdh = &slot->fsdh;
+
+    if (writerecord (slot->record, slot->msr.reclen, &slot->msr))
+      __atomic_add_fetch (&outputerrors, 1, __ATOMIC_RELAXED);
+
+    /* Release the slot and wake the producer if it is waiting for a
+     * batch of slots that is now free */
+    __atomic_store_n (&queue->head, ++head, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n (&queue->producerwaiting, __ATOMIC_SEQ_CST) &&
+        (__atomic_load_n (&queue->tail, __ATOMIC_ACQUIRE) - head) <= (queue->size - queue->batch))
+    {
+      pthread_mutex_lock (&queue->lock);
+      pthread_cond_signal (&queue->cond);
+      pthread_mutex_unlock (&queue->lock);
+    }
+  }
+
+  return NULL;
+} /* End of writerthread() */
+
+/***************************************************************************
+ * processparallel():
+ *
+ * Process all input files using the specified number of worker
+ * threads.  Each input file is a work unit processed by readfile(),
+ * output records are buffered in the unit and written by this
+ * (the main) thread in input file order, resulting in the same output
+ * as processing the files serially.
+ *
+ * Input files larger than splitsize are split into multiple units
+ * covering record aligned byte ranges (see splitfile()), the output of
+ * the units is written in range order.
+ *
+ * The number of units processed ahead of the writer is limited to
+ * bound the memory used for buffered records.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+processparallel (int threadcount)
+{
+  WorkQueue queue;
+  WorkUnit *unit;
+  OutputRecord *outrec;
+  Filelink *flp;
+  Filelink *chunklist;
+  pthread_t *threads;
+  void *ptr;
+  int unitmax = 0;
+  int chunks;
+  MSRecord *msr;
+  int32_t primesample = 0;
+  int started = 0;
+  int retval = 0;
+  int idx;
+
+  memset (&queue, 0, sizeof (queue));
+
+  /* Create work units for each input file or chunks of split files */
+  for (flp = filelist; flp; flp = flp->next)
+  {
+    chunklist = NULL;
+    chunks = (splitsize) ? splitfile (flp, splitsize, &chunklist) : 0;
+
+    if (chunks < 0)
+      retval = -1;
+
+    do
+    {
+      if (queue.unitcount >= unitmax)
+      {
+        unitmax = (unitmax) ? unitmax * 2 : 64;
+
+        if ((ptr = realloc (queue.units, unitmax * sizeof (WorkUnit))) == NULL)
+        {
+          ms_log (2, "Cannot allocate memory for work units\n");
+          retval = -1;
+          break;
+        }
+
+        queue.units = ptr;
+      }
+
+      unit = &queue.units[queue.unitcount++];
+      memset (unit, 0, sizeof (WorkUnit));
+
+      if (chunks > 0)
+      {
+        unit->flp = chunklist;
+        unit->chunk = 1;
+        chunklist = chunklist->next;
+      }
+      else
+      {
+        unit->flp = flp;
+      }
+    } while (chunklist);
+
+    if (retval)
+      break;
+  }
+
+  if (retval == 0 && queue.unitcount == 0)
+    return 0;
+
+  if (retval || (threads = (pthread_t *)calloc (threadcount, sizeof (pthread_t))) == NULL)
+  {
+    if (!retval)
+      ms_log (2, "Cannot allocate memory for worker threads\n");
+
+    for (idx = 0; idx < queue.unitcount; idx++)
+      if (queue.units[idx].chunk)
+        free (queue.units[idx].flp);
+    for (; chunklist; chunklist = flp)
+    {
+      flp = chunklist->next;
+      free (chunklist);
+    }
+    free (queue.units);
+    return -1;
+  }
+
+  queue.maxahead = threadcount * 2;
+  pthread_mutex_init (&queue.lock, NULL);
+  pthread_cond_init (&queue.cond, NULL);
+
+  /* Prime libmseed byte order and encoding settings from environment
+   * variables before starting threads, these are otherwise lazily
+   * initialized by the first msr_pack() and msr_unpack() calls. */
+  if ((msr = msr_init (NULL)))
+  {
+    msr->reclen = 512;
+    msr->encoding = DE_INT32;
+    msr->samprate = 1.0;
+    msr->datasamples = &primesample;
+    msr->numsamples = 1;
+    msr->sampletype = 'i';
+
+    msr_pack (msr, &primehandler, NULL, NULL, 1, 0);
+
+    msr->datasamples = NULL;
+    msr_free (&msr);
+  }
+
+  for (started = 0; started < threadcount; started++)
+  {
+    if (pthread_create (&threads[started], NULL, workerthread, &queue))
+    {
+      ms_log (2, "Cannot create worker thread: %s\n", strerror (errno));
+      break;
+    }
+  }
+
+  if (started == 0)
+  {
+    retval = -1;
+    queue.nextwrite = queue.unitcount;
+  }
+  else if (verbose > 1)
+  {
+    ms_log (1, "Processing %d work units with %d worker threads\n",
+            queue.unitcount, started);
+  }
+
+  /* Write output of each unit, in order, as they are completed */
+  for (; queue.nextwrite < queue.unitcount;)
+  {
+    unit = &queue.units[queue.nextwrite];
+
+    pthread_mutex_lock (&queue.lock);
+    while (unit->status != 2)
+      pthread_cond_wait (&queue.cond, &queue.lock);
+    pthread_mutex_unlock (&queue.lock);
+
+    for (idx = 0; idx < unit->recordcount; idx++)
+    {
+      outrec = &unit->records[idx];
+      outrec->msr.record = unit->buffer + outrec->offset;
+
+      if (outrec->msr.fsdh)
+        outrec->msr.fsdh = &outrec->fsdh;
+
+      queuerecord (outrec->msr.record, outrec->msr.reclen, &outrec->msr);
+    }
+
+    free (unit->buffer);
+    free (unit->records);
+    unit->buffer = NULL;
+    unit->records = NULL;
+
+    pthread_mutex_lock (&queue.lock);
+    queue.nextwrite++;
+    if (unit->retval)
+    {
+      queue.stop = 1;
+      retval = -1;
+    }
+    pthread_cond_broadcast (&queue.cond);
+    pthread_mutex_unlock (&queue.lock);
+
+    if (retval)
+      break;
+  }
+
+  for (idx = 0; idx < started; idx++)
+    pthread_join (threads[idx], NULL);
+
+  /* Release buffers of units not written due to an error and file chunks */
+  for (idx = 0; idx < queue.unitcount; idx++)
+  {
+    free (queue.units[idx].buffer);
+    free (queue.units[idx].records);
+
+    if (queue.units[idx].chunk)
+      free (queue.units[idx].flp);
+  }
+
+  pthread_mutex_destroy (&queue.lock);
+  pthread_cond_destroy (&queue.cond);
+  free (queue.units);
+  free (threads);
+
+  return retval;
+} /* End of processparallel() */
+
+/***************************************************************************
+ * workerthread():
+ *
+ * Worker thread routine, process work units from the queue with
+ * readfile() until none remain or stopping is requested.
+ ***************************************************************************/
+static void *
+workerthread (void *arg)
+{
+  WorkQueue *queue = arg;
+  WorkUnit *unit;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&queue->lock);
+
+    /* Wait while too far ahead of the writer */
+    while (!queue->stop && queue->nextunit < queue->unitcount &&
+           queue->nextunit >= (queue->nextwrite + queue->maxahead))
+      pthread_cond_wait (&queue->cond, &queue->lock);
+
+    if (queue->stop || queue->nextunit >= queue->unitcount)
+    {
+      pthread_mutex_unlock (&queue->lock);
+      break;
+    }
+
+    unit = &queue->units[queue->nextunit++];
+    unit->status = 1;
+
+    pthread_mutex_unlock (&queue->lock);
+
+    unit->retval = readfile (unit->flp, unit);
+
+    pthread_mutex_lock (&queue->lock);
+    unit->status = 2;
+    pthread_cond_broadcast (&queue->cond);
+    pthread_mutex_unlock (&queue->lock);
+  }
+
+  return NULL;
+} /* End of workerthread() */
+
+/***************************************************************************
+ * primehandler():
+ *
+ * Record handler used by processparallel() to prime libmseed, unpack
+ * the record header to complete initialization.
+ ***************************************************************************/
+static void
+primehandler (char *record, int reclen, void *handlerdata)
+{
+  MSRecord *msr = NULL;
+
+  (void)handlerdata;
+
+  if (msr_unpack (record, reclen, &msr, 0, 0) == MS_NOERROR)
+    msr_free (&msr);
+} /* End of primehandler() */
+
+/***************************************************************************
+ * splitfile():
+ *
+ * Split an input file (or its specified byte range) into chunks of
+ * approximately chunksize bytes for parallel processing.  Each chunk
+ * boundary is snapped forward to the start of a data record, as
+ * identified by findrecordstart(), so that reading the chunks in order
+ * results in the same records as reading the original range.
+ *
+ * The chunks are returned as a linked list of newly allocated
+ * Filelink entries, sharing the file name of the original entry.
+ *
+ * Returns number of chunks on success, 0 when the file is not split
+ * and -1 on error.
+ ***************************************************************************/
+static int
+splitfile (Filelink *flp, uint64_t chunksize, Filelink **chunklist)
+{
+  struct stat sbuf;
+  FILE *fp;
+  Filelink *chunk;
+  Filelink *tail = NULL;
+  uint64_t rangestart;
+  uint64_t rangeend;
+  uint64_t chunkstart;
+  uint64_t target;
+  int64_t boundary;
+  int chunks = 0;
+
+  if (!flp || !chunklist || chunksize == 0)
+    return -1;
+
+  *chunklist = NULL;
+
+  /* Only regular files can be split, errors are reported when reading */
+  if (strcmp (flp->filename, "-") == 0 ||
+      stat (flp->filename, &sbuf) || !S_ISREG (sbuf.st_mode))
+    return 0;
+
+  rangestart = flp->startoffset;
+  rangeend = (flp->endoffset > 0 && flp->endoffset < (uint64_t)sbuf.st_size) ? flp->endoffset : (uint64_t)sbuf.st_size;
+
+  if (rangeend <= rangestart || (rangeend - rangestart) <= chunksize)
+    return 0;
+
+  if ((fp = fopen (flp->filename, "rb")) == NULL)
+    return 0;
+
+  chunkstart = rangestart;
+
+  while ((rangeend - chunkstart) > chunksize)
+  {
+    /* Search for a record start between the target and the following target */
+    target = chunkstart + chunksize;
+
+    if ((boundary = findrecordstart (fp, rangestart, target, target + chunksize, rangeend)) <= 0)
+      break;
+
+    if ((chunk = (Filelink *)calloc (1, sizeof (Filelink))) == NULL)
+    {
+      ms_log (2, "splitfile(): Cannot allocate memory\n");
+      chunks = -1;
+      break;
+    }
+
+    chunk->filename = flp->filename;
+    chunk->startoffset = chunkstart;
+    chunk->endoffset = (uint64_t)boundary;
+
+    if (tail)
+      tail->next = chunk;
+    else
+      *chunklist = chunk;
+    tail = chunk;
+    chunks++;
+
+    chunkstart = (uint64_t)boundary;
+  }
+
+  fclose (fp);
+
+  /* Add final chunk covering remainder of range */
+  if (chunks > 0)
+  {
+    if ((chunk = (Filelink *)calloc (1, sizeof (Filelink))) == NULL)
+    {
+      ms_log (2, "splitfile(): Cannot allocate memory\n");
+      chunks = -1;
+    }
+    else
+    {
+      chunk->filename = flp->filename;
+      chunk->startoffset = chunkstart;
+      chunk->endoffset = flp->endoffset;
+
+      tail->next = chunk;
+      chunks++;
+    }
+  }
+
+  if (chunks < 0)
+  {
+    while (*chunklist)
+    {
+      chunk = (*chunklist)->next;
+      free (*chunklist);
+      *chunklist = chunk;
+    }
+  }
+  else if (chunks > 0 && verbose > 1)
+  {
+    ms_log (1, "Split %s into %d chunks for parallel processing\n",
+            flp->filename, chunks);
+  }
+
+  return chunks;
+} /* End of splitfile() */
+
+/***************************************************************************
+ * findrecordstart():
+ *
+ * Search an open file for the start of a data record at or after
+ * offset and before limit.  Records are expected at MINRECLEN byte
+ * multiples from the base offset, the same positions visited by the
+ * record reader.  A candidate is accepted when a record is detected
+ * with ms_detect() and the data following the record is either
+ * another detected record or the end of the range, protecting against
+ * data that happens to look like a record header.
+ *
+ * Returns the offset of the record start on success, 0 when no record
+ * start was found and -1 on error.
+ ***************************************************************************/
+static int64_t
+findrecordstart (FILE *fp, uint64_t base, uint64_t offset, uint64_t limit,
+                 uint64_t end)
+{
+  char buffer[4096];
+  uint64_t candidate;
+  int64_t detlen;
+  size_t readlen;
+
+  if (!fp || offset < base)
+    return -1;
+
+  /* Align first candidate to a MINRECLEN multiple from the base */
+  candidate = base + ((offset - base + MINRECLEN - 1) / MINRECLEN) * MINRECLEN;
+
+  if (limit > end)
+    limit = end;
+
+  for (; candidate < limit; candidate += MINRECLEN)
+  {
+    if (lmp_fseeko (fp, (off_t)candidate, SEEK_SET))
+      return -1;
+
+    readlen = fread (buffer, 1, sizeof (buffer), fp);
+
+    if (readlen < 48)
+      break;
+
+    if ((detlen = ms_detect (buffer, (int)readlen)) <= 0)
+      continue;
+
+    /* Accept if the record ends the range */
+    if ((candidate + detlen) >= end)
+      return (int64_t)candidate;
+
+    /* Otherwise require a record to follow */
+    if (lmp_fseeko (fp, (off_t)(candidate + detlen), SEEK_SET))
+      return -1;
+
+    readlen = fread (buffer, 1, sizeof (buffer), fp);
+
+    if (readlen >= 48 && ms_detect (buffer, (int)readlen) >= 0)
+      return (int64_t)candidate;
+  }
+
+  return 0;
+} /* End of findrecordstart() */
+
+/***************************************************************************
+ * matchsrcname():
+ *
+ * Find the match outcome for a source name in the cache, determining
+ * and adding the outcome if not present.  The outcome includes tests
+ * of the match and reject regexes and the selection entries with
+ * matching source names, time windows are not tested.
+ *
+ * Returns pointer to cache entry on success and NULL on error.
+ ***************************************************************************/
+static MatchEntry *
+matchsrcname (MatchCache *cache, char *srcname)
+{
+  MatchEntry *entries;
+  MatchEntry *entry;
+  unsigned int newsize;
+  unsigned int hash;
+  unsigned int idx;
+  unsigned char *cp;
+  int matchesmax = 0;
+
+  /* Grow table when half full, re-inserting entries */
+  if (cache->count * 2 >= cache->size)
+  {
+    newsize = (cache->size) ? cache->size * 2 : 64;
+
+    if (!(entries = (MatchEntry *)calloc (newsize, sizeof (MatchEntry))))
+    {
+      ms_log (2, "Cannot allocate memory\n");
+      return NULL;
+    }
+
+    for (idx = 0; idx < cache->size; idx++)
+    {
+      if (!cache->entries[idx].srcname)
+        continue;
+
+      for (hash = 0, cp = (unsigned char *)cache->entries[idx].srcname; *cp; cp++)
+        hash = hash * 31 + *cp;
+
+      hash &= newsize - 1;
+      while (entries[hash].srcname)
+        hash = (hash + 1) & (newsize - 1);
+
+      entries[hash] = cache->entries[idx];
+    }
+
+    if (cache->entries)
+      free (cache->entries);
+
+    cache->entries = entries;
+    cache->size = newsize;
+  }
+
+  /* Find existing entry or empty slot */
+  for (hash = 0, cp = (unsigned char *)srcname; *cp; cp++)
+    hash = hash * 31 + *cp;
+
+  hash &= cache->size - 1;
+  while (cache->entries[hash].srcname && strcmp (cache->entries[hash].srcname, srcname))
+    hash = (hash + 1) & (cache->size - 1);
+
+  entry = &cache->entries[hash];
+
+  if (entry->srcname)
+  {
+    cache->hits++;
+    return entry;
+  }
+
+  cache->misses++;
+
+  if (match && !matchregexset (match, srcname))
+    entry->skip = 1;
+  else if (reject && matchregexset (reject, srcname))
+    entry->skip = 2;
+  else if (selections)
+  {
+    if ((entry->matchcount = ms_matchselectindex (selectindex, srcname, &entry->matches, &matchesmax)) < 0)
+    {
+      entry->matchcount = 0;
+      return NULL;
+    }
+
+    if (entry->matchcount == 0)
+      entry->skip = 3;
+  }
+
+  if (!(entry->srcname = strdup (srcname)))
+  {
+    ms_log (2, "Cannot allocate memory\n");
+    if (entry->matches)
+      free (entry->matches);
+    memset (entry, 0, sizeof (MatchEntry));
+    return NULL;
+  }
+
+  cache->count++;
+
+  return entry;
+} /* End of matchsrcname() */
+
+/***************************************************************************
+ * freematchcache():
+ *
+ * Free all memory associated with a match cache.
+ ***************************************************************************/
+static void
+freematchcache (MatchCache *cache)
+{
+  unsigned int idx;
+
+  if (!cache || !cache->entries)
+    return;
+
+  for (idx = 0; idx < cache->size; idx++)
+  {
+    if (cache->entries[idx].srcname)
+      free (cache->entries[idx].srcname);
+    if (cache->entries[idx].matches)
+      free (cache->entries[idx].matches);
+  }
+
+  free (cache->entries);
+  cache->entries = NULL;
+  cache->size = 0;
+  cache->count = 0;
+} /* End of freematchcache() */
 
 /***************************************************************************
  * findselectlimits():
  *
  * Determine selection time limits for the given record based on all
- * matching selection entries.
+ * matching selection entries.  The matches are the selection entries
+ * with source names matching the record, in selection list order,
+ * with time windows sorted by ms_sortselecttimes().
  *
  * Return 0 on success and -1 on error.
  ***************************************************************************/
 static int
-findselectlimits (Selections *select, char *srcname, hptime_t starttime,
-                  hptime_t endtime, hptime_t *selectstart, hptime_t *selectend)
+findselectlimits (Selections **matches, int matchcount, char *srcname,
+                  hptime_t starttime, hptime_t endtime,
+                  hptime_t *selectstart, hptime_t *selectend)
 {
   SelectTime *selecttime;
   char timestring[100];
+  int idx;
 
-  if (!select || !srcname || !selectstart || !selectend)
+  if (!matches || !srcname || !selectstart || !selectend)
     return -1;
 
   *selectstart = HPTERROR;
   *selectend = HPTERROR;
 
-  while ((select = ms_matchselect (select, srcname, starttime, endtime, &selecttime)))
+  for (idx = 0; idx < matchcount; idx++)
   {
+    selecttime = ms_matchselecttime (matches[idx], starttime, endtime);
+
     while (selecttime)
     {
+      /* Windows are sorted by start time, later windows do not intersect */
+      if (selecttime->starttime > endtime)
+        break;
+
       /* Continue if selection edge time does not intersect with record coverage */
       if ((starttime < selecttime->starttime && !(starttime <= selecttime->starttime && endtime >= selecttime->starttime)))
       {
@@ -783,8 +2255,6 @@ findselectlimits (Selections *select, char *srcname, hptime_t starttime,
 
       selecttime = selecttime->next;
     }
-
-    select = select->next;
   }
 
   return 0;
@@ -868,6 +2338,10 @@ processparam (int argcount, char **argvec)
   char *matchpattern = 0;
   char *rejectpattern = 0;
   char *tptr;
+  struct timespec loadstart;
+  struct timespec loadend;
+  uint64_t size;
+  int selectcount = 0;
 
   /* Process all command line arguments */
   for (optind = 1; optind < argcount; optind++)
@@ -919,6 +2393,64 @@ processparam (int argcount, char **argvec)
     {
       skipzerosamps = 1;
     }
+    else if (strcmp (argvec[optind], "-mmap") == 0)
+    {
+      usemmap = 1;
+    }
+    else if (strcmp (argvec[optind], "-j") == 0)
+    {
+      workers = strtol (getoptval (argcount, argvec, optind++), &tptr, 10);
+
+      if (*tptr || workers < 0)
+      {
+        ms_log (2, "Invalid number of worker threads: '%s'\n", argvec[optind]);
+        return -1;
+      }
+    }
+    else if (strcmp (argvec[optind], "-jsplit") == 0)
+    {
+      tptr = getoptval (argcount, argvec, optind++);
+
+      if (parsesize (tptr, &splitsize) || (splitsize > 0 && splitsize < MAXRECLEN))
+      {
+        ms_log (2, "Invalid split size: '%s', minimum is %d bytes\n", tptr, MAXRECLEN);
+        return -1;
+      }
+    }
+    else if (strcmp (argvec[optind], "-wbuf") == 0)
+    {
+      tptr = getoptval (argcount, argvec, optind++);
+
+      if (parsesize (tptr, &size))
+      {
+        ms_log (2, "Invalid write buffer size: '%s'\n", tptr);
+        return -1;
+      }
+
+      ds_bufsize = (size_t)size;
+    }
+    else if (strcmp (argvec[optind], "-wbufmax") == 0)
+    {
+      tptr = getoptval (argcount, argvec, optind++);
+
+      if (parsesize (tptr, &size))
+      {
+        ms_log (2, "Invalid write buffer memory limit: '%s'\n", tptr);
+        return -1;
+      }
+
+      ds_bufbudget = (size_t)size;
+    }
+    else if (strcmp (argvec[optind], "-wqueue") == 0)
+    {
+      queueslots = strtol (getoptval (argcount, argvec, optind++), &tptr, 10);
+
+      if (*tptr || queueslots < 0 || queueslots > 1048576)
+      {
+        ms_log (2, "Invalid output queue length: '%s'\n", argvec[optind]);
+        return -1;
+      }
+    }
     else if (strcmp (argvec[optind], "-m") == 0)
     {
       tptr = getoptval (argcount, argvec, optind++);
@@ -1044,79 +2576,79 @@ processparam (int argcount, char **argvec)
   /* Read data selection file */
   if (selectfile)
   {
-    if (ms_readselectionsfile (&selections, selectfile) < 0)
+    clock_gettime (CLOCK_MONOTONIC, &loadstart);
+
+    if ((selectcount = ms_readselectionsfile (&selections, selectfile)) < 0)
     {
       ms_log (2, "Cannot read data selection file\n");
       exit (1);
     }
   }
 
-  /* Expand match pattern from a file if prefixed by '@' */
-  if (matchpattern)
+  /* Sort selection time windows and build index of data selections */
+  if (selections)
   {
-    if (*matchpattern == '@')
+    if (ms_sortselecttimes (selections) || !(selectindex = ms_initselectindex (selections)))
     {
-      tptr = strdup (matchpattern + 1); /* Skip the @ sign */
-      free (matchpattern);
-      matchpattern = 0;
-
-      if (readregexfile (tptr, &matchpattern) <= 0)
-      {
-        ms_log (2, "Cannot read match pattern regex file\n");
-        exit (1);
-      }
-
-      free (tptr);
+      ms_log (2, "Cannot build index of data selections\n");
+      exit (1);
     }
   }
 
-  /* Expand reject pattern from a file if prefixed by '@' */
-  if (rejectpattern)
+  if (selectfile && verbose)
   {
-    if (*rejectpattern == '@')
-    {
-      tptr = strdup (rejectpattern + 1); /* Skip the @ sign */
-      free (rejectpattern);
-      rejectpattern = 0;
+    clock_gettime (CLOCK_MONOTONIC, &loadend);
+    ms_log (1, "Loaded %d selections from %s in %.3f seconds\n", selectcount, selectfile,
+            (loadend.tv_sec - loadstart.tv_sec) + (loadend.tv_nsec - loadstart.tv_nsec) / 1e9);
+  }
 
-      if (readregexfile (tptr, &rejectpattern) <= 0)
+  /* Add match patterns, from a file if prefixed by '@', and compile */
+  if (matchpattern)
+  {
+    if (*matchpattern == '@')
+    {
+      if (readregexfile (matchpattern + 1, &match) <= 0)
       {
-        ms_log (2, "Cannot read reject pattern regex file\n");
+        ms_log (2, "Cannot read match pattern regex file\n");
         exit (1);
       }
-
-      free (tptr);
     }
-  }
-
-  /* Compile match and reject patterns */
-  if (matchpattern)
-  {
-    if (!(match = (regex_t *)malloc (sizeof (regex_t))))
+    else if (addregex (&match, matchpattern))
     {
-      ms_log (2, "Cannot allocate memory for match expression\n");
+      ms_log (2, "Cannot add match regex: '%s'\n", matchpattern);
       exit (1);
     }
 
-    if (regcomp (match, matchpattern, REG_EXTENDED) != 0)
+    if (compileregexset (match))
     {
-      ms_log (2, "Cannot compile match regex: '%s'\n", matchpattern);
+      ms_log (2, "Cannot compile match regex: '%s'\n", match->pattern);
+      exit (1);
     }
 
     free (matchpattern);
   }
 
+  /* Add reject patterns, from a file if prefixed by '@', and compile */
   if (rejectpattern)
   {
-    if (!(reject = (regex_t *)malloc (sizeof (regex_t))))
+    if (*rejectpattern == '@')
+    {
+      if (readregexfile (rejectpattern + 1, &reject) <= 0)
+      {
+        ms_log (2, "Cannot read reject pattern regex file\n");
+        exit (1);
+      }
+    }
+    else if (addregex (&reject, rejectpattern))
     {
-      ms_log (2, "Cannot allocate memory for reject expression\n");
+      ms_log (2, "Cannot add reject regex: '%s'\n", rejectpattern);
       exit (1);
     }
 
-    if (regcomp (reject, rejectpattern, REG_EXTENDED) != 0)
+    if (compileregexset (reject))
     {
-      ms_log (2, "Cannot compile reject regex: '%s'\n", rejectpattern);
+      ms_log (2, "Cannot compile reject regex: '%s'\n", reject->pattern);
+      exit (1);
     }
 
     free (rejectpattern);
@@ -1129,6 +2661,42 @@ processparam (int argcount, char **argvec)
   return 0;
 } /* End of processparam() */
 
+/***************************************************************************
+ * parsesize:
+ * Parse a size in bytes with an optional K, M or G suffix.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+parsesize (const char *value, uint64_t *size)
+{
+  char *tptr;
+
+  *size = strtoull (value, &tptr, 10);
+
+  if (tptr == value)
+    return -1;
+
+  /* Apply optional size suffix */
+  if (*tptr == 'k' || *tptr == 'K')
+  {
+    *size *= 1024;
+    tptr++;
+  }
+  else if (*tptr == 'm' || *tptr == 'M')
+  {
+    *size *= 1048576;
+    tptr++;
+  }
+  else if (*tptr == 'g' || *tptr == 'G')
+  {
+    *size *= 1073741824;
+    tptr++;
+  }
+
+  return (*tptr) ? -1 : 0;
+} /* End of parsesize() */
+
 /***************************************************************************
  * getoptval:
  * Return the value to a command line option; checking that the value is
@@ -1345,7 +2913,8 @@ addlistfile (char *filename)
 /***************************************************************************
  * addarchive:
  * Add entry to the data stream archive chain.  'layout' if defined
- * will be appended to 'path'.
+ * will be appended to 'path'.  The resulting layout is compiled with
+ * ds_compilelayout().
  *
  * Returns 0 on success, and -1 on failure
  ***************************************************************************/
@@ -1387,6 +2956,24 @@ addarchive (const char *path, const char *layout)
 
   newarch->datastream.idletimeout = 60;
   newarch->datastream.grouproot = NULL;
+  newarch->datastream.grouptail = NULL;
+  newarch->datastream.grouptable = NULL;
+  newarch->datastream.grouptablesize = 0;
+  newarch->datastream.groupcount = 0;
+  newarch->datastream.layout = NULL;
+  newarch->datastream.layoutcount = 0;
+  newarch->datastream.dircache = NULL;
+  newarch->datastream.dircachesize = 0;
+  newarch->datastream.dircachecount = 0;
+
+  /* Compile the layout once, file names are expanded from it for each record */
+  if (ds_compilelayout (&newarch->datastream))
+  {
+    ms_log (2, "addarchive(): cannot compile archive layout: %s\n", newarch->datastream.path);
+    free (newarch->datastream.path);
+    free (newarch);
+    return -1;
+  }
 
   newarch->next = archiveroot;
   archiveroot = newarch;
@@ -1397,23 +2984,18 @@ addarchive (const char *path, const char *layout)
 /***************************************************************************
  * readregexfile:
  *
- * Read a list of regular expressions from a file and combine them
- * into a single, compound expression which is returned in *pppattern.
- * The return buffer is reallocated as need to hold the growing
- * pattern.  When called *pppattern should not point to any associated
- * memory.
+ * Read a list of regular expressions from a file and add them to the
+ * regex set at *ppset, allocating the set if needed.
  *
  * Returns the number of regexes parsed from the file or -1 on error.
  ***************************************************************************/
 static int
-readregexfile (char *regexfile, char **pppattern)
+readregexfile (char *regexfile, RegexSet **ppset)
 {
   FILE *fp;
   char line[1024];
   char linepattern[1024];
   int regexcnt = 0;
-  int lengthbase;
-  int lengthadd;
 
   if (!regexfile)
   {
@@ -1421,9 +3003,9 @@ readregexfile (char *regexfile, char **pppattern)
     return -1;
   }
 
-  if (!pppattern)
+  if (!ppset)
   {
-    ms_log (2, "readregexfile: pattern string buffer not supplied\n");
+    ms_log (2, "readregexfile: regex set not supplied\n");
     return -1;
   }
 
@@ -1438,8 +3020,6 @@ readregexfile (char *regexfile, char **pppattern)
   if (verbose)
     ms_log (1, "Reading regex list from %s\n", regexfile);
 
-  *pppattern = NULL;
-
   while ((fgets (line, sizeof (line), fp)) != NULL)
   {
     /* Trim spaces and skip if empty lines */
@@ -1452,46 +3032,320 @@ readregexfile (char *regexfile, char **pppattern)
 
     regexcnt++;
 
-    /* Add regex to compound regex */
-    if (*pppattern)
+    if (addregex (ppset, linepattern))
+    {
+      fclose (fp);
+      return -1;
+    }
+  }
+
+  fclose (fp);
+
+  return regexcnt;
+} /* End of readregexfile() */
+
+/***************************************************************************
+ * addregex:
+ *
+ * Add a regular expression to the regex set at *ppset, allocating the
+ * set if needed.
+ *
+ * Patterns that match a literal string, optionally anchored at the
+ * start and/or end and optionally with leading or trailing '.*', are
+ * added to the hash table of literals.  All other patterns are added
+ * to the alternation compiled by compileregexset().
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+addregex (RegexSet **ppset, char *pattern)
+{
+  RegexSet *set;
+  char literal[100];
+  char **slot;
+  char **literals;
+  char *cp;
+  unsigned int newsize;
+  unsigned int idx;
+  unsigned int pos;
+  size_t length = 0;
+  flag anchorstart = 0;
+  flag anchorend = 0;
+  flag trailingany = 0;
+  int type;
+  int lengthbase;
+  int lengthadd;
+
+  if (!ppset || !pattern)
+    return -1;
+
+  if (!*ppset && !(*ppset = (RegexSet *)calloc (1, sizeof (RegexSet))))
+  {
+    ms_log (2, "Cannot allocate memory for regex set\n");
+    return -1;
+  }
+
+  set = *ppset;
+
+  /* Parse pattern: [^][.*]literal[.*][$] */
+  cp = pattern;
+
+  if (*cp == '^')
+  {
+    anchorstart = 1;
+    cp++;
+  }
+
+  while (cp[0] == '.' && cp[1] == '*')
+  {
+    anchorstart = 0;
+    cp += 2;
+  }
+
+  for (; *cp && length < sizeof (literal) - 2; length++)
+  {
+    if (*cp == '\\' && cp[1] && strchr (".[]()*+?{}|^$\\", cp[1]))
+    {
+      literal[length + 1] = cp[1];
+      cp += 2;
+    }
+    else if (strchr (".[]()*+?{}|^$\\", *cp))
+    {
+      break;
+    }
+    else
+    {
+      literal[length + 1] = *cp++;
+    }
+  }
+
+  literal[length + 1] = '\0';
+
+  while (cp[0] == '.' && cp[1] == '*')
+  {
+    trailingany = 1;
+    cp += 2;
+  }
+
+  if (cp[0] == '$' && cp[1] == '\0')
+  {
+    anchorend = (trailingany) ? 0 : 1;
+    cp++;
+  }
+
+  /* Add literal to hash table, first character of key is the type */
+  if (*cp == '\0')
+  {
+    type = (anchorstart) ? ((anchorend) ? 3 : 1) : ((anchorend) ? 2 : 0);
+    literal[0] = "CPSE"[type];
+
+    /* Grow table to keep it at least half empty */
+    if ((set->count + 1) * 2 > set->size)
     {
-      lengthbase = strlen (*pppattern);
-      lengthadd = strlen (linepattern) + 4; /* Length of addition plus 4 characters: |()\0 */
+      newsize = (set->size) ? set->size * 2 : 256;
 
-      *pppattern = realloc (*pppattern, lengthbase + lengthadd);
+      if (!(literals = (char **)calloc (newsize, sizeof (char *))))
+      {
+        ms_log (2, "Cannot allocate memory for regex set\n");
+        return -1;
+      }
 
-      if (*pppattern)
+      for (idx = 0; idx < set->size; idx++)
       {
-        snprintf ((*pppattern) + lengthbase, lengthadd, "|(%s)", linepattern);
+        if (!set->literals[idx])
+          continue;
+
+        for (pos = 0, cp = set->literals[idx]; *cp; cp++)
+          pos = pos * 31 + (unsigned char)*cp;
+
+        pos &= newsize - 1;
+        while (literals[pos])
+          pos = (pos + 1) & (newsize - 1);
+
+        literals[pos] = set->literals[idx];
       }
-      else
+
+      if (set->literals)
+        free (set->literals);
+
+      set->literals = literals;
+      set->size = newsize;
+    }
+
+    slot = findliteral (set, literal);
+
+    if (!*slot)
+    {
+      if (!(*slot = strdup (literal)))
       {
-        ms_log (2, "Cannot allocate memory for regex string\n");
+        ms_log (2, "Cannot allocate memory for regex set\n");
         return -1;
       }
+
+      set->count++;
     }
-    else
+
+    set->lengths[type][length] = 1;
+
+    return 0;
+  }
+
+  /* Add pattern to compound regex */
+  if (set->pattern)
+  {
+    lengthbase = strlen (set->pattern);
+    lengthadd = strlen (pattern) + 4; /* Length of addition plus 4 characters: |()\0 */
+
+    if (!(set->pattern = realloc (set->pattern, lengthbase + lengthadd)))
     {
-      lengthadd = strlen (linepattern) + 3; /* Length of addition plus 3 characters: ()\0 */
+      ms_log (2, "Cannot allocate memory for regex string\n");
+      return -1;
+    }
 
-      *pppattern = malloc (lengthadd);
+    snprintf (set->pattern + lengthbase, lengthadd, "|(%s)", pattern);
+  }
+  else
+  {
+    lengthadd = strlen (pattern) + 3; /* Length of addition plus 3 characters: ()\0 */
 
-      if (*pppattern)
-      {
-        snprintf (*pppattern, lengthadd, "(%s)", linepattern);
-      }
-      else
+    if (!(set->pattern = malloc (lengthadd)))
+    {
+      ms_log (2, "Cannot allocate memory for regex string\n");
+      return -1;
+    }
+
+    snprintf (set->pattern, lengthadd, "(%s)", pattern);
+  }
+
+  set->patterncount++;
+
+  return 0;
+} /* End of addregex() */
+
+/***************************************************************************
+ * compileregexset:
+ *
+ * Compile the alternation of patterns in a regex set that are not
+ * literals, if any.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+compileregexset (RegexSet *set)
+{
+  if (!set)
+    return -1;
+
+  if (verbose > 1)
+    ms_log (1, "Regex set of %u literal and %d other patterns\n",
+            set->count, set->patterncount);
+
+  if (!set->pattern)
+    return 0;
+
+  if (!(set->regex = (regex_t *)malloc (sizeof (regex_t))))
+  {
+    ms_log (2, "Cannot allocate memory for regex\n");
+    return -1;
+  }
+
+  if (regcomp (set->regex, set->pattern, REG_EXTENDED | REG_NOSUB) != 0)
+  {
+    free (set->regex);
+    set->regex = NULL;
+    return -1;
+  }
+
+  return 0;
+} /* End of compileregexset() */
+
+/***************************************************************************
+ * matchregexset:
+ *
+ * Test a source name against a regex set.  Each literal is looked up
+ * by testing the hash table for substrings of the source name with
+ * the lengths and positions allowed by the literal type: anywhere
+ * (C), at the start (P), at the end (S) or the complete name (E).
+ *
+ * Returns 1 if any pattern matches and 0 otherwise.
+ ***************************************************************************/
+static int
+matchregexset (RegexSet *set, char *srcname)
+{
+  char key[101];
+  size_t namelength;
+  size_t length;
+  size_t maxlength;
+  size_t start;
+  int type;
+
+  if (!set || !srcname)
+    return 0;
+
+  if (set->count)
+  {
+    namelength = strlen (srcname);
+    maxlength = (namelength < sizeof (set->lengths[0])) ? namelength : sizeof (set->lengths[0]) - 1;
+
+    for (type = 0; type < 4; type++)
+    {
+      key[0] = "CPSE"[type];
+
+      for (length = 0; length <= maxlength; length++)
       {
-        ms_log (2, "Cannot allocate memory for regex string\n");
-        return -1;
+        if (!set->lengths[type][length])
+          continue;
+
+        if (type == 3 && length != namelength)
+          continue;
+
+        for (start = (type == 2) ? namelength - length : 0;
+             start + length <= namelength; start++)
+        {
+          memcpy (key + 1, srcname + start, length);
+          key[length + 1] = '\0';
+
+          if (*findliteral (set, key))
+            return 1;
+
+          /* Prefix, suffix and exact literals have a single position */
+          if (type != 0)
+            break;
+        }
       }
     }
   }
 
-  fclose (fp);
+  if (set->regex && regexec (set->regex, srcname, 0, 0, 0) == 0)
+    return 1;
 
-  return regexcnt;
-} /* End of readregexfile() */
+  return 0;
+} /* End of matchregexset() */
+
+/***************************************************************************
+ * findliteral:
+ *
+ * Find the hash table slot for a literal key in a regex set using
+ * linear probing, the table must be allocated.
+ *
+ * Returns pointer to the slot containing the key or the empty slot
+ * where the key would be stored.
+ ***************************************************************************/
+static char **
+findliteral (RegexSet *set, char *key)
+{
+  unsigned int pos;
+  char *cp;
+
+  for (pos = 0, cp = key; *cp; cp++)
+    pos = pos * 31 + (unsigned char)*cp;
+
+  pos &= set->size - 1;
+  while (set->literals[pos] && strcmp (set->literals[pos], key))
+    pos = (pos + 1) & (set->size - 1);
+
+  return &set->literals[pos];
+} /* End of findliteral() */
 
 /***************************************************************************
  * usage():
@@ -1523,12 +3377,18 @@ usage (int level)
            " -o file      Specify a single output file, use +o file to append\n"
            " -A format    Write all records in a custom directory/file layout (try -H)\n"
            " -Ps          Prune/trim records at the sample level\n"
+           " -wbuf size   Write buffer size for each output file, default 64K\n"
+           " -wbufmax size Maximum memory for archive write buffers, default 64M\n"
+           " -wqueue count Records queued for the writer thread, 0 = none, default 1024\n"
            "\n"
            " ## Diagnostic output ##\n"
            " -out file    Write a summary of output records to specified file\n"
            " -outprefix X Include prefix on summary output lines for identification\n"
            "\n"
            " ## Input data ##\n"
+           " -mmap        Read input files via memory mapping instead of buffered I/O\n"
+           " -j threads   Process input files in parallel using worker threads\n"
+           " -jsplit size Split files larger than size for parallel processing, default 64M\n"
            " file#        Files(s) of miniSEED records\n"
            "\n");
 
@@ -34,23 +34,181 @@
 int ds_maxopenfiles  = 0;
 int ds_openfilecount = 0;
 
-/* For a linked list of strings, as filled by strparse() */
-typedef struct strlist_s
-{
-  char *element;
-  struct strlist_s *next;
-} strlist;
+/* Write buffer size for each file and memory budget for all buffers */
+size_t ds_bufsize   = 65536;
+size_t ds_bufbudget = 67108864;
+static size_t ds_bufused = 0;
+
+/* Coarse clock for idle stream tracking, updated every DS_CLOCKCALLS calls */
+#define DS_CLOCKCALLS 64
+static time_t ds_clock   = 0;
+static int ds_clockcalls = 0;
 
 /* Functions internal to this source file */
 static DataStreamGroup *ds_getstream (DataStream *datastream, MSRecord *msr,
                                       const char *defkey, const char *filename);
+static int ds_linkgroup (DataStream *datastream, DataStreamGroup *group, int table);
+static void ds_unlinkgroup (DataStream *datastream, DataStreamGroup *group, int table);
 static int ds_openfile (DataStream *datastream, const char *filename);
 static int ds_closeidle (DataStream *datastream, int idletimeout);
+static int ds_closegroup (DataStream *datastream, DataStreamGroup *group);
+static int ds_writegroup (DataStream *datastream, DataStreamGroup *group,
+                          const void *data, size_t length);
+static int ds_flushgroup (DataStreamGroup *group, int release);
+static int ds_writefile (int filed, const char *data, size_t length);
 static void ds_shutdown (DataStream *datastream);
-static int strparse (const char *string, const char *delim, strlist **list);
+static time_t ds_time (void);
+static int ds_makedirs (DataStream *datastream, char *filename,
+                        const short *dirends, int dircount);
+static char **ds_finddir (DataStream *datastream, const char *path, int length);
+static void ds_freedircache (DataStream *datastream);
+static char *ds_putint (char *dst, const char *end, long value, int width);
 
 static int dsverbose;
 
+/***************************************************************************
+ * ds_compilelayout:
+ *
+ * Compile the archive layout in datastream->path into a sequence of
+ * tokens at datastream->layout: literal text, flags that are expanded
+ * from each record by ds_streamproc() and directory separators.  Flags
+ * starting with '%' are part of the definition key, flags starting
+ * with '#' are not.  Literal text references datastream->path, which
+ * must not be changed while the layout is in use.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+extern int
+ds_compilelayout (DataStream *datastream)
+{
+  DataStreamToken *token;
+  const char *p;
+  const char *literal;
+  const char *element;
+
+  if (!datastream || !datastream->path)
+    return -1;
+
+  if (datastream->path[0] == '\0')
+  {
+    fprintf (stderr, "ds_compilelayout(): empty path format\n");
+    return -1;
+  }
+
+  /* Every token consumes at least one character of the path */
+  free (datastream->layout);
+  datastream->layoutcount = 0;
+  if (!(datastream->layout = (DataStreamToken *)malloc ((strlen (datastream->path) + 1) * sizeof (DataStreamToken))))
+  {
+    fprintf (stderr, "ERROR: Cannot allocate memory for archive layout\n");
+    return -1;
+  }
+
+  token   = datastream->layout;
+  p       = datastream->path;
+  literal = p;
+
+/* Add a literal token for the text from literal to the current position */
+#define DS_ADDLITERAL()                  \
+  if (p > literal)                       \
+  {                                      \
+    token->code    = 0;                  \
+    token->defkey  = 0;                  \
+    token->length  = (int)(p - literal); \
+    token->literal = literal;            \
+    token++;                             \
+  }
+
+  /* Special case of an absolute path, the first separator is literal */
+  if (*p == '/')
+    p++;
+
+  element = p;
+
+  for (;;)
+  {
+    /* Directory separators and the end of the path end a path element */
+    if (*p == '/' || *p == '\0')
+    {
+      /* Special case of no file given */
+      if (*p == '\0' && p == element)
+      {
+        fprintf (stderr, "ds_compilelayout(): no file name specified in %s\n",
+                 datastream->path);
+        free (datastream->layout);
+        datastream->layout = NULL;
+        return -1;
+      }
+
+      DS_ADDLITERAL ();
+
+      if (*p == '\0')
+        break;
+
+      token->code    = '/';
+      token->defkey  = 0;
+      token->length  = 0;
+      token->literal = NULL;
+      token++;
+
+      literal = element = ++p;
+    }
+    else if (*p == '%' || *p == '#')
+    {
+      DS_ADDLITERAL ();
+
+      switch (*(p + 1))
+      {
+      case 'n':
+      case 's':
+      case 'l':
+      case 'c':
+      case 'Y':
+      case 'y':
+      case 'j':
+      case 'H':
+      case 'M':
+      case 'S':
+      case 'F':
+      case 'q':
+      case 'L':
+      case 'r':
+      case 'R':
+        token->code    = *(p + 1);
+        token->defkey  = (*p == '%');
+        token->length  = 0;
+        token->literal = NULL;
+        token++;
+        p += 2;
+        literal = p;
+        break;
+      case '%':
+      case '#':
+        /* Escaped flag characters are literal */
+        literal = p + 1;
+        p += 2;
+        break;
+      default:
+        /* Unknown flags are dropped, the code is literal */
+        fprintf (stderr, "Unknown layout format code: '%c'\n", *(p + 1));
+        p++;
+        literal = p;
+        break;
+      }
+    }
+    else
+    {
+      p++;
+    }
+  }
+
+#undef DS_ADDLITERAL
+
+  datastream->layoutcount = (int)(token - datastream->layout);
+
+  return 0;
+} /* End of ds_compilelayout() */
+
 /***************************************************************************
  * ds_streamproc:
  *
@@ -60,6 +218,10 @@ static int dsverbose;
  * ds_shutdown() will be called to close all open files and free all
  * associated memory.
  *
+ * The file name and definition key are expanded from the compiled
+ * layout in a single pass, the layout is compiled with
+ * ds_compilelayout() if needed.
+ *
  * This version has been modified from others to add the suffix
  * integer supplied with ds_streamproc() to the defkey and file name.
  *
@@ -69,14 +231,21 @@ extern int
 ds_streamproc (DataStream *datastream, MSRecord *msr, long suffix, int verbose)
 {
   DataStreamGroup *foundgroup = NULL;
+  DataStreamToken *token;
+  DataStreamToken *lasttoken;
   BTime stime;
-  strlist *fnlist, *fnptr;
-  char net[3], sta[6], loc[3], chan[4];
   char filename[400];
   char definition[400];
-  char pathformat[600];
-  char tstr[20];
-  int fnlen = 0;
+  char value[30];
+  char *fnptr;
+  char *defptr;
+  char *valptr;
+  char *fnend  = filename + sizeof (filename) - 1;
+  char *defend = definition + sizeof (definition) - 1;
+  short dirends[sizeof (filename)];
+  int dircount = 0;
+  int length;
+  int tdy;
 
   /* Set Verbosity for ds_ functions */
   dsverbose = verbose;
@@ -97,265 +266,146 @@ ds_streamproc (DataStream *datastream, MSRecord *msr, long suffix, int verbose)
     return -1;
   }
 
-  /* Build file path and name from datastream->path */
-  filename[0]   = '\0';
-  definition[0] = '\0';
-  snprintf (pathformat, sizeof (pathformat), "%s", datastream->path);
-
-  if (strparse (pathformat, "/", &fnlist) < 0)
-  {
-    fprintf (stderr, "ds_streamproc(): error parsing path format: '%s'\n", pathformat);
+  /* Compile the layout on first use */
+  if (!datastream->layout && ds_compilelayout (datastream))
     return -1;
-  }
-
-  fnptr = fnlist;
-
-  /* Special case of an absolute path (first entry is empty) */
-  if (*fnptr->element == '\0')
-  {
-    if (fnptr->next != 0)
-    {
-      strncat (filename, "/", sizeof (filename) - 1);
-      fnptr = fnptr->next;
-    }
-    else
-    {
-      fprintf (stderr, "ds_streamproc(): empty path format\n");
-      strparse (NULL, NULL, &fnlist);
-      return -1;
-    }
-  }
 
   /* Convert normalized starttime to BTime structure */
   if (ms_hptime2btime (msr->starttime, &stime))
   {
     fprintf (stderr, "ds_streamproc(): cannot convert start time to separate fields\n");
-    strparse (NULL, NULL, &fnlist);
     return -1;
   }
 
-  while (fnptr != 0)
-  {
-    int tdy;
-    char *w, *p, def;
-
-    p = fnptr->element;
+  /* Build file path and name and definition key from the layout */
+  fnptr  = filename;
+  defptr = definition;
 
-    /* Special case of no file given */
-    if (*p == '\0' && fnptr->next == 0)
-    {
-      fprintf (stderr, "ds_streamproc(): no file name specified, only %s\n",
-               filename);
-      strparse (NULL, NULL, &fnlist);
-      return -1;
-    }
+  lasttoken = datastream->layout + datastream->layoutcount;
+  for (token = datastream->layout; token < lasttoken; token++)
+  {
+    valptr = value;
 
-    while ((w = strpbrk (p, "%#")) != NULL)
+    switch (token->code)
     {
-      def = (*w == '%');
-      *w  = '\0';
-      strncat (filename, p, (sizeof (filename) - fnlen));
-      fnlen = strlen (filename);
-
-      w += 1;
-
-      switch (*w)
+    case 0:
+      length = (token->length < (fnend - fnptr)) ? token->length : (int)(fnend - fnptr);
+      memcpy (fnptr, token->literal, length);
+      fnptr += length;
+      continue;
+    case '/':
+      /* The path to this point should be a directory, checked below */
+      if (fnptr < fnend)
       {
-      case 'n':
-        ms_strncpclean (net, msr->fsdh->network, 2);
-        strncat (filename, net, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, net, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 's':
-        ms_strncpclean (sta, msr->fsdh->station, 5);
-        strncat (filename, sta, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, sta, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'l':
-        ms_strncpclean (loc, msr->fsdh->location, 2);
-        strncat (filename, loc, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, loc, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'c':
-        ms_strncpclean (chan, msr->fsdh->channel, 3);
-        strncat (filename, chan, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, chan, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'Y':
-        snprintf (tstr, sizeof (tstr), "%04d", (int)stime.year);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'y':
-        tdy = (int)stime.year;
-        while (tdy > 100)
-        {
-          tdy -= 100;
-        }
-        snprintf (tstr, sizeof (tstr), "%02d", tdy);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'j':
-        snprintf (tstr, sizeof (tstr), "%03d", (int)stime.day);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'H':
-        snprintf (tstr, sizeof (tstr), "%02d", (int)stime.hour);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'M':
-        snprintf (tstr, sizeof (tstr), "%02d", (int)stime.min);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'S':
-        snprintf (tstr, sizeof (tstr), "%02d", (int)stime.sec);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'F':
-        snprintf (tstr, sizeof (tstr), "%04d", (int)stime.fract);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'q':
-        snprintf (tstr, sizeof (tstr), "%c", msr->dataquality);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'L':
-        snprintf (tstr, sizeof (tstr), "%d", msr->reclen);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'r':
-        snprintf (tstr, sizeof (tstr), "%ld", (long int)(msr->samprate + 0.5));
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case 'R':
-        snprintf (tstr, sizeof (tstr), "%.6f", msr->samprate);
-        strncat (filename, tstr, (sizeof (filename) - fnlen));
-        if (def)
-          strncat (definition, tstr, (sizeof (definition) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case '%':
-        strncat (filename, "%", (sizeof (filename) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      case '#':
-        strncat (filename, "#", (sizeof (filename) - fnlen));
-        fnlen = strlen (filename);
-        p     = w + 1;
-        break;
-      default:
-        fprintf (stderr, "Unknown layout format code: '%c'\n", *w);
-        p = w;
-        break;
+        dirends[dircount++] = (short)(fnptr - filename);
+        *fnptr++ = '/';
+      }
+      continue;
+    case 'n':
+      valptr += ms_strncpclean (value, msr->fsdh->network, 2);
+      break;
+    case 's':
+      valptr += ms_strncpclean (value, msr->fsdh->station, 5);
+      break;
+    case 'l':
+      valptr += ms_strncpclean (value, msr->fsdh->location, 2);
+      break;
+    case 'c':
+      valptr += ms_strncpclean (value, msr->fsdh->channel, 3);
+      break;
+    case 'Y':
+      valptr = ds_putint (value, value + sizeof (value), (long)stime.year, 4);
+      break;
+    case 'y':
+      tdy = (int)stime.year;
+      while (tdy > 100)
+      {
+        tdy -= 100;
       }
+      valptr = ds_putint (value, value + sizeof (value), (long)tdy, 2);
+      break;
+    case 'j':
+      valptr = ds_putint (value, value + sizeof (value), (long)stime.day, 3);
+      break;
+    case 'H':
+      valptr = ds_putint (value, value + sizeof (value), (long)stime.hour, 2);
+      break;
+    case 'M':
+      valptr = ds_putint (value, value + sizeof (value), (long)stime.min, 2);
+      break;
+    case 'S':
+      valptr = ds_putint (value, value + sizeof (value), (long)stime.sec, 2);
+      break;
+    case 'F':
+      valptr = ds_putint (value, value + sizeof (value), (long)stime.fract, 4);
+      break;
+    case 'q':
+      if (msr->dataquality)
+        *valptr++ = msr->dataquality;
+      break;
+    case 'L':
+      valptr = ds_putint (value, value + sizeof (value), (long)msr->reclen, 0);
+      break;
+    case 'r':
+      valptr = ds_putint (value, value + sizeof (value), (long int)(msr->samprate + 0.5), 0);
+      break;
+    case 'R':
+      length = snprintf (value, sizeof (value), "%.6f", msr->samprate);
+      valptr += (length < (int)sizeof (value)) ? length : (int)sizeof (value) - 1;
+      break;
     }
 
-    strncat (filename, p, (sizeof (filename) - fnlen));
-    fnlen = strlen (filename);
+    /* Add flag value to file name and, if a defining flag, to the definition */
+    length = (int)(valptr - value);
+    if (length > (fnend - fnptr))
+      length = (int)(fnend - fnptr);
+    memcpy (fnptr, value, length);
+    fnptr += length;
 
-    /* If not the last entry then it should be a directory */
-    if (fnptr->next != 0)
+    if (token->defkey)
     {
-      if (access (filename, F_OK))
-      {
-        if (errno == ENOENT)
-        {
-          if (dsverbose >= 1)
-            fprintf (stderr, "Creating directory: %s\n", filename);
-
-          if (mkdir (filename, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH))
-          {
-            fprintf (stderr, "ds_streamproc: mkdir(%s) %s\n", filename, strerror (errno));
-            strparse (NULL, NULL, &fnlist);
-            return -1;
-          }
-        }
-        else
-        {
-          fprintf (stderr, "%s: access denied, %s\n", filename, strerror (errno));
-          strparse (NULL, NULL, &fnlist);
-          return -1;
-        }
-      }
-
-      strncat (filename, "/", (sizeof (filename) - fnlen));
-      fnlen++;
+      length = (int)(valptr - value);
+      if (length > (defend - defptr))
+        length = (int)(defend - defptr);
+      memcpy (defptr, value, length);
+      defptr += length;
     }
-
-    fnptr = fnptr->next;
   }
 
-  strparse (NULL, NULL, &fnlist);
-
   /* Add ".suffix" to filename and definition if suffix is not 0 */
   if (suffix)
   {
-    snprintf (tstr, sizeof (tstr), ".%06ld", suffix);
-    strncat (filename, tstr, (sizeof (filename) - fnlen));
-    strncat (definition, tstr, (sizeof (definition) - fnlen));
-    fnlen = strlen (filename);
+    value[0] = '.';
+    valptr   = ds_putint (value + 1, value + sizeof (value), suffix, 6);
+
+    length = (int)(valptr - value);
+    if (length > (fnend - fnptr))
+      length = (int)(fnend - fnptr);
+    memcpy (fnptr, value, length);
+    fnptr += length;
+
+    length = (int)(valptr - value);
+    if (length > (defend - defptr))
+      length = (int)(defend - defptr);
+    memcpy (defptr, value, length);
+    defptr += length;
   }
 
-  /* Make sure the filename and definition are NULL terminated */
-  *(filename + sizeof (filename) - 1)     = '\0';
-  *(definition + sizeof (definition) - 1) = '\0';
+  /* Terminate the filename and definition */
+  *fnptr  = '\0';
+  *defptr = '\0';
+
+  /* Make sure the directories of the file exist */
+  if (ds_makedirs (datastream, filename, dirends, dircount))
+    return -1;
 
   /* Check for previously used stream entry, otherwise create it */
   foundgroup = ds_getstream (datastream, msr, definition, filename);
 
+  /* Directories may have been removed, verify them again for later records */
+  if (foundgroup == NULL)
+    ds_freedircache (datastream);
+
   if (foundgroup != NULL)
   {
     /* Write binary data samples to appropriate file */
@@ -364,14 +414,15 @@ ds_streamproc (DataStream *datastream, MSRecord *msr, long suffix, int verbose)
       if (dsverbose >= 3)
         fprintf (stderr, "Writing binary data samples to data stream file %s\n", filename);
 
-      if (!write (foundgroup->filed, msr->datasamples, msr->numsamples * ms_samplesize (msr->sampletype)))
+      if (ds_writegroup (datastream, foundgroup, msr->datasamples,
+                         (size_t)msr->numsamples * ms_samplesize (msr->sampletype)))
       {
         fprintf (stderr, "ds_streamproc: failed to write binary data samples\n");
         return -1;
       }
       else
       {
-        foundgroup->modtime = time (NULL);
+        foundgroup->modtime = ds_clock;
       }
     }
     /* Write the data record to the appropriate file */
@@ -380,14 +431,14 @@ ds_streamproc (DataStream *datastream, MSRecord *msr, long suffix, int verbose)
       if (dsverbose >= 3)
         fprintf (stderr, "Writing data record to data stream file %s\n", filename);
 
-      if (!write (foundgroup->filed, msr->record, msr->reclen))
+      if (ds_writegroup (datastream, foundgroup, msr->record, (size_t)msr->reclen))
       {
         fprintf (stderr, "ds_streamproc: failed to write data record\n");
         return -1;
       }
       else
       {
-        foundgroup->modtime = time (NULL);
+        foundgroup->modtime = ds_clock;
       }
     }
 
@@ -400,14 +451,15 @@ ds_streamproc (DataStream *datastream, MSRecord *msr, long suffix, int verbose)
 /***************************************************************************
  * ds_getstream:
  *
- * Find the DataStreamGroup entry that matches the definition key, if
- * no matching entries are found allocate a new entry and open the
- * given file.
+ * Find the DataStreamGroup entry that matches the definition key using
+ * the hash table of the DataStream, if no matching entries are found
+ * open the given file and add a new entry.
  *
- * Resource maintenance is performed here: the modification time of
- * each stream, modtime, is compared to the current time.  If the
- * stream entry has been idle for 'DataStream.idletimeout' seconds
- * then the stream will be closed (file closed and memory freed).
+ * Resource maintenance is performed here: entries are kept in a list
+ * ordered by use, the least recently used first.  Entries at the front
+ * of the list that have been idle for 'DataStream.idletimeout' seconds
+ * are closed (file closed and memory freed).  Idle time is measured
+ * with a coarse clock, see ds_time().
  *
  * Returns a pointer to a DataStreamGroup on success or NULL on error.
  ***************************************************************************/
@@ -415,110 +467,213 @@ static DataStreamGroup *
 ds_getstream (DataStream *datastream, MSRecord *msr,
               const char *defkey, const char *filename)
 {
-  DataStreamGroup *foundgroup  = NULL;
-  DataStreamGroup *searchgroup = NULL;
-  DataStreamGroup *prevgroup   = NULL;
+  DataStreamGroup *foundgroup = NULL;
+  const unsigned char *cp;
+  unsigned int hash;
   time_t curtime;
+  int filed;
 
   if (!datastream)
     return NULL;
 
-  searchgroup = datastream->grouproot;
-  curtime     = time (NULL);
-
-  /* Traverse the stream chain looking for matching streams */
-  while (searchgroup != NULL)
-  {
-    DataStreamGroup *nextgroup = (DataStreamGroup *)searchgroup->next;
-
-    if (!strcmp (searchgroup->defkey, defkey))
-    {
-      if (dsverbose >= 3)
-        fprintf (stderr, "Found data stream entry for key %s\n", defkey);
-
-      foundgroup = searchgroup;
+  curtime = ds_time ();
 
-      /* Keep ds_closeidle from closing this stream */
-      if (foundgroup->modtime > 0)
-      {
-        foundgroup->modtime *= -1;
-      }
+  for (hash = 0, cp = (const unsigned char *)defkey; *cp; cp++)
+    hash = hash * 31 + *cp;
 
-      break;
-    }
+  /* Find the stream in the hash table */
+  if (datastream->grouptable)
+  {
+    foundgroup = datastream->grouptable[hash & (datastream->grouptablesize - 1)];
 
-    prevgroup   = searchgroup;
-    searchgroup = nextgroup;
+    while (foundgroup && (foundgroup->hash != hash || strcmp (foundgroup->defkey, defkey)))
+      foundgroup = foundgroup->hashnext;
   }
 
-  /* If not found, create a stream entry */
-  if (foundgroup == NULL)
+  if (foundgroup != NULL)
   {
-    if (dsverbose >= 2)
-      fprintf (stderr, "Creating data stream entry for key %s\n", defkey);
+    if (dsverbose >= 3)
+      fprintf (stderr, "Found data stream entry for key %s\n", defkey);
 
-    if (!(foundgroup = (DataStreamGroup *)malloc (sizeof (DataStreamGroup))))
+    /* Move to the most recently used end of the list */
+    if (foundgroup != datastream->grouptail)
     {
-      fprintf (stderr, "ERROR: Cannot allocate memory for DataStreamGroup\n");
-      return NULL;
+      ds_unlinkgroup (datastream, foundgroup, 0);
+      ds_linkgroup (datastream, foundgroup, 0);
     }
 
-    foundgroup->defkey  = strdup (defkey);
-    foundgroup->filed   = 0;
     foundgroup->modtime = curtime;
-    foundgroup->next    = NULL;
 
-    /* Set the stream root if this is the first entry */
-    if (datastream->grouproot == NULL)
-    {
-      datastream->grouproot = foundgroup;
-    }
-    /* Otherwise add to the end of the chain */
-    else if (prevgroup != NULL)
-    {
-      prevgroup->next = foundgroup;
-    }
-    else
-    {
-      fprintf (stderr, "stream chain is broken!\n");
-      return NULL;
-    }
+    /* Close idle stream files, the found stream is not idle */
+    ds_closeidle (datastream, datastream->idletimeout);
+
+    return foundgroup;
   }
 
+  /* If not found, create a stream entry */
+  if (dsverbose >= 2)
+    fprintf (stderr, "Creating data stream entry for key %s\n", defkey);
+
   /* Close idle stream files */
   ds_closeidle (datastream, datastream->idletimeout);
 
-  /* If no file is open, well, open it */
-  if (foundgroup->filed == 0)
+  if (dsverbose >= 1)
+    fprintf (stderr, "Opening data stream file %s\n", filename);
+
+  if ((filed = ds_openfile (datastream, filename)) == -1)
   {
-    int filepos;
+    fprintf (stderr, "cannot open data stream file, %s\n", strerror (errno));
+    return NULL;
+  }
 
-    if (dsverbose >= 1)
-      fprintf (stderr, "Opening data stream file %s\n", filename);
+  if (lseek (filed, (off_t)0, SEEK_END) < 0)
+  {
+    fprintf (stderr, "cannot seek in data stream file, %s\n", strerror (errno));
+    close (filed);
+    ds_openfilecount--;
+    return NULL;
+  }
 
-    if ((foundgroup->filed = ds_openfile (datastream, filename)) == -1)
-    {
-      fprintf (stderr, "cannot open data stream file, %s\n", strerror (errno));
-      return NULL;
-    }
+  if (!(foundgroup = (DataStreamGroup *)malloc (sizeof (DataStreamGroup))) ||
+      !(foundgroup->defkey = strdup (defkey)))
+  {
+    fprintf (stderr, "ERROR: Cannot allocate memory for DataStreamGroup\n");
+    free (foundgroup);
+    close (filed);
+    ds_openfilecount--;
+    return NULL;
+  }
 
-    if ((filepos = (int)lseek (foundgroup->filed, (off_t)0, SEEK_END)) < 0)
-    {
-      fprintf (stderr, "cannot seek in data stream file, %s\n", strerror (errno));
-      return NULL;
-    }
+  foundgroup->filed    = filed;
+  foundgroup->modtime  = curtime;
+  foundgroup->buffer   = NULL;
+  foundgroup->bufsize  = 0;
+  foundgroup->buflen   = 0;
+  foundgroup->hash     = hash;
+  foundgroup->hashnext = NULL;
+  foundgroup->prev     = NULL;
+  foundgroup->next     = NULL;
+
+  if (ds_linkgroup (datastream, foundgroup, 1))
+  {
+    fprintf (stderr, "ERROR: Cannot allocate memory for DataStreamGroup table\n");
+    free (foundgroup->defkey);
+    free (foundgroup);
+    close (filed);
+    ds_openfilecount--;
+    return NULL;
   }
 
   return foundgroup;
 } /* End of ds_getstream() */
 
+/***************************************************************************
+ * ds_linkgroup:
+ *
+ * Add a DataStreamGroup at the most recently used end of the list of
+ * the DataStream.  If 'table' is true also add the entry to the hash
+ * table, growing the table as needed.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+static int
+ds_linkgroup (DataStream *datastream, DataStreamGroup *group, int table)
+{
+  DataStreamGroup **newtable;
+  DataStreamGroup *entry;
+  DataStreamGroup *nextentry;
+  unsigned int newsize;
+  unsigned int idx;
+
+  if (table)
+  {
+    /* Grow table when entries outnumber slots, re-inserting entries */
+    if (datastream->groupcount >= datastream->grouptablesize)
+    {
+      newsize = (datastream->grouptablesize) ? datastream->grouptablesize * 2 : 64;
+
+      if (!(newtable = (DataStreamGroup **)calloc (newsize, sizeof (DataStreamGroup *))))
+        return -1;
+
+      for (idx = 0; idx < datastream->grouptablesize; idx++)
+      {
+        for (entry = datastream->grouptable[idx]; entry; entry = nextentry)
+        {
+          nextentry = entry->hashnext;
+
+          entry->hashnext = newtable[entry->hash & (newsize - 1)];
+          newtable[entry->hash & (newsize - 1)] = entry;
+        }
+      }
+
+      free (datastream->grouptable);
+
+      datastream->grouptable     = newtable;
+      datastream->grouptablesize = newsize;
+    }
+
+    idx = group->hash & (datastream->grouptablesize - 1);
+
+    group->hashnext = datastream->grouptable[idx];
+    datastream->grouptable[idx] = group;
+    datastream->groupcount++;
+  }
+
+  group->prev = datastream->grouptail;
+  group->next = NULL;
+
+  if (datastream->grouptail)
+    datastream->grouptail->next = group;
+  else
+    datastream->grouproot = group;
+
+  datastream->grouptail = group;
+
+  return 0;
+} /* End of ds_linkgroup() */
+
+/***************************************************************************
+ * ds_unlinkgroup:
+ *
+ * Remove a DataStreamGroup from the list of the DataStream.  If 'table'
+ * is true also remove the entry from the hash table.
+ ***************************************************************************/
+static void
+ds_unlinkgroup (DataStream *datastream, DataStreamGroup *group, int table)
+{
+  DataStreamGroup **slot;
+
+  if (table)
+  {
+    slot = &datastream->grouptable[group->hash & (datastream->grouptablesize - 1)];
+
+    while (*slot != group)
+      slot = &(*slot)->hashnext;
+
+    *slot = group->hashnext;
+    datastream->groupcount--;
+  }
+
+  if (group->prev)
+    group->prev->next = group->next;
+  else
+    datastream->grouproot = group->next;
+
+  if (group->next)
+    group->next->prev = group->prev;
+  else
+    datastream->grouptail = group->prev;
+
+  group->prev = NULL;
+  group->next = NULL;
+} /* End of ds_unlinkgroup() */
+
 /***************************************************************************
  * ds_openfile:
  *
  * Open a specified file, if the open file limit has been reached try
  * once to increase the limit, if that fails or has already been done
- * start closing idle files with decreasing idle timeouts until a file
- * can be opened.
+ * close idle files or, if none are idle, the least recently used file.
  *
  * Return the result of open(2), normally this a the file descriptor
  * on success and -1 on error.
@@ -577,11 +732,9 @@ ds_openfile (DataStream *datastream, const char *filename)
       fprintf (stderr, "Maximum open archive files reached (%d), closing idle stream files\n",
                (ds_maxopenfiles - 10));
 
-    /* Close idle streams until we have free descriptors */
-    while (ds_closeidle (datastream, idletimeout) == 0 && idletimeout >= 0)
-    {
-      idletimeout = (idletimeout / 2) - 1;
-    }
+    /* Close idle streams, if none are idle close the least recently used stream */
+    if (ds_closeidle (datastream, idletimeout) == 0 && datastream->grouproot)
+      ds_closegroup (datastream, datastream->grouproot);
   }
 
   /* Open file */
@@ -597,7 +750,8 @@ ds_openfile (DataStream *datastream, const char *filename)
  * ds_closeidle:
  *
  * Close all stream files that have not been active for the specified
- * idletimeout.
+ * idletimeout.  Only the idle entries at the least recently used end
+ * of the list are visited.
  *
  * Return the number of files closed.
  ***************************************************************************/
@@ -606,67 +760,61 @@ ds_closeidle (DataStream *datastream, int idletimeout)
 {
   int count                    = 0;
   DataStreamGroup *searchgroup = NULL;
-  DataStreamGroup *prevgroup   = NULL;
-  DataStreamGroup *nextgroup   = NULL;
-  time_t curtime;
-
-  searchgroup = datastream->grouproot;
-  curtime     = time (NULL);
 
-  /* Traverse the stream chain */
-  while (searchgroup != NULL)
+  /* Close streams from the least recently used end of the list */
+  while ((searchgroup = datastream->grouproot) != NULL &&
+         (ds_clock - searchgroup->modtime) > idletimeout)
   {
-    nextgroup = searchgroup->next;
+    if (dsverbose >= 2)
+      fprintf (stderr, "Closing idle stream with key %s\n", searchgroup->defkey);
 
-    if (searchgroup->modtime > 0 && (curtime - searchgroup->modtime) > idletimeout)
-    {
-      if (dsverbose >= 2)
-        fprintf (stderr, "Closing idle stream with key %s\n", searchgroup->defkey);
+    count += ds_closegroup (datastream, searchgroup);
+  }
 
-      /* Re-link the stream chain */
-      if (prevgroup != NULL)
-      {
-        if (searchgroup->next != NULL)
-          prevgroup->next = searchgroup->next;
-        else
-          prevgroup->next = NULL;
-      }
-      else
-      {
-        if (searchgroup->next != NULL)
-          datastream->grouproot = searchgroup->next;
-        else
-          datastream->grouproot = NULL;
-      }
+  return count;
+} /* End of ds_closeidle() */
 
-      /* Close the associated file */
-      if (close (searchgroup->filed))
-        fprintf (stderr, "ds_closeidle(), closing data stream file, %s\n",
-                 strerror (errno));
-      else
-        count++;
+/***************************************************************************
+ * ds_closegroup:
+ *
+ * Remove a DataStreamGroup from the DataStream, flush the write buffer,
+ * close the stream file and free the entry.
+ *
+ * Return 1 if the file was closed and 0 otherwise.
+ ***************************************************************************/
+static int
+ds_closegroup (DataStream *datastream, DataStreamGroup *group)
+{
+  int closed = 0;
 
-      free (searchgroup->defkey);
-      free (searchgroup);
-    }
-    else
-    {
-      prevgroup = searchgroup;
-    }
+  ds_unlinkgroup (datastream, group, 1);
+
+  ds_flushgroup (group, 1);
 
-    searchgroup = nextgroup;
+  /* Close the associated file */
+  if (close (group->filed))
+  {
+    fprintf (stderr, "ds_closeidle(), closing data stream file, %s\n",
+             strerror (errno));
+  }
+  else
+  {
+    ds_openfilecount--;
+    closed = 1;
   }
 
-  ds_openfilecount -= count;
+  free (group->defkey);
+  free (group);
 
-  return count;
-} /* End of ds_closeidle() */
+  return closed;
+} /* End of ds_closegroup() */
 
 /***************************************************************************
  * ds_shutdown:
  *
- * Close all stream files and release all of the DataStreamGroup memory
- * structures.
+ * Flush write buffers, close all stream files and release all of the
+ * DataStreamGroup memory structures, the compiled layout and the
+ * directory cache.
  ***************************************************************************/
 static void
 ds_shutdown (DataStream *datastream)
@@ -684,106 +832,360 @@ ds_shutdown (DataStream *datastream)
     if (dsverbose >= 2)
       fprintf (stderr, "Shutting down stream with key: %s\n", prevgroup->defkey);
 
+    ds_flushgroup (prevgroup, 1);
+
     if (close (prevgroup->filed))
       fprintf (stderr, "ds_shutdown(), closing data stream file, %s\n",
                strerror (errno));
+    else
+      ds_openfilecount--;
 
     free (prevgroup->defkey);
     free (prevgroup);
   }
+
+  datastream->grouproot = NULL;
+  datastream->grouptail = NULL;
+
+  free (datastream->grouptable);
+  datastream->grouptable     = NULL;
+  datastream->grouptablesize = 0;
+  datastream->groupcount     = 0;
+
+  free (datastream->layout);
+  datastream->layout      = NULL;
+  datastream->layoutcount = 0;
+
+  ds_freedircache (datastream);
 } /* End of ds_shutdown() */
 
 /***************************************************************************
- * strparse:
+ * ds_writegroup:
  *
- * splits a 'string' on 'delim' and puts each part into a linked list
- * pointed to by 'list' (a pointer to a pointer).  The last entry has
- * it's 'next' set to 0.  All elements are NULL terminated strings.
- * If both 'string' and 'delim' are NULL then the linked list is
- * traversed and the memory used is free'd and the list pointer is
- * set to NULL.
+ * Write data to the file of a DataStreamGroup through the write buffer
+ * of the entry.  A buffer of ds_bufsize bytes is allocated on first use
+ * if the total of all buffers stays within ds_bufbudget, otherwise the
+ * buffers of the other entries of the DataStream are flushed and
+ * released first.  Data is written directly when buffering is
+ * disabled, no buffer can be allocated or the data is larger than the
+ * buffer.
  *
- * Returns the number of elements added to the list, 0 when freeing
- * the linked list and -1 on error.
+ * Returns 0 on success, -1 on error.
  ***************************************************************************/
 static int
-strparse (const char *string, const char *delim, strlist **list)
+ds_writegroup (DataStream *datastream, DataStreamGroup *group,
+               const void *data, size_t length)
 {
-  const char *beg; /* beginning of element */
-  const char *del; /* delimiter */
-  int stop  = 0;
-  int count = 0;
-  int total;
-
-  strlist *curlist = 0;
-  strlist *tmplist = 0;
+  DataStreamGroup *searchgroup;
 
-  if (string != NULL && delim != NULL)
+  /* Allocate a buffer within the memory budget */
+  if (!group->buffer && ds_bufsize > 0 && length < ds_bufsize)
   {
-    total = strlen (string);
-    beg   = string;
-
-    while (!stop)
+    if (ds_bufused + ds_bufsize > ds_bufbudget)
     {
-      /* Find delimiter */
-      del = strstr (beg, delim);
+      if (dsverbose >= 2)
+        fprintf (stderr, "Write buffer budget reached, flushing buffers\n");
 
-      /* Delimiter not found or empty */
-      if (del == NULL || strlen (delim) == 0)
+      for (searchgroup = datastream->grouproot; searchgroup; searchgroup = searchgroup->next)
       {
-        del  = string + strlen (string);
-        stop = 1;
+        if (searchgroup != group && searchgroup->buffer)
+          ds_flushgroup (searchgroup, 1);
       }
+    }
 
-      if (!(tmplist = (strlist *)malloc (sizeof (strlist))))
-      {
-        fprintf (stderr, "ERROR: Cannot allocate memory for string parsing\n");
-        return -1;
-      }
+    if (ds_bufused + ds_bufsize <= ds_bufbudget &&
+        (group->buffer = (char *)malloc (ds_bufsize)) != NULL)
+    {
+      group->bufsize = ds_bufsize;
+      ds_bufused += ds_bufsize;
+    }
+  }
+
+  /* Flush buffer if the data does not fit */
+  if (group->buflen > 0 && group->buflen + length > group->bufsize)
+  {
+    if (ds_flushgroup (group, 0))
+      return -1;
+  }
 
-      tmplist->next = 0;
+  /* Write data directly if it cannot be buffered */
+  if (length >= group->bufsize)
+    return ds_writefile (group->filed, (const char *)data, length);
 
-      if (!(tmplist->element = (char *)malloc (del - beg + 1)))
-      {
-        fprintf (stderr, "ERROR: Cannot allocate memory for string parsing\n");
-        return -1;
-      }
+  memcpy (group->buffer + group->buflen, data, length);
+  group->buflen += length;
 
-      strncpy (tmplist->element, beg, (del - beg));
-      tmplist->element[(del - beg)] = '\0';
+  return 0;
+} /* End of ds_writegroup() */
 
-      /* Add this to the list */
-      if (count++ == 0)
-      {
-        curlist = tmplist;
-        *list   = curlist;
-      }
-      else
+/***************************************************************************
+ * ds_flushgroup:
+ *
+ * Write the data in the write buffer of a DataStreamGroup to the file.
+ * If 'release' is true the buffer is freed.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+static int
+ds_flushgroup (DataStreamGroup *group, int release)
+{
+  int retval = 0;
+
+  if (group->buflen > 0)
+  {
+    if (dsverbose >= 3)
+      fprintf (stderr, "Flushing %lu bytes to data stream file for key %s\n",
+               (unsigned long)group->buflen, group->defkey);
+
+    retval        = ds_writefile (group->filed, group->buffer, group->buflen);
+    group->buflen = 0;
+  }
+
+  if (release && group->buffer)
+  {
+    free (group->buffer);
+    ds_bufused -= group->bufsize;
+
+    group->buffer  = NULL;
+    group->bufsize = 0;
+  }
+
+  return retval;
+} /* End of ds_flushgroup() */
+
+/***************************************************************************
+ * ds_writefile:
+ *
+ * Write all data to a file descriptor, retrying partial and interrupted
+ * writes.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+static int
+ds_writefile (int filed, const char *data, size_t length)
+{
+  ssize_t written;
+
+  while (length > 0)
+  {
+    if ((written = write (filed, data, length)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      fprintf (stderr, "ds_writefile(): write failed, %s\n", strerror (errno));
+      return -1;
+    }
+
+    data += written;
+    length -= (size_t)written;
+  }
+
+  return 0;
+} /* End of ds_writefile() */
+
+/***************************************************************************
+ * ds_time:
+ *
+ * Return the time of a coarse clock used to track idle streams, the
+ * clock is updated with time() once every DS_CLOCKCALLS calls instead
+ * of for every record.
+ ***************************************************************************/
+static time_t
+ds_time (void)
+{
+  if (--ds_clockcalls <= 0)
+  {
+    ds_clock      = time (NULL);
+    ds_clockcalls = DS_CLOCKCALLS;
+  }
+
+  return ds_clock;
+} /* End of ds_time() */
+
+/***************************************************************************
+ * ds_makedirs:
+ *
+ * Make sure the directories of filename exist, creating them like
+ * "mkdir -p" if needed.  The directory separators of filename are at
+ * the offsets in dirends.  Directories that exist or were created are
+ * added to the directory cache of the DataStream and are not checked
+ * again, so once the directories of a file are known no system calls
+ * are made.
+ *
+ * Returns 0 on success, -1 on error.
+ ***************************************************************************/
+static int
+ds_makedirs (DataStream *datastream, char *filename,
+             const short *dirends, int dircount)
+{
+  char **slot;
+  int idx;
+
+  if (dircount <= 0)
+    return 0;
+
+  /* The deepest directory is only cached when all parents exist */
+  if ((slot = ds_finddir (datastream, filename, dirends[dircount - 1])) && *slot)
+    return 0;
+
+  for (idx = 0; idx < dircount; idx++)
+  {
+    if (!(slot = ds_finddir (datastream, filename, dirends[idx])))
+    {
+      fprintf (stderr, "ERROR: Cannot allocate memory for directory cache\n");
+      return -1;
+    }
+
+    if (*slot)
+      continue;
+
+    /* Test the path up to this separator */
+    filename[dirends[idx]] = '\0';
+
+    if (mkdir (filename, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH))
+    {
+      if (errno != EEXIST)
       {
-        curlist->next = tmplist;
-        curlist       = curlist->next;
+        fprintf (stderr, "ds_streamproc: mkdir(%s) %s\n", filename, strerror (errno));
+        filename[dirends[idx]] = '/';
+        return -1;
       }
+    }
+    else if (dsverbose >= 1)
+    {
+      fprintf (stderr, "Creating directory: %s\n", filename);
+    }
 
-      /* Update 'beg' */
-      beg = (del + strlen (delim));
-      if ((beg - string) > total)
-        break;
+    /* Add directory to the cache in the empty slot */
+    if (!(*slot = strdup (filename)))
+    {
+      fprintf (stderr, "ERROR: Cannot allocate memory for directory cache\n");
+      filename[dirends[idx]] = '/';
+      return -1;
     }
 
-    return count;
+    datastream->dircachecount++;
+    filename[dirends[idx]] = '/';
   }
-  else
+
+  return 0;
+} /* End of ds_makedirs() */
+
+/***************************************************************************
+ * ds_finddir:
+ *
+ * Find the slot of the directory cache entry for the first length
+ * characters of path, the slot is empty if the directory is not in
+ * the cache.  The table grows when half full, so an empty slot is
+ * always available for a new entry.
+ *
+ * Returns a pointer to the slot or NULL on error.
+ ***************************************************************************/
+static char **
+ds_finddir (DataStream *datastream, const char *path, int length)
+{
+  char **table;
+  unsigned int newsize;
+  unsigned int hash;
+  unsigned int idx;
+  const unsigned char *cp;
+
+  /* Grow table when half full, re-inserting entries */
+  if (datastream->dircachecount * 2 >= datastream->dircachesize)
   {
-    curlist = *list;
-    while (curlist != NULL)
+    newsize = (datastream->dircachesize) ? datastream->dircachesize * 2 : 64;
+
+    if (!(table = (char **)calloc (newsize, sizeof (char *))))
+      return NULL;
+
+    for (idx = 0; idx < datastream->dircachesize; idx++)
     {
-      tmplist = curlist->next;
-      free (curlist->element);
-      free (curlist);
-      curlist = tmplist;
+      if (!datastream->dircache[idx])
+        continue;
+
+      for (hash = 0, cp = (const unsigned char *)datastream->dircache[idx]; *cp; cp++)
+        hash = hash * 31 + *cp;
+
+      hash &= newsize - 1;
+      while (table[hash])
+        hash = (hash + 1) & (newsize - 1);
+
+      table[hash] = datastream->dircache[idx];
     }
-    *list = NULL;
 
-    return 0;
+    free (datastream->dircache);
+
+    datastream->dircache     = table;
+    datastream->dircachesize = newsize;
   }
-} /* End of strparse() */
+
+  /* Find existing entry or empty slot */
+  for (hash = 0, cp = (const unsigned char *)path; cp < (const unsigned char *)path + length; cp++)
+    hash = hash * 31 + *cp;
+
+  hash &= datastream->dircachesize - 1;
+  while (datastream->dircache[hash] &&
+         (strncmp (datastream->dircache[hash], path, length) || datastream->dircache[hash][length]))
+    hash = (hash + 1) & (datastream->dircachesize - 1);
+
+  return &datastream->dircache[hash];
+} /* End of ds_finddir() */
+
+/***************************************************************************
+ * ds_freedircache:
+ *
+ * Free all entries of the directory cache and the cache table.
+ ***************************************************************************/
+static void
+ds_freedircache (DataStream *datastream)
+{
+  unsigned int idx;
+
+  for (idx = 0; idx < datastream->dircachesize; idx++)
+    free (datastream->dircache[idx]);
+
+  free (datastream->dircache);
+
+  datastream->dircache      = NULL;
+  datastream->dircachesize  = 0;
+  datastream->dircachecount = 0;
+} /* End of ds_freedircache() */
+
+/***************************************************************************
+ * ds_putint:
+ *
+ * Write the decimal representation of value to dst, zero padded to
+ * width characters like printf("%0*ld"), without writing at or
+ * beyond end.
+ *
+ * Returns a pointer to the character after the written value.
+ ***************************************************************************/
+static char *
+ds_putint (char *dst, const char *end, long value, int width)
+{
+  char digits[24];
+  unsigned long uvalue = (value < 0) ? -(unsigned long)value : (unsigned long)value;
+  int count = 0;
+
+  do
+  {
+    digits[count++] = '0' + (char)(uvalue % 10);
+    uvalue /= 10;
+  } while (uvalue);
+
+  /* A sign is included in the width */
+  if (value < 0)
+    width--;
+
+  while (count < width && count < (int)sizeof (digits) - 1)
+    digits[count++] = '0';
+
+  if (value < 0)
+    digits[count++] = '-';
+
+  while (count > 0 && dst < end)
+    *dst++ = digits[--count];
+
+  return dst;
+} /* End of ds_putint() */
@@ -13,12 +13,29 @@
 #define CSSLAYOUT   "%Y/%j/%s.%c.%Y:%j:#H:#M:#S"
 #define SDSLAYOUT   "%Y/%n/%s/%c.D/%n.%s.%l.%c.D.%Y.%j"
 
+/* Token of a compiled archive layout: literal text, a flag expanded
+ * from each record or a directory separator */
+typedef struct DataStreamToken_s
+{
+  char    code;     /* Flag code, 0 for literal text, '/' for a directory */
+  char    defkey;   /* Flag value is part of the definition key */
+  int     length;   /* Length of literal text */
+  const char *literal; /* Literal text, not terminated */
+}
+DataStreamToken;
+
 typedef struct DataStreamGroup_s
 {
   char   *defkey;
   int     filed;
   time_t  modtime;
-  struct  DataStreamGroup_s *next;
+  char   *buffer;            /* Write buffer, NULL if not allocated */
+  size_t  bufsize;           /* Size of write buffer */
+  size_t  buflen;            /* Length of data in write buffer */
+  unsigned int hash;         /* Hash of defkey */
+  struct  DataStreamGroup_s *hashnext; /* Next entry in hash table slot */
+  struct  DataStreamGroup_s *prev; /* Previous, less recently used entry */
+  struct  DataStreamGroup_s *next; /* Next, more recently used entry */
 }
 DataStreamGroup;
 
@@ -26,13 +43,28 @@ typedef struct DataStream_s
 {
   char   *path;
   int     idletimeout;
-  struct  DataStreamGroup_s *grouproot;
+  struct  DataStreamGroup_s *grouproot; /* Least recently used entry */
+  struct  DataStreamGroup_s *grouptail; /* Most recently used entry */
+  DataStreamGroup **grouptable; /* Hash table of entries by defkey */
+  unsigned int grouptablesize; /* Number of table slots, a power of 2 */
+  unsigned int groupcount;   /* Number of entries */
+  DataStreamToken *layout;   /* Compiled path, see ds_compilelayout() */
+  int     layoutcount;       /* Number of tokens in layout */
+  char  **dircache;          /* Hash table of directories known to exist */
+  unsigned int dircachesize; /* Number of table slots, a power of 2 */
+  unsigned int dircachecount; /* Number of used table slots */
 }
 DataStream;
 
 /* Maximum number of open files for all DataStreams */
 extern int ds_maxopenfiles;
 
+/* Size of the write buffer of each DataStreamGroup file, 0 disables
+ * buffering, and the maximum memory for write buffers of all DataStreams */
+extern size_t ds_bufsize;
+extern size_t ds_bufbudget;
+
+extern int ds_compilelayout (DataStream *datastream);
 extern int ds_streamproc (DataStream *datastream, MSRecord *msr,
                           long suffix, int verbose);
 
@@ -0,0 +1,465 @@
+/***************************************************************************
+ * steimtrim.c
+ * Routines to trim samples from Steim1 and Steim2 encoded data without
+ * decoding and re-encoding all of the samples.
+ *
+ * Steim encoded data are a sequence of 64-byte frames, each containing
+ * a word of 16 2-bit nibbles followed by 15 data words.  Words 1 and 2
+ * of the first frame contain the forward (X0) and reverse (Xn)
+ * integration constants, aka the first and last sample values.  The
+ * nibble for each data word identifies how many differences between
+ * consecutive samples are contained in the word.  The first difference
+ * is ignored when decoding as the first sample is X0.
+ *
+ * Trimming walks the data words counting differences.  Words entirely
+ * within the remaining samples are copied verbatim, only the words
+ * containing trimmed samples are decoded and the words containing the
+ * cut points are re-encoded with the remaining differences.  The
+ * integration constants are updated with the sums of the trimmed
+ * differences.
+ ***************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#include "steimtrim.h"
+
+/* Maximum number of differences in a single data word */
+#define STEIM_MAXDIFFS 7
+
+/* Output frame writer state */
+typedef struct SteimWriter_s
+{
+  unsigned char *output; /* Output frames */
+  int maxframes;         /* Maximum number of output frames */
+  int bigendian;         /* Data byte order, 1 = big endian */
+  int frameidx;          /* Current frame */
+  int widx;              /* Next word in current frame */
+  uint32_t nibbles;      /* Nibbles word for current frame */
+} SteimWriter;
+
+/* Steim2 word layouts, in order of preference when encoding */
+static const struct
+{
+  int count;  /* Number of differences */
+  int bits;   /* Bits per difference */
+  int nibble; /* Nibble value */
+  int dnib;   /* Decode nibble, high order two bits of word, -1 if none */
+} steim2layout[] = {
+    {7, 4, 3, 2},
+    {6, 5, 3, 1},
+    {5, 6, 3, 0},
+    {4, 8, 1, -1},
+    {3, 10, 2, 3},
+    {2, 15, 2, 2},
+    {1, 30, 2, 1}};
+
+#define STEIM2_LAYOUTS ((int)(sizeof (steim2layout) / sizeof (steim2layout[0])))
+
+static uint32_t getword (const unsigned char *raw, int bigendian);
+static void setword (unsigned char *raw, uint32_t value, int bigendian);
+static int diffcount (const unsigned char *raw, int nibble, int encoding, int bigendian);
+static int getdiffs (const unsigned char *raw, int nibble, int encoding,
+                     int bigendian, int32_t *diffs);
+static int putword (SteimWriter *writer, int nibble, const unsigned char *raw);
+static int putdiffs (SteimWriter *writer, int encoding, int32_t *diffs, int count);
+static int fitsbits (int32_t *diffs, int count, int bits);
+
+/***************************************************************************
+ * steim_trim():
+ *
+ * Trim starttrim samples from the beginning and endtrim samples from
+ * the end of samplecount Steim1 or Steim2 encoded samples in input and
+ * write the encoded remaining samples to output.  Both input and output
+ * are datalength bytes, unused output frames are zeroed.  The output
+ * must not overlap the input.
+ *
+ * Returns the number of output frames used on success or -1 if the data
+ * cannot be trimmed, e.g. the input contains fewer than samplecount
+ * samples or the remaining samples do not fit in datalength bytes.
+ ***************************************************************************/
+int
+steim_trim (char *output, const char *input, int datalength,
+            int encoding, int bigendian, int samplecount,
+            int starttrim, int endtrim)
+{
+  const unsigned char *frame;
+  SteimWriter writer;
+  int32_t diffs[STEIM_MAXDIFFS];
+  int32_t keep[STEIM_MAXDIFFS];
+  uint32_t nibbles;
+  uint32_t X0;
+  uint32_t Xn;
+  int maxframes = datalength / 64;
+  int lastsample;
+  int sampleidx;
+  int frameidx;
+  int widx;
+  int nibble;
+  int count;
+  int keepcount;
+  int idx;
+
+  if (!output || !input || maxframes <= 0)
+    return -1;
+
+  if (encoding != DE_STEIM1 && encoding != DE_STEIM2)
+    return -1;
+
+  if (starttrim < 0 || endtrim < 0 || (starttrim + endtrim) >= samplecount)
+    return -1;
+
+  /* Index of the last remaining sample */
+  lastsample = samplecount - 1 - endtrim;
+
+  X0 = getword ((const unsigned char *)input + 4, bigendian);
+  Xn = getword ((const unsigned char *)input + 8, bigendian);
+
+  memset (output, 0, datalength);
+
+  /* First output frame starts after the nibbles, X0 and Xn words */
+  writer.output = (unsigned char *)output;
+  writer.maxframes = maxframes;
+  writer.bigendian = bigendian;
+  writer.frameidx = 0;
+  writer.widx = 3;
+  writer.nibbles = 0;
+
+  sampleidx = 0;
+  for (frameidx = 0; frameidx < maxframes && sampleidx < samplecount; frameidx++)
+  {
+    frame = (const unsigned char *)input + (64 * frameidx);
+    nibbles = getword (frame, bigendian);
+
+    for (widx = (frameidx == 0) ? 3 : 1; widx < 16 && sampleidx < samplecount; widx++)
+    {
+      nibble = (nibbles >> (30 - (2 * widx))) & 0x3;
+
+      /* Special words contain no differences */
+      if (nibble == 0)
+        continue;
+
+      if ((count = diffcount (frame + (4 * widx), nibble, encoding, bigendian)) < 0)
+        return -1;
+
+      /* Copy words containing only remaining samples, unless the first
+       * difference is needed to determine the new X0 */
+      if ((sampleidx > starttrim || starttrim == 0) &&
+          (sampleidx + count - 1) <= lastsample)
+      {
+        if (putword (&writer, nibble, frame + (4 * widx)))
+          return -1;
+
+        sampleidx += count;
+        continue;
+      }
+
+      getdiffs (frame + (4 * widx), nibble, encoding, bigendian, diffs);
+
+      /* Integrate trimmed differences and collect remaining differences */
+      keepcount = 0;
+      for (idx = 0; idx < count && sampleidx < samplecount; idx++, sampleidx++)
+      {
+        if (sampleidx < starttrim)
+        {
+          if (sampleidx > 0)
+            X0 += (uint32_t)diffs[idx];
+        }
+        else if (sampleidx <= lastsample)
+        {
+          /* The first remaining difference is ignored by decoders */
+          if (sampleidx == starttrim && sampleidx > 0)
+            X0 += (uint32_t)diffs[idx];
+
+          keep[keepcount++] = diffs[idx];
+        }
+        else
+        {
+          Xn -= (uint32_t)diffs[idx];
+        }
+      }
+
+      if (keepcount > 0 && putdiffs (&writer, encoding, keep, keepcount))
+        return -1;
+    }
+  }
+
+  /* Input does not contain the expected number of samples */
+  if (sampleidx < samplecount)
+    return -1;
+
+  /* Store integration constants and nibbles of last frame */
+  setword ((unsigned char *)output + 4, X0, bigendian);
+  setword ((unsigned char *)output + 8, Xn, bigendian);
+  setword ((unsigned char *)output + (64 * writer.frameidx), writer.nibbles, bigendian);
+
+  return writer.frameidx + 1;
+} /* End of steim_trim() */
+
+/***************************************************************************
+ * getword():
+ *
+ * Returns the 32-bit word at raw in the specified byte order.
+ ***************************************************************************/
+static uint32_t
+getword (const unsigned char *raw, int bigendian)
+{
+  if (bigendian)
+    return ((uint32_t)raw[0] << 24) | ((uint32_t)raw[1] << 16) |
+           ((uint32_t)raw[2] << 8) | (uint32_t)raw[3];
+  else
+    return ((uint32_t)raw[3] << 24) | ((uint32_t)raw[2] << 16) |
+           ((uint32_t)raw[1] << 8) | (uint32_t)raw[0];
+} /* End of getword() */
+
+/***************************************************************************
+ * setword():
+ *
+ * Store a 32-bit word at raw in the specified byte order.
+ ***************************************************************************/
+static void
+setword (unsigned char *raw, uint32_t value, int bigendian)
+{
+  int idx;
+
+  for (idx = 0; idx < 4; idx++)
+    raw[(bigendian) ? 3 - idx : idx] = (unsigned char)(value >> (8 * idx));
+} /* End of setword() */
+
+/***************************************************************************
+ * diffcount():
+ *
+ * Determine the number of differences in a data word from the nibble
+ * and, for Steim2, the decode nibble in the word.
+ *
+ * Returns the number of differences or -1 for undefined combinations.
+ ***************************************************************************/
+static int
+diffcount (const unsigned char *raw, int nibble, int encoding, int bigendian)
+{
+  int dnib;
+
+  if (encoding == DE_STEIM1)
+    return (nibble == 1) ? 4 : (nibble == 2) ? 2 : 1;
+
+  if (nibble == 1)
+    return 4;
+
+  dnib = getword (raw, bigendian) >> 30;
+
+  if (nibble == 2)
+    return (dnib == 0) ? -1 : dnib;
+
+  return (dnib == 3) ? -1 : 5 + dnib;
+} /* End of diffcount() */
+
+/***************************************************************************
+ * getdiffs():
+ *
+ * Decode the differences in a data word into diffs, which must have
+ * space for STEIM_MAXDIFFS values.
+ *
+ * Returns the number of differences or -1 for undefined combinations.
+ ***************************************************************************/
+static int
+getdiffs (const unsigned char *raw, int nibble, int encoding,
+          int bigendian, int32_t *diffs)
+{
+  uint32_t word;
+  uint32_t semask;
+  uint32_t mask;
+  int count;
+  int bits;
+  int idx;
+
+  if ((count = diffcount (raw, nibble, encoding, bigendian)) < 0)
+    return -1;
+
+  /* Four 1-byte differences in byte order for both encodings */
+  if (nibble == 1)
+  {
+    for (idx = 0; idx < 4; idx++)
+      diffs[idx] = (int8_t)raw[idx];
+
+    return count;
+  }
+
+  word = getword (raw, bigendian);
+
+  if (encoding == DE_STEIM1)
+  {
+    if (count == 2)
+    {
+      if (bigendian)
+      {
+        diffs[0] = (int16_t)(word >> 16);
+        diffs[1] = (int16_t)(word & 0xFFFF);
+      }
+      else
+      {
+        diffs[0] = (int16_t)(word & 0xFFFF);
+        diffs[1] = (int16_t)(word >> 16);
+      }
+    }
+    else
+    {
+      diffs[0] = (int32_t)word;
+    }
+
+    return count;
+  }
+
+  for (idx = 0; steim2layout[idx].count != count; idx++)
+    ;
+  bits = steim2layout[idx].bits;
+
+  mask = (1u << bits) - 1;
+  semask = 1u << (bits - 1);
+
+  for (idx = 0; idx < count; idx++)
+    diffs[idx] = (int32_t)((((word >> ((count - 1 - idx) * bits)) & mask) ^ semask) - semask);
+
+  return count;
+} /* End of getdiffs() */
+
+/***************************************************************************
+ * putword():
+ *
+ * Append a data word with the specified nibble to the output frames.
+ *
+ * Returns 0 on success and -1 if the output frames are full.
+ ***************************************************************************/
+static int
+putword (SteimWriter *writer, int nibble, const unsigned char *raw)
+{
+  /* Store nibbles and move to the next frame when the current is full */
+  if (writer->widx >= 16)
+  {
+    if (writer->frameidx + 1 >= writer->maxframes)
+      return -1;
+
+    setword (writer->output + (64 * writer->frameidx), writer->nibbles, writer->bigendian);
+
+    writer->frameidx++;
+    writer->widx = 1;
+    writer->nibbles = 0;
+  }
+
+  memcpy (writer->output + (64 * writer->frameidx) + (4 * writer->widx), raw, 4);
+  writer->nibbles |= (uint32_t)nibble << (30 - (2 * writer->widx));
+  writer->widx++;
+
+  return 0;
+} /* End of putword() */
+
+/***************************************************************************
+ * putdiffs():
+ *
+ * Encode differences into as few data words as possible and append
+ * them to the output frames.
+ *
+ * Returns 0 on success and -1 if the differences cannot be encoded or
+ * the output frames are full.
+ ***************************************************************************/
+static int
+putdiffs (SteimWriter *writer, int encoding, int32_t *diffs, int count)
+{
+  unsigned char raw[4];
+  uint32_t word = 0;
+  int layout;
+  int nibble;
+  int bits;
+  int packed;
+  int idx;
+
+  while (count > 0)
+  {
+    if (encoding == DE_STEIM1)
+    {
+      if (count >= 4 && fitsbits (diffs, 4, 8))
+      {
+        nibble = 1;
+        packed = 4;
+      }
+      else if (count >= 2 && fitsbits (diffs, 2, 16))
+      {
+        nibble = 2;
+        packed = 2;
+
+        if (writer->bigendian)
+          word = ((uint32_t) (uint16_t)diffs[0] << 16) | (uint16_t)diffs[1];
+        else
+          word = ((uint32_t) (uint16_t)diffs[1] << 16) | (uint16_t)diffs[0];
+      }
+      else
+      {
+        nibble = 3;
+        packed = 1;
+        word = (uint32_t)diffs[0];
+      }
+    }
+    else
+    {
+      /* Select the layout containing the most differences that fit */
+      for (layout = 0; layout < STEIM2_LAYOUTS; layout++)
+      {
+        if (steim2layout[layout].count <= count &&
+            fitsbits (diffs, steim2layout[layout].count, steim2layout[layout].bits))
+          break;
+      }
+
+      if (layout >= STEIM2_LAYOUTS)
+        return -1;
+
+      nibble = steim2layout[layout].nibble;
+      packed = steim2layout[layout].count;
+      bits = steim2layout[layout].bits;
+
+      word = (uint32_t)steim2layout[layout].dnib << 30;
+      for (idx = 0; idx < packed; idx++)
+        word |= ((uint32_t)diffs[idx] & ((1u << bits) - 1)) << ((packed - 1 - idx) * bits);
+    }
+
+    /* Four 1-byte differences are stored in byte order for both encodings */
+    if (nibble == 1)
+    {
+      for (idx = 0; idx < 4; idx++)
+        raw[idx] = (unsigned char)diffs[idx];
+    }
+    else
+    {
+      setword (raw, word, writer->bigendian);
+    }
+
+    if (putword (writer, nibble, raw))
+      return -1;
+
+    diffs += packed;
+    count -= packed;
+  }
+
+  return 0;
+} /* End of putdiffs() */
+
+/***************************************************************************
+ * fitsbits():
+ *
+ * Returns 1 if the first count differences can be represented as
+ * signed integers of the specified bits, otherwise 0.
+ ***************************************************************************/
+static int
+fitsbits (int32_t *diffs, int count, int bits)
+{
+  int32_t limit = (int32_t)1 << (bits - 1);
+  int idx;
+
+  for (idx = 0; idx < count; idx++)
+  {
+    if (diffs[idx] < -limit || diffs[idx] >= limit)
+      return 0;
+  }
+
+  return 1;
+} /* End of fitsbits() */
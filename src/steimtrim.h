@@ -0,0 +1,9 @@
+
+#ifndef STEIMTRIM_H
+#define STEIMTRIM_H
+
+extern int steim_trim (char *output, const char *input, int datalength,
+                       int encoding, int bigendian, int samplecount,
+                       int starttrim, int endtrim);
+
+#endif /* STEIMTRIM_H */
@@ -0,0 +1,110 @@
+/***************************************************************************
+ * dftestparse.c
+ *
+ * A program to print miniSEED records produced by datafilter tests.
+ *
+ * For each record the header summary is printed followed by the
+ * sample count and a checksum of the decoded samples.  With -D all
+ * samples are also printed.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+static void print_stderr (char *message);
+
+int
+main (int argc, char **argv)
+{
+  MSRecord *msr = 0;
+  char *inputfile = 0;
+  flag printdata = 0;
+  flag details = 0;
+  uint32_t checksum;
+  uint64_t value;
+  int samplesize;
+  int byte;
+  int retcode;
+  int idx;
+
+  /* Redirect libmseed logging facility to stderr for consistency */
+  ms_loginit (print_stderr, NULL, print_stderr, NULL);
+
+  for (idx = 1; idx < argc; idx++)
+  {
+    if (strcmp (argv[idx], "-D") == 0)
+      printdata = 1;
+    else if (strcmp (argv[idx], "-p") == 0)
+      details = 1;
+    else
+      inputfile = argv[idx];
+  }
+
+  if (!inputfile)
+  {
+    fprintf (stderr, "Usage: dftestparse [-p] [-D] file|-\n");
+    return 1;
+  }
+
+  /* Loop over the input file */
+  while ((retcode = ms_readmsr (&msr, inputfile, -1, NULL, NULL, 1, 1, 0)) == MS_NOERROR)
+  {
+    msr_print (msr, details);
+
+    samplesize = ms_samplesize (msr->sampletype);
+
+    /* FNV-1a hash of the decoded sample values, least significant byte
+     * first independent of host byte order */
+    checksum = 2166136261u;
+    for (idx = 0; idx < msr->numsamples; idx++)
+    {
+      if (samplesize == 8)
+        memcpy (&value, (char *)msr->datasamples + idx * 8, 8);
+      else if (samplesize == 4)
+        value = ((uint32_t *)msr->datasamples)[idx];
+      else
+        value = ((uint8_t *)msr->datasamples)[idx];
+
+      for (byte = 0; byte < samplesize; byte++)
+      {
+        checksum ^= (uint8_t) (value >> (byte * 8));
+        checksum *= 16777619u;
+      }
+    }
+
+    ms_log (0, "  %" PRId64 " samples, checksum %08X\n", msr->numsamples, checksum);
+
+    if (printdata)
+    {
+      for (idx = 0; idx < msr->numsamples; idx++)
+      {
+        if (msr->sampletype == 'i')
+          ms_log (0, "%10d  ", ((int32_t *)msr->datasamples)[idx]);
+        else if (msr->sampletype == 'f')
+          ms_log (0, "%10.8g  ", ((float *)msr->datasamples)[idx]);
+        else if (msr->sampletype == 'd')
+          ms_log (0, "%10.10g  ", ((double *)msr->datasamples)[idx]);
+
+        if (idx % 6 == 5 || idx == msr->numsamples - 1)
+          ms_log (0, "\n");
+      }
+    }
+  }
+
+  if (retcode != MS_ENDOFFILE)
+    ms_log (2, "Cannot read %s: %s\n", inputfile, ms_errorstr (retcode));
+
+  /* Make sure everything is cleaned up */
+  ms_readmsr (&msr, NULL, 0, NULL, NULL, 0, 0, 0);
+
+  return 0;
+} /* End of main() */
+
+static void
+print_stderr (char *message)
+{
+  fprintf (stderr, "%s", message);
+} /* End of print_stderr() */